@@ -0,0 +1,149 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "BatchWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+ssize_t BatchWriter::WaitWritable(long timeout) {
+    if (!_writer->IsOpen()) {
+        return CLOSED;
+    }
+    // Writes are buffered, so only wait if the next write will have to flush a full batch
+    if (Pending() < _max_bytes) {
+        return OK;
+    }
+    return _writer->WaitWritable(timeout);
+}
+
+ssize_t BatchWriter::WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) {
+    if (!_writer->IsOpen()) {
+        return CLOSED;
+    }
+
+    if (Pending() == 0) {
+        Clear();
+        _pending_since = std::chrono::steady_clock::now();
+    }
+
+    if (_datagram && size > 0) {
+        _msg_ends.push_back(_size + size);
+    }
+
+    auto ptr = reinterpret_cast<const uint8_t*>(buf);
+    while (size > 0) {
+        auto idx = _size / CHUNK_SIZE;
+        auto offset = _size % CHUNK_SIZE;
+        if (idx >= _chunks.size()) {
+            _chunks.emplace_back(new uint8_t[CHUNK_SIZE]);
+        }
+        auto n = std::min(size, CHUNK_SIZE - offset);
+        memcpy(_chunks[idx].get() + offset, ptr, n);
+        ptr += n;
+        size -= n;
+        _size += n;
+    }
+
+    if (Pending() >= _max_bytes) {
+        return Flush(timeout, fn);
+    }
+    return OK;
+}
+
+ssize_t BatchWriter::Flush(long timeout, const std::function<bool()>& fn) {
+    if (Pending() == 0) {
+        return OK;
+    }
+
+    if (_datagram) {
+        build_msgs();
+        Clear();
+        return _writer->SendAllMessages(_msgs.data(), static_cast<unsigned int>(_msgs.size()), timeout, fn);
+    }
+
+    build_iov();
+    Clear();
+
+    return _writer->WriteAllV(_iov.data(), static_cast<int>(_iov.size()), timeout, fn);
+}
+
+ssize_t BatchWriter::WriteSome() {
+    if (Pending() == 0) {
+        return OK;
+    }
+
+    ssize_t ret;
+    if (_datagram) {
+        build_msgs();
+        ret = _writer->SendMessages(_msgs.data(), static_cast<unsigned int>(_msgs.size()));
+        if (ret <= 0) {
+            return ret;
+        }
+        _msg_offset += ret;
+        _offset = _msg_ends[_msg_offset-1];
+    } else {
+        build_iov();
+        ret = _writer->WriteV(_iov.data(), static_cast<int>(_iov.size()));
+        if (ret <= 0) {
+            return ret;
+        }
+        _offset += ret;
+    }
+
+    if (Pending() == 0) {
+        Clear();
+        return OK;
+    }
+    return TIMEOUT;
+}
+
+void BatchWriter::append_iov(size_t begin, size_t end) {
+    size_t pos = begin;
+    while (pos < end) {
+        auto idx = pos / CHUNK_SIZE;
+        auto offset = pos % CHUNK_SIZE;
+        auto n = std::min(end - pos, CHUNK_SIZE - offset);
+        _iov.push_back({_chunks[idx].get() + offset, n});
+        pos += n;
+    }
+}
+
+void BatchWriter::build_iov() {
+    _iov.clear();
+    append_iov(_offset, _size);
+}
+
+void BatchWriter::build_msgs() {
+    _iov.clear();
+    _msgs.resize(_msg_ends.size() - _msg_offset);
+    size_t begin = _offset;
+    for (size_t i = 0; i < _msgs.size(); ++i) {
+        auto end = _msg_ends[_msg_offset+i];
+        auto iov_start = _iov.size();
+        append_iov(begin, end);
+        memset(&_msgs[i], 0, sizeof(struct mmsghdr));
+        _msgs[i].msg_hdr.msg_iovlen = _iov.size() - iov_start;
+        begin = end;
+    }
+    // _iov is complete, so the pointers into it are now stable
+    size_t iov_idx = 0;
+    for (auto& msg : _msgs) {
+        msg.msg_hdr.msg_iov = _iov.data() + iov_idx;
+        iov_idx += msg.msg_hdr.msg_iovlen;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef AUOMS_BATCHWRITER_H
+#define AUOMS_BATCHWRITER_H
+
+#include "IO.h"
+
+#include <memory>
+#include <vector>
+#include <chrono>
+
+/*
+ * Accumulates writes into a set of reusable fixed size chunks and writes them
+ * to the underlying IOBase with writev() once max_bytes have accumulated, or
+ * when Flush() is called.
+ *
+ * If the underlying writer is a datagram socket, each WriteAll() is kept as a
+ * separate message and the messages are sent with sendmmsg() instead.
+ */
+class BatchWriter: public IWriter {
+public:
+    static constexpr size_t CHUNK_SIZE = 64*1024;
+
+    BatchWriter(std::shared_ptr<IOBase> writer, size_t max_bytes): _writer(std::move(writer)), _datagram(_writer->IsDatagram()),
+        _max_bytes(max_bytes), _size(0), _offset(0), _msg_offset(0) {}
+
+    ssize_t WaitWritable(long timeout) override;
+
+    ssize_t WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) override;
+    using IWriter::WriteAll;
+
+    /*
+     * Write all pending data to the underlying writer.
+     * The pending data is discarded regardless of the outcome.
+     *
+     * Return OK on success
+     * Return CLOSED if fd closed
+     * Return FAILED if write failed
+     * Return TIMEOUT if write timeout occurred
+     * Return INTERRUPTED if signal received
+     */
+    ssize_t Flush(long timeout, const std::function<bool()>& fn);
+
+    /*
+     * Write as much pending data as possible with a single writev() call.
+     * Intended for use with non-blocking writers, unwritten data remains pending.
+     *
+     * Return OK if all pending data was written
+     * Return TIMEOUT if some data remains pending
+     * Return CLOSED if fd closed
+     * Return FAILED if write failed
+     */
+    ssize_t WriteSome();
+
+    size_t Pending() const { return _size - _offset; }
+
+    // Time at which the oldest pending data was added
+    std::chrono::steady_clock::time_point PendingSince() const { return _pending_since; }
+
+    void Clear() { _size = 0; _offset = 0; _msg_ends.clear(); _msg_offset = 0; }
+
+private:
+    void append_iov(size_t begin, size_t end);
+    void build_iov();
+    void build_msgs();
+
+    std::shared_ptr<IOBase> _writer;
+    bool _datagram;
+    size_t _max_bytes;
+    size_t _size;
+    size_t _offset;
+    // In datagram mode, the end offset of each message, and the index of the first unsent message
+    std::vector<size_t> _msg_ends;
+    size_t _msg_offset;
+    std::chrono::steady_clock::time_point _pending_since;
+    std::vector<std::unique_ptr<uint8_t[]>> _chunks;
+    std::vector<struct iovec> _iov;
+    std::vector<struct mmsghdr> _msgs;
+};
+
+#endif //AUOMS_BATCHWRITER_H
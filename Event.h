@@ -25,6 +25,8 @@
 
 
 constexpr uint32_t EVENT_FLAG_IS_AUOMS_EVENT = 1;
+// Interp values were not computed by the event processor and must be produced by the output (if needed)
+constexpr uint32_t EVENT_FLAG_INTERP_DEFERRED = 2;
 
 class IEventBuilderAllocator {
 public:
@@ -53,6 +55,13 @@ public:
     int EndRecord();
     int AddField(const char *field_name, const char* raw_value, const char* interp_value, field_type_t field_type);
     int AddField(const std::string_view& field_name, const std::string_view& raw_value, const std::string_view& interp_value, field_type_t field_type);
+    // Constructing a std::string_view from nullptr is undefined, so catch the no-interp-value case explicitly.
+    inline int AddField(const char *field_name, const char* raw_value, std::nullptr_t, field_type_t field_type) {
+        return AddField(field_name, raw_value, static_cast<const char*>(nullptr), field_type);
+    }
+    inline int AddField(const std::string_view& field_name, const std::string_view& raw_value, std::nullptr_t, field_type_t field_type) {
+        return AddField(field_name, raw_value, std::string_view(), field_type);
+    }
     int GetFieldCount();
 
 private:
@@ -16,6 +16,7 @@
 
 #include "EventFilter.h"
 #include "RecordType.h"
+#include "Interpret.h"
 #include "Logger.h"
 
 std::shared_ptr<IEventFilter> EventFilter::NewEventFilter(const std::string& name, const Config& config, std::shared_ptr<UserDB> user_db, std::shared_ptr<FiltersEngine> filtersEngine, std::shared_ptr<ProcessTree> processTree) {
@@ -43,26 +44,29 @@ EventFilter::~EventFilter() {
 bool EventFilter::IsEventFiltered(const Event& event) {
     static std::string S_SYSCALL = "syscall";
 
-    bool filtered = false;
-    // Get event syscall
-    std::string syscall;
+    std::bitset<FILTER_BITSET_SIZE> flags;
+    if (_filtersEngine->GetEventFilterFlags(EventId(event.Seconds(), event.Milliseconds(), event.Serial()), flags)) {
+        return (flags & _filterFlagsMask).any();
+    }
+
+    MachineType mtype = MachineType::UNKNOWN;
+    int syscall = -1;
 
     for (auto rec : event) {
-        if (rec.RecordType() != static_cast<uint32_t>(RecordType::SYSCALL)) {
+        auto rtype = static_cast<RecordType>(rec.RecordType());
+        if (rtype != RecordType::SYSCALL && rtype != RecordType::AUOMS_SYSCALL && rtype != RecordType::AUOMS_EXECVE) {
             continue;
         }
         auto field = rec.FieldByName(S_SYSCALL);
         if (field) {
-            syscall = field.InterpValue();
+            FieldToSyscall(rec, field, mtype, syscall);
             break;
         }
     }
 
-    std::shared_ptr<ProcessTreeItem> p = nullptr;
-
-    if (!syscall.empty()) {
-        p = _processTree->GetInfoForPid(event.Pid());
+    if (syscall < 0) {
+        return false;
     }
 
-    return !syscall.empty() && _filtersEngine->IsEventFiltered(syscall, p, _filterFlagsMask);
+    return _filtersEngine->IsEventFiltered(mtype, syscall, _processTree->GetInfoForPid(event.Pid()), _filterFlagsMask);
 }
@@ -70,29 +70,48 @@ int parse_execve_fieldname(const std::string_view& fname, const std::string_view
     return -1;
 }
 
-void ExecveConverter::Convert(std::vector<EventRecord> execve_recs, std::string& cmdline) {
-    static auto S_ELIPSIS = std::string("...");
-    static auto S_MISSING_ARG_PIECE = std::string("<...>");
+// Equivalent to unescape_raw_field() followed by bash_escape_string() but avoids copying quoted values.
+void ExecveConverter::append_arg(std::string& cmdline, const std::string_view& val) {
+    if (val.empty()) {
+        bash_escape_string(cmdline, val.data(), 0);
+    } else if (val[0] == '"' && val.size() >= 2 && val.back() == '"') {
+        bash_escape_string(cmdline, val.data()+1, val.size()-2);
+    } else if (val[0] == '"' || val[0] == '(') {
+        bash_escape_string(cmdline, val.data(), val.size());
+    } else {
+        decode_hex(_unescaped_val, val.data(), val.size());
+        bash_escape_string(cmdline, _unescaped_val.data(), _unescaped_val.size());
+    }
+}
+
+void ExecveConverter::Convert(const std::vector<EventRecord>& execve_recs, std::string& cmdline) {
+    static auto S_ELIPSIS = std::string_view("...");
+    static auto S_MISSING_ARG_PIECE = std::string_view("<...>");
 
     cmdline.resize(0);
 
     // Sort EXECVE records so that args (e.g. a0, a1, a2 ...) will be in order.
-    std::sort(execve_recs.begin(), execve_recs.end(), [](const EventRecord& a, const EventRecord& b) -> int {
-        auto fa = a.FieldAt(0);
-        auto fb = b.FieldAt(0);
-        int a_num = parse_execve_argnum(fa.FieldName());
-        int b_num = parse_execve_argnum(fb.FieldName());
-
-        return a_num < b_num;
-    });
+    // Only the (arg num, index) pairs are sorted, the records themselves are not copied.
+    _rec_order.resize(0);
+    size_t total_size = 0;
+    for (size_t i = 0; i < execve_recs.size(); ++i) {
+        auto& rec = execve_recs[i];
+        _rec_order.emplace_back(parse_execve_argnum(rec.FieldAt(0).FieldName()), i);
+        total_size += rec.RecordTextSize();
+    }
+    std::sort(_rec_order.begin(), _rec_order.end());
 
+    // The unescaped cmdline is almost always shorter than the sum of the raw record text sizes.
+    if (cmdline.capacity() < total_size) {
+        cmdline.reserve(total_size);
+    }
 
     int expected_arg_num = 0;
     int expected_arg_len = 0;
     int accum_arg_len = 0;
     int expected_arg_idx = 0;
-    for (auto& rec : execve_recs) {
-        for (auto &f : rec) {
+    for (auto& order : _rec_order) {
+        for (auto &f : execve_recs[order.second]) {
             auto fname = f.FieldName();
             auto val = f.RawValue();
             int arg_num = 0;
@@ -126,9 +145,9 @@ void ExecveConverter::Convert(std::vector<EventRecord> execve_recs, std::string&
                     cmdline.push_back(' ');
                 }
                 cmdline.push_back('<');
-                cmdline.append(std::to_string(expected_arg_num));
+                append_int(cmdline, expected_arg_num);
                 cmdline.append(S_ELIPSIS);
-                cmdline.append(std::to_string(arg_num-1));
+                append_int(cmdline, arg_num-1);
                 cmdline.push_back('>');
                 expected_arg_num = arg_num;
             }
@@ -146,12 +165,10 @@ void ExecveConverter::Convert(std::vector<EventRecord> execve_recs, std::string&
                         expected_arg_idx = 0;
                     }
 
-                    _unescaped_val.resize(0);
                     if (!cmdline.empty()) {
                         cmdline.push_back(' ');
                     }
-                    unescape_raw_field(_unescaped_val, val.data(), val.size());
-                    bash_escape_string(cmdline, _unescaped_val.data(), _unescaped_val.length());
+                    append_arg(cmdline, val);
                     expected_arg_num += 1;
                     break;
                 case 1: // a%d_len=%d
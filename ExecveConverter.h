@@ -7,16 +7,21 @@
 
 #include "Event.h"
 
+#include <string>
+#include <string_view>
 #include <vector>
 
 class ExecveConverter {
 public:
-    void Convert(std::vector<EventRecord> execve_recs, std::string& cmdline);
+    void Convert(const std::vector<EventRecord>& execve_recs, std::string& cmdline);
 
     // Assumes that raw_cmdline contains NUL delimited args
     static void ConvertRawCmdline(const std::string_view& raw_cmdline, std::string& cmdline);
 
 private:
+    void append_arg(std::string& cmdline, const std::string_view& val);
+
+    std::vector<std::pair<int, size_t>> _rec_order;
     std::string _tmp_val;
     std::string _unescaped_val;
 };
@@ -0,0 +1,147 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define BOOST_TEST_DYN_LINK
+
+#include "ExecveConverter.h"
+#include "TestEventQueue.h"
+#include "RecordType.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Measures ExecveConverter::Convert throughput (execs/sec) for a few typical argv shapes.
+ *
+ * Usage: ExecveConverterBench [iterations]
+ */
+
+typedef std::vector<std::vector<std::pair<std::string, std::string>>> ExecveRecs;
+
+std::string to_hex(const std::string& str) {
+    static const char* hex_chars = "0123456789ABCDEF";
+    std::string out;
+    for (auto c : str) {
+        out.push_back(hex_chars[static_cast<uint8_t>(c) >> 4]);
+        out.push_back(hex_chars[static_cast<uint8_t>(c) & 0xF]);
+    }
+    return out;
+}
+
+std::string quote(const std::string& str) {
+    return "\"" + str + "\"";
+}
+
+ExecveRecs make_simple() {
+    return {{{"argc", "3"}, {"a0", quote("ls")}, {"a1", quote("-l")}, {"a2", quote("/tmp")}}};
+}
+
+ExecveRecs make_shell() {
+    return {{
+        {"argc", "3"},
+        {"a0", quote("/bin/sh")},
+        {"a1", quote("-c")},
+        {"a2", to_hex("cd /var/log && grep -i 'error' syslog | tail -n 100 > /tmp/errors.txt")},
+    }};
+}
+
+ExecveRecs make_many_args() {
+    std::vector<std::pair<std::string, std::string>> rec;
+    rec.emplace_back("argc", "64");
+    for (int i = 0; i < 64; ++i) {
+        std::string name = "a" + std::to_string(i);
+        if (i % 4 == 3) {
+            rec.emplace_back(name, to_hex("--opt=value with space " + std::to_string(i)));
+        } else {
+            rec.emplace_back(name, quote("--arg" + std::to_string(i)));
+        }
+    }
+    return {rec};
+}
+
+ExecveRecs make_multi_part() {
+    std::string arg;
+    for (int i = 0; i < 1024; ++i) {
+        arg.push_back('a' + (i % 26));
+    }
+    auto hex = to_hex(arg);
+    std::vector<std::pair<std::string, std::string>> rec1 = {{"argc", "2"}, {"a0", quote("java")}, {"a1_len", std::to_string(hex.size())}};
+    std::vector<std::pair<std::string, std::string>> rec2;
+    size_t part_size = 512;
+    for (size_t i = 0; i*part_size < hex.size(); ++i) {
+        rec2.emplace_back("a1[" + std::to_string(i) + "]", hex.substr(i*part_size, part_size));
+    }
+    // Put the records out of order to exercise the sort
+    return {rec2, rec1};
+}
+
+std::vector<EventRecord> build_records(EventBuilder& builder, TestEventQueue& queue, const ExecveRecs& recs) {
+    builder.BeginEvent(1, 0, 1, static_cast<uint16_t>(recs.size()));
+    for (auto& rec : recs) {
+        builder.BeginRecord(static_cast<uint32_t>(RecordType::EXECVE), "EXECVE", "", static_cast<uint16_t>(rec.size()));
+        for (auto& f : rec) {
+            builder.AddField(f.first, f.second, std::string_view(), field_type_t::UNCLASSIFIED);
+        }
+        builder.EndRecord();
+    }
+    builder.EndEvent();
+
+    std::vector<EventRecord> out;
+    auto event = queue.GetEvent(static_cast<int>(queue.GetEventCount()-1));
+    for (auto& rec : event) {
+        out.emplace_back(rec);
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    long iterations = 1000000;
+    if (argc > 1) {
+        iterations = std::stol(argv[1]);
+    }
+
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+
+    std::vector<std::pair<std::string, ExecveRecs>> cases = {
+            {"simple", make_simple()},
+            {"shell", make_shell()},
+            {"many-args", make_many_args()},
+            {"multi-part", make_multi_part()},
+    };
+
+    ExecveConverter converter;
+    std::string cmdline;
+    for (auto& c : cases) {
+        auto recs = build_records(builder, *queue, c.second);
+
+        converter.Convert(recs, cmdline);
+        size_t cmdline_size = cmdline.size();
+
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            converter.Convert(recs, cmdline);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+
+        std::cout << c.first << ": " << static_cast<uint64_t>(iterations/secs) << " execs/sec"
+                  << " (" << cmdline_size << " byte cmdline)" << std::endl;
+    }
+
+    return 0;
+}
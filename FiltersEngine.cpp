@@ -17,6 +17,7 @@
 
 #include "Logger.h"
 #include "StringUtils.h"
+#include "Translate.h"
 
 #include <string>
 #include <iostream>
@@ -44,22 +45,26 @@ std::bitset<FILTER_BITSET_SIZE> FiltersEngine::AddFilter(const ProcFilterSpec& p
         info.outputs.emplace(outputName);
         _filtersBitPosition[pfs] = info;
         ret[_nextBitPosition] = 1;
+        _bitGenerations[_nextBitPosition] = _generation;
 
-        // Insert the syscalls *in order* into an unordered_map that maps each one to a bool.
-        // A true value indicates an exclusion syscall (no !) and a false value indicates an
-        // inclusion syscall (!syscall).  If the syscall is already in the unordered_map then
-        // ignore the repetitions; e.g. take the first value for each syscall only.
-        std::unordered_map<std::string, bool>& syscalls = _bitPositionSyscalls[_nextBitPosition];
-        for (auto s : pfs._syscalls) {
-            if (s[0] != '!') {
-                if (syscalls.count(s) == 0) {
-                    syscalls[s] = true;
-                }
-            } else {
-                if (syscalls.count(s.substr(1)) == 0) {
-                    syscalls[s] = false;
+        for (auto& s : pfs._syscalls) {
+            auto name = std::string_view(s);
+            if (!name.empty() && name[0] == '!') {
+                name.remove_prefix(1);
+            }
+            if (name == "*") {
+                continue;
+            }
+            bool found = false;
+            for (int m = 0; m < NUM_MACHINE_TYPES; ++m) {
+                if (SyscallNameToNumber(static_cast<MachineType>(m), name) >= 0) {
+                    found = true;
+                    break;
                 }
             }
+            if (!found) {
+                Logger::Warn("FiltersEngine: Unknown syscall '%s' in process filter for output '%s'", s.c_str(), outputName.c_str());
+            }
         }
         _nextBitPosition++;
     }
@@ -73,13 +78,15 @@ std::bitset<FILTER_BITSET_SIZE> FiltersEngine::AddFilter(const ProcFilterSpec& p
 
 std::bitset<FILTER_BITSET_SIZE> FiltersEngine::AddFilterList(const std::vector<ProcFilterSpec>& pfsVec, const std::string& outputName)
 {
+    std::lock_guard<std::mutex> lock(_mutex);
     std::bitset<FILTER_BITSET_SIZE> ret;
 
+    _generation++;
     for (auto pfs : pfsVec) {
         ret |= AddFilter(pfs, outputName);
     }
 
-    SetCommonFlagsMask();
+    Publish();
 
     return ret;
 }
@@ -100,7 +107,7 @@ void FiltersEngine::RemoveFilter(const ProcFilterSpec& pfs, const std::string& o
 
     if (info.outputs.size() <= 1) {
         // outputs is either empty or only contains this output
-        _bitPositionSyscalls.erase(info.bitPosition);
+        _bitGenerations[info.bitPosition] = _generation;
         _filtersBitPosition.erase(pfs);
     } else {
         // outputs contains this output and others
@@ -110,98 +117,177 @@ void FiltersEngine::RemoveFilter(const ProcFilterSpec& pfs, const std::string& o
 
 void FiltersEngine::RemoveFilterList(const std::vector<ProcFilterSpec>& pfsVec, const std::string& outputName)
 {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _generation++;
     for (auto pfs : pfsVec) {
         RemoveFilter(pfs, outputName);
     }
 
     _outputs.erase(outputName);
-    SetCommonFlagsMask();
+    Publish();
 }
 
-bool FiltersEngine::ProcessMatchFilter(const std::shared_ptr<ProcessTreeItem>& process, const ProcFilterSpec& pfs, unsigned int height)
+void FiltersEngine::Publish()
 {
-    if (pfs._depth != -1 && pfs._depth < height) {
-        return false;
-    }
+    auto snapshot = std::make_shared<FiltersSnapshot>();
+    snapshot->generation = _generation;
+    snapshot->numBits = _nextBitPosition;
+    snapshot->bitGenerations = _bitGenerations;
+    SetCommonFlagsMask(*snapshot);
+    CompileSyscalls(*snapshot);
+    CompileMatchers(*snapshot);
+    std::atomic_store(&_snapshot, std::shared_ptr<const FiltersSnapshot>(std::move(snapshot)));
+}
 
-    if (pfs._match_mask & PFS_MATCH_UID) {
-        if (pfs._uid != process->_uid) {
-            return false;
+void FiltersEngine::CompileMatchers(FiltersSnapshot& snapshot)
+{
+    static auto pattern_type = [](StringMatchType type) {
+        switch (type) {
+            case MatchEquals:
+                return PatternType::EQUALS;
+            case MatchStartsWith:
+                return PatternType::STARTS_WITH;
+            case MatchContains:
+                return PatternType::CONTAINS;
+            default:
+                return PatternType::REGEX;
         }
-    }
-
-    if (pfs._match_mask & PFS_MATCH_GID) {
-        if (pfs._gid != process->_gid) {
-            return false;
+    };
+
+    for (auto& element : _filtersBitPosition) {
+        auto& pfs = element.first;
+        FiltersSnapshot::CompiledFilter cf;
+        cf.bit = element.second.bitPosition;
+        cf.match_mask = pfs._match_mask;
+        cf.depth = pfs._depth;
+        cf.uid = pfs._uid;
+        cf.gid = pfs._gid;
+
+        if (pfs._match_mask & PFS_MATCH_EXE_EQUALS) {
+            cf.exe_patterns.emplace_back(snapshot.exeMatcher.Add(PatternType::EQUALS, pfs._exeMatchValue));
         }
+        if (pfs._match_mask & PFS_MATCH_EXE_STARTSWITH) {
+            cf.exe_patterns.emplace_back(snapshot.exeMatcher.Add(PatternType::STARTS_WITH, pfs._exeMatchValue));
+        }
+        if (pfs._match_mask & PFS_MATCH_EXE_CONTAINS) {
+            cf.exe_patterns.emplace_back(snapshot.exeMatcher.Add(PatternType::CONTAINS, pfs._exeMatchValue));
+        }
+        if (pfs._match_mask & PFS_MATCH_EXE_REGEX) {
+            cf.exe_patterns.emplace_back(snapshot.exeMatcher.Add(PatternType::REGEX, pfs._exeMatchValue));
+        }
+        for (auto& cmf : pfs._cmdlineFilters) {
+            if (cmf._matchType != MatchUndefined) {
+                cf.cmdline_patterns.emplace_back(snapshot.cmdlineMatcher.Add(pattern_type(cmf._matchType), cmf._matchValue));
+            }
+        }
+
+        snapshot.compiledFilters.emplace_back(std::move(cf));
     }
 
-    if (pfs._match_mask & PFS_MATCH_EXE_EQUALS) {
-        if (pfs._exeMatchValue != process->_exe) {
-            return false;
+    snapshot.exeMatcher.Compile();
+    snapshot.cmdlineMatcher.Compile();
+
+    int max_depth = -1;
+    for (auto& cf : snapshot.compiledFilters) {
+        max_depth = std::max(max_depth, cf.depth);
+    }
+    auto& depthMasks = snapshot.depthMasks;
+    depthMasks.assign(max_depth+2, std::bitset<FILTER_BITSET_SIZE>());
+    for (auto& cf : snapshot.compiledFilters) {
+        if (cf.depth < -1) {
+            continue;
+        }
+        auto limit = cf.depth == -1 ? depthMasks.size()-1 : static_cast<size_t>(cf.depth);
+        for (size_t h = 0; h <= limit; ++h) {
+            depthMasks[h][cf.bit] = 1;
         }
     }
+}
 
-    if (pfs._match_mask & PFS_MATCH_EXE_STARTSWITH) {
-        if (!starts_with(process->_exe, pfs._exeMatchValue)) {
-            return false;
-        }
+std::bitset<FILTER_BITSET_SIZE> FiltersEngine::GetFlags(const std::shared_ptr<ProcessTreeItem>& process, unsigned int height)
+{
+    auto snap = GetSnapshot();
+    return snap->GetMatchFlags(*process, snap->GetDepthMask(height)) & snap->GetDepthMask(height);
+}
+
+std::bitset<FILTER_BITSET_SIZE> FiltersSnapshot::GetMatchFlags(const ProcessTreeItem& process, const std::bitset<FILTER_BITSET_SIZE>& bits) const
+{
+    static thread_local MultiPatternMatcher::State exe_state;
+    static thread_local MultiPatternMatcher::State cmdline_state;
+
+    std::bitset<FILTER_BITSET_SIZE> flags;
+
+    if (bits.none()) {
+        return flags;
     }
 
-    if (pfs._match_mask & PFS_MATCH_EXE_CONTAINS) {
-        if (process->_exe.find(pfs._exeMatchValue) == std::string::npos) {
-            return false;
+    std::string_view exe = process._exe.str();
+    std::string_view cmdline = process._cmdline.str();
+    bool exe_scanned = false;
+    bool cmdline_scanned = false;
+
+    // All the literal patterns are evaluated by the first scan, regexes only when a filter gets that far
+    for (auto& cf : compiledFilters) {
+        if (!bits[cf.bit]) {
+            continue;
         }
-    }
-    if (pfs._match_mask & PFS_MATCH_EXE_REGEX) {
-        if (!std::regex_search(process->_exe, pfs._exeRegex)) {
-            return false;
+        if ((cf.match_mask & PFS_MATCH_UID) && cf.uid != process._uid) {
+            continue;
+        }
+        if ((cf.match_mask & PFS_MATCH_GID) && cf.gid != process._gid) {
+            continue;
         }
-    }
 
-    for (auto cf : pfs._cmdlineFilters) {
-        if (cf._matchType == MatchEquals) {
-            if (cf._matchValue != process->_cmdline) {
-                return false;
-            }
-        } else if (cf._matchType == MatchStartsWith) {
-            if (!starts_with(process->_cmdline, cf._matchValue)) {
-                return false;
-            }
-        } else if (cf._matchType == MatchContains) {
-            if (process->_cmdline.find(cf._matchValue) == std::string::npos) {
-                return false;
+        if (!cf.exe_patterns.empty() && !exe_scanned) {
+            exeMatcher.Scan(exe, exe_state);
+            exe_scanned = true;
+        }
+        bool matched = true;
+        for (auto id : cf.exe_patterns) {
+            if (!exeMatcher.Matches(exe, id, exe_state)) {
+                matched = false;
+                break;
             }
-        } else if (cf._matchType == MatchRegex) {
-            if (!std::regex_search(process->_cmdline, cf._matchRegex)) {
-                return false;
+        }
+        if (!matched) {
+            continue;
+        }
+
+        if (!cf.cmdline_patterns.empty() && !cmdline_scanned) {
+            cmdlineMatcher.Scan(cmdline, cmdline_state);
+            cmdline_scanned = true;
+        }
+        for (auto id : cf.cmdline_patterns) {
+            if (!cmdlineMatcher.Matches(cmdline, id, cmdline_state)) {
+                matched = false;
+                break;
             }
         }
+        if (matched) {
+            flags[cf.bit] = 1;
+        }
     }
 
-    return true;
+    return flags;
 }
 
-std::bitset<FILTER_BITSET_SIZE> FiltersEngine::GetFlags(const std::shared_ptr<ProcessTreeItem>& process, unsigned int height)
+std::bitset<FILTER_BITSET_SIZE> FiltersSnapshot::ChangedSince(uint64_t generation) const
 {
-    std::bitset<FILTER_BITSET_SIZE> flags;
-
-    for (auto element : _filtersBitPosition) {
-        ProcFilterSpec pfs = element.first;
-        if (ProcessMatchFilter(process, pfs, height)) {
-            flags[element.second.bitPosition] = 1;
+    std::bitset<FILTER_BITSET_SIZE> changed;
+    for (unsigned int i = 0; i < numBits && i < FILTER_BITSET_SIZE; ++i) {
+        if (bitGenerations[i] > generation) {
+            changed[i] = 1;
         }
     }
-
-    return flags;
+    return changed;
 }
 
 std::bitset<FILTER_BITSET_SIZE> FiltersEngine::GetCommonFlagsMask()
 {
-    return _globalFlagsMask;
+    return GetSnapshot()->globalFlagsMask;
 }
 
-void FiltersEngine::SetCommonFlagsMask()
+void FiltersEngine::SetCommonFlagsMask(FiltersSnapshot& snapshot)
 {
     std::bitset<FILTER_BITSET_SIZE> flags;
     unsigned int numberOfOutputs = _outputs.size();
@@ -212,46 +298,110 @@ void FiltersEngine::SetCommonFlagsMask()
         }
     }
 
-    _globalFlagsMask = flags;
+    snapshot.globalFlagsMask = flags;
 }
 
-bool FiltersEngine::syscallIsFiltered(const std::string& syscall, const std::unordered_map<std::string, bool>& syscalls)
+// Compile each filter's syscall list into per machine type syscall number tables.
+// For each filter, the first occurrence of a syscall wins. A syscall without a ! is filtered, !syscall is not,
+// and "*" sets the default for syscalls that are not listed.
+void FiltersEngine::CompileSyscalls(FiltersSnapshot& snapshot)
 {
-    auto it = syscalls.find(syscall);
-    if (it != syscalls.end()) {
-        return it->second;
-    } else {
-        if (syscalls.count("*") > 0) {
-            return true;
+    struct Compiled {
+        unsigned int bit;
+        bool wildcard;
+        std::array<std::unordered_map<int, bool>, NUM_MACHINE_TYPES> syscalls;
+    };
+
+    std::vector<Compiled> filters;
+    std::array<size_t, NUM_MACHINE_TYPES> table_sizes;
+    table_sizes.fill(0);
+
+    for (auto& element : _filtersBitPosition) {
+        Compiled c;
+        c.bit = element.second.bitPosition;
+        c.wildcard = false;
+        bool wildcard_seen = false;
+        for (auto& s : element.first._syscalls) {
+            auto name = std::string_view(s);
+            bool filtered = true;
+            if (!name.empty() && name[0] == '!') {
+                filtered = false;
+                name.remove_prefix(1);
+            }
+            if (name == "*") {
+                if (!wildcard_seen) {
+                    wildcard_seen = true;
+                    c.wildcard = filtered;
+                }
+                continue;
+            }
+            for (int m = 0; m < NUM_MACHINE_TYPES; ++m) {
+                auto num = SyscallNameToNumber(static_cast<MachineType>(m), name);
+                if (num >= 0) {
+                    c.syscalls[m].emplace(num, filtered);
+                    table_sizes[m] = std::max(table_sizes[m], static_cast<size_t>(num)+1);
+                }
+            }
+        }
+        if (c.wildcard) {
+            snapshot.wildcardSyscallBits[c.bit] = 1;
+        }
+        filters.emplace_back(std::move(c));
+    }
+
+    for (int m = 0; m < NUM_MACHINE_TYPES; ++m) {
+        auto& table = snapshot.syscallBits[m];
+        table.assign(table_sizes[m], snapshot.wildcardSyscallBits);
+        for (auto& c : filters) {
+            for (auto& e : c.syscalls[m]) {
+                table[e.first][c.bit] = e.second;
+            }
         }
     }
-    return false;
 }
 
-bool FiltersEngine::IsEventFiltered(const std::string& syscall, const std::shared_ptr<ProcessTreeItem>& p, const std::bitset<FILTER_BITSET_SIZE>& filterFlagsMask)
+std::bitset<FILTER_BITSET_SIZE> FiltersEngine::GetSyscallFlags(MachineType mtype, int syscall, const std::shared_ptr<ProcessTreeItem>& p)
 {
-    // Get event syscall
-    bool filtered = false;
-
-    if (syscall.empty() || !p) {
-        return false;
+    if (syscall < 0 || !p) {
+        return std::bitset<FILTER_BITSET_SIZE>();
     }
 
-    // Check if this process is filtered
-    std::bitset<FILTER_BITSET_SIZE> matched_flags = p->_flags & filterFlagsMask;
+    auto snap = GetSnapshot();
 
-    // Find syscalls filtered for process
-    for (unsigned int i=0; i<_nextBitPosition; i++) {
-        if (matched_flags[i]) {
-            std::unordered_map<std::string, bool>& syscalls = _bitPositionSyscalls[i];
-            if (syscallIsFiltered(syscall, syscalls)) {
-                filtered = true;
-                break;
-            }
-        }
+    // Syscalls of an unknown machine type can only match "*"
+    auto idx = static_cast<int>(mtype);
+    if (idx < 0 || idx >= NUM_MACHINE_TYPES) {
+        return p->_flags & snap->wildcardSyscallBits;
     }
 
-    return filtered;
+    auto& table = snap->syscallBits[idx];
+    auto& syscall_bits = static_cast<size_t>(syscall) < table.size() ? table[syscall] : snap->wildcardSyscallBits;
+
+    return p->_flags & syscall_bits;
 }
 
+bool FiltersEngine::IsEventFiltered(MachineType mtype, int syscall, const std::shared_ptr<ProcessTreeItem>& p, const std::bitset<FILTER_BITSET_SIZE>& filterFlagsMask)
+{
+    return (GetSyscallFlags(mtype, syscall, p) & filterFlagsMask).any();
+}
 
+void FiltersEngine::SetEventFilterFlags(const EventId& id, const std::bitset<FILTER_BITSET_SIZE>& flags)
+{
+    auto idx = id.Serial() & (EVENT_FLAGS_TABLE_SIZE-1);
+    std::lock_guard<std::mutex> lock(_eventFlagsLocks[idx % EVENT_FLAGS_LOCKS]);
+    auto& slot = _eventFlags[idx];
+    slot.id = id;
+    slot.flags = flags;
+}
+
+bool FiltersEngine::GetEventFilterFlags(const EventId& id, std::bitset<FILTER_BITSET_SIZE>& flags)
+{
+    auto idx = id.Serial() & (EVENT_FLAGS_TABLE_SIZE-1);
+    std::lock_guard<std::mutex> lock(_eventFlagsLocks[idx % EVENT_FLAGS_LOCKS]);
+    auto& slot = _eventFlags[idx];
+    if (slot.id != id) {
+        return false;
+    }
+    flags = slot.flags;
+    return true;
+}
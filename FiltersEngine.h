@@ -24,12 +24,18 @@
 #include <unordered_map>
 #include <queue>
 #include <regex>
+#include <array>
+#include <bitset>
+#include <mutex>
 #include "Config.h"
 #include "UserDB.h"
 #include "ProcessInfo.h"
 #include "ProcFilter.h"
 #include "ProcessTree.h"
 #include "ProcessDefines.h"
+#include "MachineType.h"
+#include "EventId.h"
+#include "PatternMatcher.h"
 
 
 struct FiltersInfo {
@@ -39,27 +45,106 @@ struct FiltersInfo {
 
 class ProcessTreeItem;
 
+// The compiled form of the filters that the event processing threads read. A new one is built every time a
+// filter list is added or removed, and swapped in atomically, so readers never see a partially rebuilt table
+// and a generation always comes with the filters it was computed for.
+class FiltersSnapshot {
+public:
+    struct CompiledFilter {
+        unsigned int bit;
+        uint32_t match_mask;
+        int depth;
+        uint32_t uid;
+        uint32_t gid;
+        std::vector<size_t> exe_patterns;
+        std::vector<size_t> cmdline_patterns;
+    };
+
+    // The subset of bits whose filters' uid, gid, exe and cmdline conditions match the process. Depth is not considered.
+    std::bitset<FILTER_BITSET_SIZE> GetMatchFlags(const ProcessTreeItem& process, const std::bitset<FILTER_BITSET_SIZE>& bits) const;
+    // The bits of the filters that apply to a match at height generations above the process.
+    inline const std::bitset<FILTER_BITSET_SIZE>& GetDepthMask(unsigned int height) const {
+        return depthMasks[std::min<size_t>(height, depthMasks.size()-1)];
+    }
+    // Incremented every time a filter is added or removed. Starts at 1.
+    inline uint64_t Generation() const { return generation; }
+    // The bits of the filters that were added or removed after generation.
+    std::bitset<FILTER_BITSET_SIZE> ChangedSince(uint64_t generation) const;
+
+    uint64_t generation = 1;
+    unsigned int numBits = 0;
+    std::array<uint64_t, FILTER_BITSET_SIZE> bitGenerations{};
+    // Indexed by height, the last entry only has the filters with no depth limit
+    std::vector<std::bitset<FILTER_BITSET_SIZE>> depthMasks = std::vector<std::bitset<FILTER_BITSET_SIZE>>(1);
+    std::bitset<FILTER_BITSET_SIZE> globalFlagsMask;
+    // Per machine type, indexed by syscall number, the bits of the filters that filter that syscall.
+    // Syscalls beyond the end of a table are only filtered by the filters in wildcardSyscallBits.
+    std::array<std::vector<std::bitset<FILTER_BITSET_SIZE>>, NUM_MACHINE_TYPES> syscallBits;
+    std::bitset<FILTER_BITSET_SIZE> wildcardSyscallBits;
+    // The exe and cmdline patterns of all filters, so that GetMatchFlags() only has to scan each string once.
+    std::vector<CompiledFilter> compiledFilters;
+    MultiPatternMatcher exeMatcher;
+    MultiPatternMatcher cmdlineMatcher;
+};
+
 class FiltersEngine {
 public:
-    FiltersEngine(): _nextBitPosition(0) {}
+    FiltersEngine(): _nextBitPosition(0), _generation(1), _bitGenerations(), _snapshot(std::make_shared<const FiltersSnapshot>()), _eventFlags(new EventFlagsSlot[EVENT_FLAGS_TABLE_SIZE]) {}
     std::bitset<FILTER_BITSET_SIZE> AddFilterList(const std::vector<ProcFilterSpec>& pfsVec, const std::string& outputName);
     void RemoveFilterList(const std::vector<ProcFilterSpec>& pfsVec, const std::string& outputName);
+    // The current filters. Callers that need several of the values below to agree should hold on to one snapshot.
+    inline std::shared_ptr<const FiltersSnapshot> GetSnapshot() const { return std::atomic_load(&_snapshot); }
     std::bitset<FILTER_BITSET_SIZE> GetFlags(const std::shared_ptr<ProcessTreeItem>& process, unsigned int height);
+    inline std::bitset<FILTER_BITSET_SIZE> GetMatchFlags(const ProcessTreeItem& process, const std::bitset<FILTER_BITSET_SIZE>& bits) {
+        return GetSnapshot()->GetMatchFlags(process, bits);
+    }
+    inline std::bitset<FILTER_BITSET_SIZE> GetDepthMask(unsigned int height) {
+        return GetSnapshot()->GetDepthMask(height);
+    }
+    inline uint64_t Generation() { return GetSnapshot()->Generation(); }
+    inline std::bitset<FILTER_BITSET_SIZE> ChangedSince(uint64_t generation) {
+        return GetSnapshot()->ChangedSince(generation);
+    }
     std::bitset<FILTER_BITSET_SIZE> GetCommonFlagsMask();
-    bool IsEventFiltered(const std::string& syscall, const std::shared_ptr<ProcessTreeItem>& p, const std::bitset<FILTER_BITSET_SIZE>& filterFlagsMask);
+    bool IsEventFiltered(MachineType mtype, int syscall, const std::shared_ptr<ProcessTreeItem>& p, const std::bitset<FILTER_BITSET_SIZE>& filterFlagsMask);
+    // The bits of all the filters that would filter the syscall for the process. An event is filtered for an output if this intersects the output's mask.
+    std::bitset<FILTER_BITSET_SIZE> GetSyscallFlags(MachineType mtype, int syscall, const std::shared_ptr<ProcessTreeItem>& p);
+
+    // Filter flags computed once per event by the event processor, so that each output doesn't have to repeat the
+    // syscall and process lookup. The table is fixed size and indexed by serial, so lookups for events that were
+    // overwritten (or queued before a restart) miss and the caller has to evaluate the event itself.
+    void SetEventFilterFlags(const EventId& id, const std::bitset<FILTER_BITSET_SIZE>& flags);
+    bool GetEventFilterFlags(const EventId& id, std::bitset<FILTER_BITSET_SIZE>& flags);
 
 private:
+    static constexpr size_t EVENT_FLAGS_TABLE_SIZE = 8192;
+    static constexpr size_t EVENT_FLAGS_LOCKS = 64;
+
+    struct EventFlagsSlot {
+        EventId id;
+        std::bitset<FILTER_BITSET_SIZE> flags;
+    };
+
     std::bitset<FILTER_BITSET_SIZE> AddFilter(const ProcFilterSpec& pfs, const std::string& outputName);
     void RemoveFilter(const ProcFilterSpec& pfs, const std::string& outputName);
-    void SetCommonFlagsMask();
-    bool ProcessMatchFilter(const std::shared_ptr<ProcessTreeItem>& process, const ProcFilterSpec& pfs, unsigned int height);
-    bool syscallIsFiltered(const std::string& syscall, const std::unordered_map<std::string, bool>& syscalls);
+    void SetCommonFlagsMask(FiltersSnapshot& snapshot);
+    void CompileSyscalls(FiltersSnapshot& snapshot);
+    void CompileMatchers(FiltersSnapshot& snapshot);
+    void Publish();
+
+    // Serializes AddFilterList() and RemoveFilterList(), and guards the fields below up to _snapshot
+    std::mutex _mutex;
 
     unsigned int _nextBitPosition;
-    std::bitset<FILTER_BITSET_SIZE> _globalFlagsMask;
+    uint64_t _generation;
+    std::array<uint64_t, FILTER_BITSET_SIZE> _bitGenerations;
     std::unordered_set<std::string> _outputs;
     std::unordered_map<ProcFilterSpec, FiltersInfo, ProcFilterSpecHash, ProcFilterSpecCompare> _filtersBitPosition;
-    std::unordered_map<unsigned int, std::unordered_map<std::string, bool>> _bitPositionSyscalls;
+
+    std::shared_ptr<const FiltersSnapshot> _snapshot;
+
+    std::unique_ptr<EventFlagsSlot[]> _eventFlags;
+    std::array<std::mutex, EVENT_FLAGS_LOCKS> _eventFlagsLocks;
 };
 
 #endif //AUOMS_FILTERS_ENGINE_H
@@ -13,49 +13,135 @@
 
     THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
+
 #include "FluentEventWriter.h"
 
-void FluentEventWriter::write_int32_field(const std::string& name, int32_t value)
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+bool FluentEventWriter::ParseMode(const std::string& str, FluentMode& mode)
+{
+    if (str == "forward") {
+        mode = FluentMode::FORWARD;
+    } else if (str == "packed_forward") {
+        mode = FluentMode::PACKED_FORWARD;
+    } else if (str == "compressed_packed_forward") {
+        mode = FluentMode::COMPRESSED_PACKED_FORWARD;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+FluentEventWriter::FluentEventWriter(TextEventWriterConfig config, const std::string &tag, FluentMode mode, bool chunk_ack, size_t pack_max_bytes)
+    : TextEventWriterBase(config), _tag(tag), _mode(mode), _chunk_ack(chunk_ack), _pack_max_bytes(pack_max_bytes), _time(0),
+      _common_packer(&_common), _record_packer(&_record), _num_replaced(0), _field_index(64), _record_gen(0),
+      _event(64*1024), _event_packer(&_event), _num_event_entries(0), _entries(pack_max_bytes), _num_entries(0),
+      _message_packer(&_message), _zstream_init(false)
+{}
+
+FluentEventWriter::~FluentEventWriter()
+{
+    if (_zstream_init) {
+        deflateEnd(&_zstream);
+    }
+}
+
+void FluentEventWriter::pack_str(msgpack::packer<msgpack::sbuffer>& packer, std::string_view str)
 {
-    _recordFields[name] = std::to_string(value);
+    packer.pack_str(static_cast<uint32_t>(str.size()));
+    packer.pack_str_body(str.data(), static_cast<uint32_t>(str.size()));
 }
 
-void FluentEventWriter::write_int64_field(const std::string& name, int64_t value)
+void FluentEventWriter::pack_common_field(std::string_view name, std::string_view value)
 {
-    _recordFields[name] = std::to_string(value);
+    auto begin = _common.size();
+    pack_str(_common_packer, name);
+    pack_str(_common_packer, value);
+    _common_fields.push_back(PackedField{name, begin, _common.size(), false});
 }
 
-void FluentEventWriter::write_raw_field(const std::string& name, const char* value_data, size_t value_size)
+void FluentEventWriter::write_raw_field(std::string_view name, const char* value_data, size_t value_size)
 {
-    _recordFields[name] = std::string(value_data, value_size);
+    auto begin = _record.size();
+    pack_str(_record_packer, name);
+    pack_str(_record_packer, std::string_view(value_data, value_size));
+    add_record_field(name, begin, _record.size());
 }
 
+void FluentEventWriter::add_record_field(std::string_view name, size_t begin, size_t end)
+{
+    _record_fields.push_back(PackedField{name, begin, end, false});
+
+    // Keep the index at most half full
+    if (_record_fields.size()*2 > _field_index.size()) {
+        _field_index.assign(_field_index.size()*2, std::make_pair(0u, 0u));
+        _record_gen = 1;
+        for (uint32_t i = 0; i < _record_fields.size(); ++i) {
+            if (!_record_fields[i].replaced) {
+                index_record_field(i);
+            }
+        }
+    } else {
+        index_record_field(static_cast<uint32_t>(_record_fields.size()-1));
+    }
+}
+
+void FluentEventWriter::index_record_field(uint32_t idx)
+{
+    auto mask = _field_index.size()-1;
+    auto name = _record_fields[idx].name;
+    for (auto i = std::hash<std::string_view>()(name) & mask; ; i = (i+1) & mask) {
+        auto& slot = _field_index[i];
+        if (slot.first != _record_gen) {
+            slot = std::make_pair(_record_gen, idx);
+            return;
+        }
+        if (_record_fields[slot.second].name == name) {
+            // Same as when the record was built as a map, the last value written wins
+            _record_fields[slot.second].replaced = true;
+            _num_replaced++;
+            slot.second = idx;
+            return;
+        }
+    }
+}
 
 bool FluentEventWriter::begin_event(const Event& event)
 {
-    _fluentEvent = new FluentEvent(_tag);
-    _eventCommonFields.clear();
+    _time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    _common.clear();
+    _common_fields.clear();
+    _event.clear();
+    _num_event_entries = 0;
 
     std::stringstream str;
     time_t seconds = event.Seconds();
     time_t milliseconds = event.Milliseconds();
     str << std::put_time(gmtime(&seconds), "%FT%T") << "." << std::setw(3) << std::setfill('0') << milliseconds << "Z";
-    _eventCommonFields[_config.TimestampFieldName] = str.str();
+    pack_common_field(_config.TimestampFieldName, str.str());
 
     std::ostringstream timestamp_str;
     timestamp_str << event.Seconds() << "."
                 << std::setw(3) << std::setfill('0')
                 << event.Milliseconds();
 
-    _eventCommonFields[_config.AuditIDFieldName] = timestamp_str.str() + ":" + std::to_string(event.Serial());
-    _eventCommonFields[_config.ComputerFieldName] = _config.HostnameValue;
-    _eventCommonFields[_config.SerialFieldName] = std::to_string(event.Serial());
-    _eventCommonFields[_config.ProcessFlagsFieldName] = event.Flags()>>16;
+    pack_common_field(_config.AuditIDFieldName, timestamp_str.str() + ":" + std::to_string(event.Serial()));
+    pack_common_field(_config.ComputerFieldName, _config.HostnameValue);
+    pack_common_field(_config.SerialFieldName, std::to_string(event.Serial()));
+    // The value has always been a single char holding the (truncated) process flags
+    pack_common_field(_config.ProcessFlagsFieldName, std::string(1, static_cast<char>(event.Flags()>>16)));
 
     if ((event.Flags() & EVENT_FLAG_IS_AUOMS_EVENT) != 0) {
-        _eventCommonFields[_config.MsgTypeFieldName] = "AUOMS_EVENT";
+        pack_common_field(_config.MsgTypeFieldName, "AUOMS_EVENT");
     } else {
-        _eventCommonFields[_config.MsgTypeFieldName] = "AUDIT_EVENT";
+        pack_common_field(_config.MsgTypeFieldName, "AUDIT_EVENT");
     }
 
     return true;
@@ -64,14 +150,28 @@ bool FluentEventWriter::begin_event(const Event& event)
 ssize_t FluentEventWriter::WriteEvent(const Event& event, IWriter* writer)
 {
     try {
-        if (write_event(event)) {
-            msgpack::sbuffer sbuf;
-            msgpack::pack(sbuf, *_fluentEvent);
-
-            return writer->WriteAll(sbuf.data(), sbuf.size());
-        } else {
+        if (!write_event(event)) {
             return IEventWriter::NOOP;
         }
+
+        if (_mode == FluentMode::FORWARD) {
+            _message.clear();
+            _message_packer.pack_array(2);
+            pack_str(_message_packer, _tag);
+            _message_packer.pack_array(_num_event_entries);
+            _message.write(_event.data(), _event.size());
+
+            return writer->WriteAll(_message.data(), _message.size());
+        }
+
+        _entries.write(_event.data(), _event.size());
+        _num_entries += _num_event_entries;
+        _last_event_id = EventId(event.Seconds(), event.Milliseconds(), event.Serial());
+
+        if (_entries.size() >= _pack_max_bytes) {
+            return Flush(writer);
+        }
+        return IWriter::OK;
     }
     catch (const std::exception& ex) {
         Logger::Warn("Unexpected exception while processing event: %s", ex.what());
@@ -79,15 +179,101 @@ ssize_t FluentEventWriter::WriteEvent(const Event& event, IWriter* writer)
     }
 }
 
-bool FluentEventWriter::begin_record(const EventRecord& record, const std::string& record_type_name)
+ssize_t FluentEventWriter::Flush(IWriter* writer)
+{
+    if (_num_entries == 0) {
+        return IWriter::OK;
+    }
+
+    bool compressed = _mode == FluentMode::COMPRESSED_PACKED_FORWARD;
+    const char* entries = _entries.data();
+    size_t entries_size = _entries.size();
+    if (compressed) {
+        if (!compress_entries()) {
+            Logger::Warn("FluentEventWriter: Failed to compress entries");
+            Discard();
+            return IWriter::FAILED;
+        }
+        entries = _compressed.data();
+        entries_size = _compressed.size();
+    }
+
+    _message.clear();
+    _message_packer.pack_array(3);
+    pack_str(_message_packer, _tag);
+    _message_packer.pack_bin(static_cast<uint32_t>(entries_size));
+    _message_packer.pack_bin_body(entries, static_cast<uint32_t>(entries_size));
+
+    _message_packer.pack_map(1 + (_chunk_ack ? 1 : 0) + (compressed ? 1 : 0));
+    pack_str(_message_packer, "size");
+    _message_packer.pack_uint32(_num_entries);
+    if (_chunk_ack) {
+        // Same format as the TextEventWriter acks, Sec:Msec:Serial in fixed size HEX
+        std::array<char, ((8+8+4)*2)+3> chunk;
+        auto len = snprintf(chunk.data(), chunk.size(), "%016lX:%08X:%016lX", _last_event_id.Seconds(), _last_event_id.Milliseconds(), _last_event_id.Serial());
+        pack_str(_message_packer, "chunk");
+        pack_str(_message_packer, std::string_view(chunk.data(), len));
+    }
+    if (compressed) {
+        pack_str(_message_packer, "compressed");
+        pack_str(_message_packer, "gzip");
+    }
+
+    Discard();
+
+    return writer->WriteAll(_message.data(), _message.size());
+}
+
+void FluentEventWriter::Discard()
+{
+    _entries.clear();
+    _num_entries = 0;
+}
+
+bool FluentEventWriter::compress_entries()
+{
+    if (!_zstream_init) {
+        memset(&_zstream, 0, sizeof(_zstream));
+        // 16+MAX_WBITS selects the gzip format
+        if (deflateInit2(&_zstream, Z_BEST_SPEED, Z_DEFLATED, 16+MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        _zstream_init = true;
+    } else if (deflateReset(&_zstream) != Z_OK) {
+        return false;
+    }
+
+    _compressed.resize(deflateBound(&_zstream, _entries.size()));
+    _zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_entries.data()));
+    _zstream.avail_in = static_cast<uInt>(_entries.size());
+    _zstream.next_out = reinterpret_cast<Bytef*>(&_compressed[0]);
+    _zstream.avail_out = static_cast<uInt>(_compressed.size());
+    if (deflate(&_zstream, Z_FINISH) != Z_STREAM_END) {
+        return false;
+    }
+    _compressed.resize(_zstream.total_out);
+    return true;
+}
+
+bool FluentEventWriter::begin_record(const EventRecord& record, std::string_view record_type_name)
 {
-    _recordFields.clear();
+    _record.clear();
+    _record_fields.clear();
+    _num_replaced = 0;
+    if (++_record_gen == 0) {
+        _field_index.assign(_field_index.size(), std::make_pair(0u, 0u));
+        _record_gen = 1;
+    }
+
     write_int32_field(_config.RecordTypeFieldName, static_cast<int32_t>(record.RecordType()));
     write_string_field(_config.RecordTypeNameFieldName, record_type_name);
+    write_raw_field(_config.RecordTextFieldName, record.RecordTextPtr(), record.RecordTextSize());
 
-    _recordFields[_config.RecordTextFieldName] = std::string(record.RecordTextPtr(), record.RecordTextSize());
-    for (auto itr = _eventCommonFields.begin(); itr != _eventCommonFields.end(); ++itr) {
-        _recordFields[itr->first] = itr->second;
+    // The common fields replace any of the above with the same name, and are replaced by the record's own fields
+    auto base = _record.size();
+    _record.write(_common.data(), _common.size());
+    for (auto& f : _common_fields) {
+        add_record_field(f.name, base + f.begin, base + f.end);
     }
 
     return true;
@@ -95,12 +281,114 @@ bool FluentEventWriter::begin_record(const EventRecord& record, const std::strin
 
 void FluentEventWriter::end_record(const EventRecord& record)
 {
-    FluentMessage fluentMsg(_recordFields);
-    _fluentEvent->Add(fluentMsg);
+    _event_packer.pack_array(2);
+    _event_packer.pack(_time);
+    _event_packer.pack_map(static_cast<uint32_t>(_record_fields.size() - _num_replaced));
+    if (_num_replaced == 0) {
+        _event.write(_record.data(), _record.size());
+    } else {
+        for (auto& f : _record_fields) {
+            if (!f.replaced) {
+                _event.write(_record.data() + f.begin, f.end - f.begin);
+            }
+        }
+    }
+    _num_event_entries++;
+}
+
+namespace {
+
+// Read a msgpack str (or bin)
+ssize_t read_msgpack_str(IReader* reader, std::string& str)
+{
+    uint8_t hdr[3];
+    auto ret = reader->ReadAll(hdr, 1);
+    if (ret != IO::OK) {
+        return ret;
+    }
+
+    size_t len;
+    if ((hdr[0] & 0xE0) == 0xA0) {
+        len = hdr[0] & 0x1F;
+    } else if (hdr[0] == 0xD9 || hdr[0] == 0xC4) {
+        ret = reader->ReadAll(&hdr[1], 1);
+        if (ret != IO::OK) {
+            return ret;
+        }
+        len = hdr[1];
+    } else if (hdr[0] == 0xDA || hdr[0] == 0xC5) {
+        ret = reader->ReadAll(&hdr[1], 2);
+        if (ret != IO::OK) {
+            return ret;
+        }
+        len = (static_cast<size_t>(hdr[1]) << 8) | hdr[2];
+    } else {
+        return IO::FAILED;
+    }
+
+    str.resize(len);
+    if (len == 0) {
+        return IO::OK;
+    }
+    return reader->ReadAll(&str[0], len);
+}
+
+}
+
+// The response to a message with a chunk option is {"ack": chunk}
+ssize_t FluentEventWriter::read_ack_chunk(EventId &event_id, IReader *reader)
+{
+    uint8_t map_hdr;
+    auto ret = reader->ReadAll(&map_hdr, 1);
+    if (ret != IO::OK) {
+        return ret;
+    }
+    if ((map_hdr & 0xF0) != 0x80) {
+        return IO::FAILED;
+    }
+
+    std::string key;
+    std::string value;
+    std::string chunk;
+    for (int i = 0; i < (map_hdr & 0x0F); ++i) {
+        ret = read_msgpack_str(reader, key);
+        if (ret != IO::OK) {
+            return ret;
+        }
+        ret = read_msgpack_str(reader, value);
+        if (ret != IO::OK) {
+            return ret;
+        }
+        if (key == "ack") {
+            chunk = value;
+        }
+    }
+
+    if (chunk.size() != ((8+8+4)*2)+2 || chunk[8*2] != ':' || chunk[(12*2)+1] != ':') {
+        return IO::FAILED;
+    }
+
+    chunk[8*2] = 0;
+    chunk[(12*2)+1] = 0;
+
+    uint64_t sec = strtoull(chunk.data(), nullptr, 16);
+    uint32_t msec = static_cast<uint32_t>(strtoul(&chunk[(8*2)+1], nullptr, 16));
+    uint64_t serial = strtoull(&chunk[(12*2)+2], nullptr, 16);
+
+    if (sec == 0 || sec == ULLONG_MAX || msec == ULONG_MAX || serial == ULLONG_MAX) {
+        return IO::FAILED;
+    }
+
+    event_id = EventId(sec, msec, serial);
+    return IO::OK;
 }
 
 ssize_t FluentEventWriter::ReadAck(EventId &event_id, IReader *reader)
 {
+    if (_mode != FluentMode::FORWARD && _chunk_ack) {
+        return read_ack_chunk(event_id, reader);
+    }
+
     std::array<uint8_t, 8 + 4 + 8> data;
     auto ret = reader->ReadAll(data.data(), data.size());
     if (ret != IO::OK)
@@ -112,3 +400,5 @@ ssize_t FluentEventWriter::ReadAck(EventId &event_id, IReader *reader)
                        *reinterpret_cast<uint64_t *>(data.data() + 12));
     return IO::OK;
 }
+
+template class TextEventWriterBase<FluentEventWriter>;
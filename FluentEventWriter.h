@@ -19,74 +19,119 @@
 
 #include "TextEventWriter.h"
 #include "Logger.h"
-#include <chrono>
 #include <msgpack.hpp>
 
-// represent one message. [[TS], {field1:"value", ...}]
-class FluentMessage
-{
-private:
-    int64_t timestamp;
-    std::unordered_map<std::string, std::string> message_dict;
-
-public:
-    explicit FluentMessage()
-    {
-        timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    }
+#include <string>
+#include <string_view>
+#include <vector>
 
-    explicit FluentMessage(std::unordered_map<std::string, std::string> &_msg_dict) : message_dict(_msg_dict)
-    {
-        timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    }
+extern "C" {
+#include <zlib.h>
+}
 
-    MSGPACK_DEFINE(timestamp, message_dict)
+/*
+ * Fluent forward protocol modes (https://github.com/fluent/fluentd/wiki/Forward-Protocol-Specification-v1)
+ *
+ * FORWARD:                     One [tag, [[time, record], ...]] message per event
+ * PACKED_FORWARD:              [tag, entries, option] with the records of many events packed into entries
+ * COMPRESSED_PACKED_FORWARD:   Same as PACKED_FORWARD, but with the entries gzip compressed
+ */
+enum class FluentMode {
+    FORWARD,
+    PACKED_FORWARD,
+    COMPRESSED_PACKED_FORWARD,
 };
 
-// represents a pack of messages
-class FluentEvent
+class FluentEventWriter : public TextEventWriterBase<FluentEventWriter>
 {
-private:
-    std::string tag;
-    std::unique_ptr<std::vector<FluentMessage>> messages;
-
 public:
-    explicit FluentEvent(const std::string &_tag) : tag(_tag)
-    {
-        messages = std::make_unique<std::vector<FluentMessage>>();
-    }
+    static constexpr size_t DEFAULT_PACK_MAX_BYTES = 256*1024;
 
-    void Add(FluentMessage m)
-    {
-        messages->push_back(m);
-    }
+    // Return false if str is not a valid mode name (forward, packed_forward, compressed_packed_forward)
+    static bool ParseMode(const std::string& str, FluentMode& mode);
 
-    MSGPACK_DEFINE(tag, messages)
-};
+    /*
+     * In the packed modes, events are accumulated until Flush() is called, or the packed entries reach pack_max_bytes.
+     * If chunk_ack is true, each packed message carries a chunk option and ReadAck expects the {"ack": chunk}
+     * responses. The chunk identifies the last event in the message.
+     */
+    FluentEventWriter(TextEventWriterConfig config, const std::string &tag, FluentMode mode = FluentMode::FORWARD,
+                      bool chunk_ack = false, size_t pack_max_bytes = DEFAULT_PACK_MAX_BYTES);
+    ~FluentEventWriter();
 
-class FluentEventWriter : public TextEventWriter
-{
-public:
-    FluentEventWriter(TextEventWriterConfig config, const std::string &tag) : TextEventWriter(config), _tag(tag) {}
     virtual ssize_t WriteEvent(const Event &event, IWriter *writer);
     virtual ssize_t ReadAck(EventId &event_id, IReader *reader);
 
+    virtual bool HasPending() { return _num_entries > 0; }
+    virtual ssize_t Flush(IWriter* writer);
+    virtual void Discard();
+
 protected:
-    void write_int32_field(const std::string &name, int32_t value);
-    void write_int64_field(const std::string &name, int64_t value);
-    void write_raw_field(const std::string &name, const char *value_data, size_t value_size);
+    friend class TextEventWriterBase<FluentEventWriter>;
+
+    void write_raw_field(std::string_view name, const char *value_data, size_t value_size);
 
     bool begin_event(const Event &event);
-    void end_event(const Event &event) {}
 
-    bool begin_record(const EventRecord &record, const std::string &record_type_name);
+    bool begin_record(const EventRecord &record, std::string_view record_type_name);
     void end_record(const EventRecord &record);
 
 private:
+    // A packed name/value pair of the current record, as the [begin, end) range of its bytes in _record (or _common)
+    struct PackedField {
+        std::string_view name;
+        size_t begin;
+        size_t end;
+        bool replaced;
+    };
+
+    void pack_str(msgpack::packer<msgpack::sbuffer>& packer, std::string_view str);
+    void pack_common_field(std::string_view name, std::string_view value);
+    void add_record_field(std::string_view name, size_t begin, size_t end);
+    void index_record_field(uint32_t idx);
+    ssize_t read_ack_chunk(EventId &event_id, IReader *reader);
+    bool compress_entries();
+
     std::string _tag;
-    FluentEvent* _fluentEvent;
-    std::unordered_map<std::string, std::string> _eventCommonFields;
-    std::unordered_map<std::string, std::string> _recordFields;
+    FluentMode _mode;
+    bool _chunk_ack;
+    size_t _pack_max_bytes;
+    int64_t _time;
+
+    // The fields common to all the records of an event
+    msgpack::sbuffer _common;
+    msgpack::packer<msgpack::sbuffer> _common_packer;
+    std::vector<PackedField> _common_fields;
+
+    // The fields of the current record, the map size is only known once all have been written.
+    // A field written again under the same name replaces the earlier one, the replaced pairs are skipped in end_record().
+    msgpack::sbuffer _record;
+    msgpack::packer<msgpack::sbuffer> _record_packer;
+    std::vector<PackedField> _record_fields;
+    uint32_t _num_replaced;
+
+    // Open addressing index of the _record_fields names, a slot is only in use if its generation is _record_gen
+    std::vector<std::pair<uint32_t, uint32_t>> _field_index;
+    uint32_t _record_gen;
+
+    // The [time, record] entries of the current event
+    msgpack::sbuffer _event;
+    msgpack::packer<msgpack::sbuffer> _event_packer;
+    uint32_t _num_event_entries;
+
+    // The entries of the events not yet written
+    msgpack::sbuffer _entries;
+    uint32_t _num_entries;
+    EventId _last_event_id;
+
+    msgpack::sbuffer _message;
+    msgpack::packer<msgpack::sbuffer> _message_packer;
+
+    z_stream _zstream;
+    bool _zstream_init;
+    std::string _compressed;
 };
 
+extern template class TextEventWriterBase<FluentEventWriter>;
+
 #endif //AUOMS_FLUENTEVENTWRITER_H
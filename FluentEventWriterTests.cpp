@@ -157,3 +157,79 @@ BOOST_AUTO_TEST_CASE( basic_test ) {
     }
     
 }
+
+BOOST_AUTO_TEST_CASE( unique_keys_test ) {
+    TestEventWriter writer;
+    auto queue = new TestEventQueue();
+    auto allocator = std::shared_ptr<IEventBuilderAllocator>(queue);
+    auto builder = std::make_shared<EventBuilder>(allocator);
+
+    for (auto e : test_events) {
+        e.Write(builder);
+    }
+
+    TextEventWriterConfig config;
+    config.FieldNameOverrideMap = TestConfigFieldNameOverrideMap;
+    config.InterpFieldNameMap = TestConfigInterpFieldNameMap;
+    config.FilterRecordTypeSet = TestConfigFilterRecordTypeSet;
+    config.FilterFieldNameSet = TestConfigFilterFieldNameSet;
+    config.HostnameValue = TestConfigHostnameValue;
+
+    // Field names that collide with a common field, and with another field of the same record
+    config.FieldNameOverrideMap["pid"] = "Computer";
+    config.InterpFieldNameMap["pid"] = "Computer";
+    config.InterpFieldNameMap["euid"] = "user";
+
+    FluentEventWriter fluent_writer(config, "LINUX_AUDITD_BLOB");
+
+    for (size_t i = 0; i < queue->GetEventCount(); ++i) {
+        fluent_writer.WriteEvent(queue->GetEvent(i), &writer);
+    }
+
+    BOOST_REQUIRE(writer.GetEventCount() > 0);
+
+    int num_overridden = 0;
+    for (int i = 0; i < writer.GetEventCount(); ++i) {
+        msgpack::unpacker unp;
+        msgpack::object_handle result;
+        unp.reserve_buffer(INITIAL_BUFFER_CAPACITY);
+        std::string event = writer.GetEvent(i);
+        size_t size = event.copy(unp.buffer(), event.length());
+        unp.buffer_consumed(size);
+
+        BOOST_REQUIRE(unp.next(result));
+        msgpack::object message(result.get());
+        BOOST_REQUIRE(message.type == msgpack::type::object_type::ARRAY);
+        BOOST_REQUIRE_EQUAL(message.via.array.size, 2);
+
+        msgpack::object entries = message.via.array.ptr[1];
+        BOOST_REQUIRE(entries.type == msgpack::type::object_type::ARRAY);
+        for (uint32_t e = 0; e < entries.via.array.size; ++e) {
+            msgpack::object entry = entries.via.array.ptr[e];
+            BOOST_REQUIRE(entry.type == msgpack::type::object_type::ARRAY);
+            BOOST_REQUIRE_EQUAL(entry.via.array.size, 2);
+            BOOST_REQUIRE(entry.via.array.ptr[1].type == msgpack::type::object_type::MAP);
+
+            msgpack::object_map& map = entry.via.array.ptr[1].via.map;
+            std::unordered_map<std::string, std::string> keys;
+            for (uint32_t k = 0; k < map.size; ++k) {
+                msgpack::object_kv& kv = map.ptr[k];
+                BOOST_REQUIRE(kv.key.type == msgpack::type::object_type::STR);
+                BOOST_REQUIRE(kv.val.type == msgpack::type::object_type::STR);
+                std::string key(kv.key.via.str.ptr, kv.key.via.str.size);
+                if (!keys.emplace(key, std::string(kv.val.via.str.ptr, kv.val.via.str.size)).second) {
+                    BOOST_FAIL("Duplicate key in record: " + key);
+                }
+            }
+
+            // The record's own field replaces the common field
+            auto itr = keys.find("Computer");
+            BOOST_REQUIRE(itr != keys.end());
+            if (itr->second != TestConfigHostnameValue) {
+                num_overridden++;
+            }
+        }
+    }
+
+    BOOST_REQUIRE(num_overridden > 0);
+}
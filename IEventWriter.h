@@ -27,6 +27,12 @@ public:
 
     virtual ssize_t WriteEvent(const Event& event, IWriter* writer) = 0;
     virtual ssize_t ReadAck(EventId& event_id, IReader* reader) = 0;
+
+    // Writers that pack several events into one message keep the events passed to WriteEvent until Flush is called.
+    virtual bool HasPending() { return false; }
+    virtual ssize_t Flush(IWriter* writer) { return IWriter::OK; }
+    // Drop any pending events (e.g. on connection loss, they will be re-sent)
+    virtual void Discard() {}
 };
 
 #endif //AUOMS_IEVENTWRITER_H
@@ -17,13 +17,17 @@
 #include "IO.h"
 #include "Signals.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <system_error>
 
 extern "C" {
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 }
 
 bool IOBase::IsOpen()
@@ -150,7 +154,9 @@ ssize_t IOBase::Read(void *buf, size_t size, const std::function<bool()>& fn)
     errno = 0;
     ssize_t nr = read(fd, buf, size);
     if (nr < 0) {
-        if (errno != EINTR) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return TIMEOUT;
+        } else if (errno != EINTR) {
             if (errno == ECONNRESET) {
                 return CLOSED;
             }
@@ -274,3 +280,133 @@ ssize_t IOBase::WriteAll(const void * buf, size_t size, long timeout, const std:
 
     return OK;
 }
+
+ssize_t IOBase::WriteV(const struct iovec* iov, int iovcnt)
+{
+    while (true) {
+        int fd = _fd.load();
+        if (_fd < 0 || _wclosed.load()) {
+            return CLOSED;
+        }
+        auto nw = writev(fd, iov, std::min(iovcnt, IOV_MAX));
+        if (nw < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return TIMEOUT;
+            } else if (errno != EINTR) {
+                if (errno == ECONNRESET || errno == EPIPE) {
+                    return CLOSED;
+                }
+                return FAILED;
+            }
+        } else if (nw == 0) {
+            return CLOSED;
+        } else {
+            return nw;
+        }
+    }
+}
+
+ssize_t IOBase::WriteAllV(struct iovec* iov, int iovcnt, long timeout, const std::function<bool()>& fn)
+{
+    // Skip empty buffers
+    while (iovcnt > 0 && iov->iov_len == 0) {
+        ++iov;
+        --iovcnt;
+    }
+    while (iovcnt > 0) {
+        int fd = _fd.load();
+        if (_fd < 0 || _wclosed.load()) {
+            return CLOSED;
+        }
+        auto ret = WaitWritable(timeout);
+        if (ret != OK) {
+            return ret;
+        }
+        auto nw = writev(fd, iov, std::min(iovcnt, IOV_MAX));
+        if (nw < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            } else if (errno != EINTR) {
+                return FAILED;
+            } else if (fn && fn()) {
+                return INTERRUPTED;
+            }
+        } else if (nw == 0) {
+            // This shouldn't happen, but treat as a EOF if it does in order to avoid infinite loop.
+            return CLOSED;
+        } else {
+            size_t n = static_cast<size_t>(nw);
+            while (iovcnt > 0 && n >= iov->iov_len) {
+                n -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            }
+            if (iovcnt > 0) {
+                iov->iov_base = reinterpret_cast<char*>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+
+    return OK;
+}
+
+ssize_t IOBase::SendAllMessages(struct mmsghdr* msgs, unsigned int count, long timeout, const std::function<bool()>& fn)
+{
+    while (count > 0) {
+        int fd = _fd.load();
+        if (_fd < 0 || _wclosed.load()) {
+            return CLOSED;
+        }
+        auto ret = WaitWritable(timeout);
+        if (ret != OK) {
+            return ret;
+        }
+        auto ns = sendmmsg(fd, msgs, count, 0);
+        if (ns < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            } else if (errno != EINTR) {
+                if (errno == ECONNREFUSED || errno == ENOTCONN || errno == EPIPE) {
+                    return CLOSED;
+                }
+                return FAILED;
+            } else if (fn && fn()) {
+                return INTERRUPTED;
+            }
+        } else if (ns == 0) {
+            // This shouldn't happen, but treat as a EOF if it does in order to avoid infinite loop.
+            return CLOSED;
+        } else {
+            msgs += ns;
+            count -= ns;
+        }
+    }
+
+    return OK;
+}
+
+ssize_t IOBase::SendMessages(struct mmsghdr* msgs, unsigned int count)
+{
+    while (true) {
+        int fd = _fd.load();
+        if (_fd < 0 || _wclosed.load()) {
+            return CLOSED;
+        }
+        auto ns = sendmmsg(fd, msgs, count, 0);
+        if (ns < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return TIMEOUT;
+            } else if (errno != EINTR) {
+                if (errno == ECONNREFUSED || errno == ENOTCONN || errno == EPIPE) {
+                    return CLOSED;
+                }
+                return FAILED;
+            }
+        } else if (ns == 0) {
+            return CLOSED;
+        } else {
+            return ns;
+        }
+    }
+}
@@ -23,6 +23,8 @@
 
 extern "C" {
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 }
 
 class IO {
@@ -42,6 +44,7 @@ public:
      * Return >0 on success
      * Return CLOSED if fd closed
      * Return FAILED if read failed
+     * Return TIMEOUT if fd is non-blocking and no data is available
      * Return INTERRUPTED if signal received
      */
     virtual ssize_t Read(void *buf, size_t buf_size, const std::function<bool()>& fn) = 0;
@@ -123,6 +126,9 @@ public:
 
     virtual void SetNonBlock(bool enable);
 
+    // Return true if each write is sent as a separate datagram
+    virtual bool IsDatagram() { return false; }
+
     ssize_t WaitReadable(long timeout) override;
     ssize_t WaitWritable(long timeout) override;
     ssize_t Read(void *buf, size_t buf_size, const std::function<bool()>& fn) override;
@@ -131,6 +137,49 @@ public:
     ssize_t DiscardAll(size_t size, const std::function<bool()>& fn) override;
     ssize_t WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) override;
 
+    /*
+     * Write all the iovec buffers, in as few writev calls as possible.
+     * The contents of iov are modified to track partial writes.
+     *
+     * Return OK on success
+     * Return CLOSED if fd closed
+     * Return FAILED if write failed
+     * Return TIMEOUT if write timeout occurred
+     * Return INTERRUPTED if signal received
+     */
+    ssize_t WriteAllV(struct iovec* iov, int iovcnt, long timeout, const std::function<bool()>& fn);
+
+    /*
+     * Make a single writev call, retrying only on EINTR. Intended for non-blocking fds.
+     *
+     * Return >0 (number of bytes written) on success
+     * Return CLOSED if fd closed
+     * Return FAILED if write failed
+     * Return TIMEOUT if the write would block
+     */
+    ssize_t WriteV(const struct iovec* iov, int iovcnt);
+
+    /*
+     * Send each message as one datagram, in as few sendmmsg calls as possible.
+     *
+     * Return OK on success
+     * Return CLOSED if fd closed or there is no longer a receiver
+     * Return FAILED if send failed
+     * Return TIMEOUT if write timeout occurred
+     * Return INTERRUPTED if signal received
+     */
+    ssize_t SendAllMessages(struct mmsghdr* msgs, unsigned int count, long timeout, const std::function<bool()>& fn);
+
+    /*
+     * Make a single sendmmsg call, retrying only on EINTR. Intended for non-blocking fds.
+     *
+     * Return >0 (number of messages sent) on success
+     * Return CLOSED if fd closed or there is no longer a receiver
+     * Return FAILED if send failed
+     * Return TIMEOUT if the send would block
+     */
+    ssize_t SendMessages(struct mmsghdr* msgs, unsigned int count);
+
 protected:
     std::atomic<int> _fd;
     std::atomic<bool> _rclosed;
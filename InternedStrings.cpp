@@ -0,0 +1,66 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InternedStrings.h"
+
+const std::string& InternedString::empty_string() {
+    static const std::string empty;
+    return empty;
+}
+
+InternedString StringInterner::Intern(std::string_view str) {
+    if (str.empty()) {
+        return InternedString();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _strings.find(str);
+    if (it != _strings.end()) {
+        return InternedString(it->second);
+    }
+    auto s = std::make_shared<const std::string>(str);
+    _strings.emplace(std::string_view(*s), s);
+    _bytes += s->size();
+    return InternedString(s);
+}
+
+size_t StringInterner::Compact() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // New references can only be created through Intern(), so an entry whose only owner is the table can be removed.
+    size_t removed = 0;
+    for (auto it = _strings.begin(); it != _strings.end();) {
+        if (it->second.use_count() == 1) {
+            _bytes -= it->second->size();
+            it = _strings.erase(it);
+            removed++;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+size_t StringInterner::Size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _strings.size();
+}
+
+size_t StringInterner::Bytes() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
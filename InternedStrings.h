@@ -0,0 +1,69 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUOMS_INTERNEDSTRINGS_H
+#define AUOMS_INTERNEDSTRINGS_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Immutable, refcounted reference to a string owned by a StringInterner.
+// A default constructed InternedString is the empty string.
+class InternedString {
+public:
+    InternedString() = default;
+    explicit InternedString(std::shared_ptr<const std::string> str): _str(std::move(str)) {}
+
+    inline const std::string& str() const { return _str ? *_str : empty_string(); }
+    inline const char* c_str() const { return str().c_str(); }
+    inline bool empty() const { return !_str || _str->empty(); }
+    inline size_t size() const { return _str ? _str->size() : 0; }
+
+    inline bool operator==(const InternedString& other) const { return _str == other._str || str() == other.str(); }
+    inline bool operator!=(const InternedString& other) const { return !(*this == other); }
+
+private:
+    static const std::string& empty_string();
+
+    std::shared_ptr<const std::string> _str;
+};
+
+// Deduplicates strings so that identical values share a single allocation.
+// Entries stay in the table until Compact() finds they are no longer referenced by any InternedString.
+class StringInterner {
+public:
+    StringInterner(): _bytes(0) {}
+
+    InternedString Intern(std::string_view str);
+
+    // Removes unreferenced strings, returns the number removed.
+    size_t Compact();
+
+    size_t Size();
+    // Total size of the string data held by the table.
+    size_t Bytes();
+
+private:
+    std::mutex _mutex;
+    // The keys refer to the strings owned by the values.
+    std::unordered_map<std::string_view, std::shared_ptr<const std::string>> _strings;
+    size_t _bytes;
+};
+
+#endif //AUOMS_INTERNEDSTRINGS_H
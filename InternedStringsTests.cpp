@@ -0,0 +1,75 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "InternedStringsTests"
+#include <boost/test/unit_test.hpp>
+
+#include "InternedStrings.h"
+
+BOOST_AUTO_TEST_CASE( basic_test ) {
+    StringInterner interner;
+
+    auto a = interner.Intern("/usr/bin/bash");
+    auto b = interner.Intern(std::string("/usr/bin/bash"));
+    auto c = interner.Intern("/usr/bin/make");
+
+    BOOST_REQUIRE_EQUAL(a.str(), "/usr/bin/bash");
+    BOOST_REQUIRE_EQUAL(a.c_str(), b.c_str());
+    BOOST_REQUIRE(a == b);
+    BOOST_REQUIRE(a != c);
+    BOOST_REQUIRE_EQUAL(interner.Size(), 2);
+    BOOST_REQUIRE_EQUAL(interner.Bytes(), 26);
+}
+
+BOOST_AUTO_TEST_CASE( empty_test ) {
+    StringInterner interner;
+
+    auto e = interner.Intern("");
+    InternedString d;
+
+    BOOST_REQUIRE(e.empty());
+    BOOST_REQUIRE(d.empty());
+    BOOST_REQUIRE(e == d);
+    BOOST_REQUIRE_EQUAL(d.str(), "");
+    BOOST_REQUIRE_EQUAL(d.size(), 0);
+    BOOST_REQUIRE_EQUAL(interner.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( compact_test ) {
+    StringInterner interner;
+
+    auto a = interner.Intern("/usr/bin/bash");
+    {
+        auto b = interner.Intern("/usr/bin/make");
+        auto c = b;
+        BOOST_REQUIRE_EQUAL(interner.Compact(), 0);
+    }
+    BOOST_REQUIRE_EQUAL(interner.Size(), 2);
+    BOOST_REQUIRE_EQUAL(interner.Compact(), 1);
+    BOOST_REQUIRE_EQUAL(interner.Size(), 1);
+    BOOST_REQUIRE_EQUAL(interner.Bytes(), 13);
+
+    a = InternedString();
+    BOOST_REQUIRE_EQUAL(interner.Compact(), 1);
+    BOOST_REQUIRE_EQUAL(interner.Size(), 0);
+    BOOST_REQUIRE_EQUAL(interner.Bytes(), 0);
+
+    // A string removed by compaction can be interned again
+    auto d = interner.Intern("/usr/bin/bash");
+    BOOST_REQUIRE_EQUAL(d.str(), "/usr/bin/bash");
+    BOOST_REQUIRE_EQUAL(interner.Size(), 1);
+}
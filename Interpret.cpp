@@ -32,6 +32,12 @@
 #include <linux/netlink.h>
 #include <arpa/inet.h>
 
+#include <algorithm>
+
+// Character that separates key in AUDIT_FILTERKEY field in rules
+// This value mirrors what is defined for AUDIT_KEY_SEPARATOR in libaudit.h
+#define KEY_SEP 0x01
+
 template <typename T>
 inline bool field_to_int(const EventRecordField& field, T& val, int base) {
     errno = 0;
@@ -46,6 +52,29 @@ inline bool field_to_uint(const EventRecordField& field, T& val, int base) {
     return errno == 0;
 }
 
+bool FieldToSyscall(const EventRecord& record, const EventRecordField& field, MachineType& mtype, int& syscall) {
+    mtype = MachineType::UNKNOWN;
+    syscall = -1;
+
+    char* end = nullptr;
+    auto val = strtol(field.RawValuePtr(), &end, 10);
+    if (end == field.RawValuePtr() || *end != 0 || val < 0 || val > INT32_MAX) {
+        return false;
+    }
+    syscall = static_cast<int>(val);
+
+    auto arch_field = record.FieldByName("arch");
+    if (!arch_field) {
+        return false;
+    }
+    uint32_t arch;
+    if (!field_to_uint(arch_field, arch, 16)) {
+        return false;
+    }
+    mtype = ArchToMachine(arch);
+    return mtype != MachineType::UNKNOWN;
+}
+
 static StringTable<int> s_fam_table(-1, {
         {"local",      AF_LOCAL},
         {"inet",       AF_INET},
@@ -341,3 +370,139 @@ bool InterpretField(std::string& out, const EventRecord& record, const EventReco
             return false;
     }
 }
+
+std::atomic<uint64_t> InterpretCache::_next_id(1);
+
+InterpretCache::InterpretCache(size_t max_entries, const std::shared_ptr<Metrics>& metrics):
+    _id(_next_id.fetch_add(1)), _num_entries(0)
+{
+    if (max_entries > 0) {
+        _num_entries = 1;
+        while (_num_entries < max_entries) {
+            _num_entries <<= 1;
+        }
+    }
+    _hits_metric = metrics->AddMetric("interp_cache", "hits", MetricPeriod::SECOND, MetricPeriod::HOUR);
+    _misses_metric = metrics->AddMetric("interp_cache", "misses", MetricPeriod::SECOND, MetricPeriod::HOUR);
+    _hit_rate_metric = metrics->AddMetric("interp_cache", "hit_rate", MetricPeriod::MINUTE, MetricPeriod::HOUR);
+}
+
+bool InterpretCache::is_cacheable(field_type_t field_type) {
+    return field_type == field_type_t::SOCKADDR;
+}
+
+InterpretCache::Table& InterpretCache::thread_table() {
+    static thread_local Table table;
+    if (table.owner != _id) {
+        table.owner = _id;
+        table.entries.assign(_num_entries, Entry());
+        table.hits = 0;
+        table.misses = 0;
+        table.reported_hits = 0;
+        table.reported_misses = 0;
+    }
+    return table;
+}
+
+bool InterpretCache::InterpretField(std::string& out, const EventRecord& record, const EventRecordField& field, field_type_t field_type) {
+    if (_num_entries == 0 || !is_cacheable(field_type)) {
+        return ::InterpretField(out, record, field, field_type);
+    }
+
+    auto raw = field.RawValue();
+    auto& table = thread_table();
+    auto& entry = table.entries[std::hash<std::string_view>()(raw) & (_num_entries-1)];
+
+    bool result;
+    if (entry.valid && entry.raw == raw) {
+        table.hits++;
+        out.assign(entry.interp);
+        result = entry.result;
+    } else {
+        table.misses++;
+        out.resize(0);
+        result = ::InterpretField(out, record, field, field_type);
+        // The strings keep their capacity, so replacing an entry doesn't allocate once the table is warm
+        entry.valid = true;
+        entry.result = result;
+        entry.raw.assign(raw);
+        entry.interp.assign(out);
+    }
+
+    if (table.hits + table.misses - table.reported_hits - table.reported_misses >= REPORT_INTERVAL) {
+        report(table);
+    }
+
+    return result;
+}
+
+uint64_t InterpretCache::ThreadHits() {
+    return thread_table().hits;
+}
+
+uint64_t InterpretCache::ThreadMisses() {
+    return thread_table().misses;
+}
+
+// Metric::Add() takes a lock and reads the clock, so counts are accumulated per thread and reported in batches.
+void InterpretCache::report(Table& table) {
+    auto hits = table.hits - table.reported_hits;
+    auto misses = table.misses - table.reported_misses;
+    _hits_metric->Add(static_cast<double>(hits));
+    _misses_metric->Add(static_cast<double>(misses));
+    _hit_rate_metric->Set(static_cast<double>(hits) * 100.0 / static_cast<double>(hits + misses));
+    table.reported_hits = table.hits;
+    table.reported_misses = table.misses;
+}
+
+bool FieldInterpreter::Interpret(std::string& out, const EventRecord& record, const EventRecordField& field, field_type_t field_type) {
+    using namespace std::string_literals;
+
+    static auto S_UNSET = "unset"s;
+
+    out.resize(0);
+
+    switch (field_type) {
+        case field_type_t::UID: {
+            int uid = static_cast<int>(strtoul(field.RawValuePtr(), NULL, 10));
+            if (uid < 0) {
+                out = S_UNSET;
+            } else {
+                out = _user_db->GetUserName(uid);
+            }
+            if (out.empty()) {
+                out = "unknown-uid(" + std::to_string(uid) + ")";
+            }
+            return true;
+        }
+        case field_type_t::GID: {
+            int gid = static_cast<int>(strtoul(field.RawValuePtr(), NULL, 10));
+            if (gid < 0) {
+                out = S_UNSET;
+            } else {
+                out = _user_db->GetGroupName(gid);
+            }
+            if (out.empty()) {
+                out = "unknown-gid(" + std::to_string(gid) + ")";
+            }
+            return true;
+        }
+        case field_type_t::ESCAPED_KEY:
+            if (unescape_raw_field(out, field.RawValuePtr(), field.RawValueSize()) > 0) {
+                std::replace(out.begin(), out.end(), static_cast<char>(KEY_SEP), ',');
+                return true;
+            }
+            out.resize(0);
+            return false;
+        case field_type_t::ESCAPED:
+        case field_type_t::PROCTITLE:
+            // The escaped raw value is handled by the output
+            return false;
+        default:
+            if (!_cache->InterpretField(out, record, field, field_type)) {
+                out.resize(0);
+                return false;
+            }
+            return true;
+    }
+}
@@ -18,7 +18,78 @@
 #define AUOMS_INTERPRET_H
 
 #include "Event.h"
+#include "Metrics.h"
+#include "UserDB.h"
+#include "IFieldInterpreter.h"
+#include "MachineType.h"
+
+#include <atomic>
+#include <vector>
 
 bool InterpretField(std::string& out, const EventRecord& record, const EventRecordField& field, field_type_t field_type);
 
+// Extract the machine type (from the record's arch field) and the numeric syscall from a syscall field's raw value.
+// Returns false if either is missing or invalid, in which case mtype is UNKNOWN and/or syscall is -1.
+bool FieldToSyscall(const EventRecord& record, const EventRecordField& field, MachineType& mtype, int& syscall);
+
+// Cache of interpreted SOCKADDR values, the only field type whose interpretation costs much more than a lookup.
+// Other field types are passed straight through to InterpretField. Each thread gets its own direct-mapped table,
+// so a lookup takes no lock and reads no clock, and a value that maps to an occupied slot replaces the old one.
+class InterpretCache {
+public:
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 4096;
+
+    InterpretCache(size_t max_entries, const std::shared_ptr<Metrics>& metrics);
+
+    bool InterpretField(std::string& out, const EventRecord& record, const EventRecordField& field, field_type_t field_type);
+
+    // The calling thread's lookups since it started using this cache
+    uint64_t ThreadHits();
+    uint64_t ThreadMisses();
+
+private:
+    static constexpr uint64_t REPORT_INTERVAL = 1024;
+
+    struct Entry {
+        bool valid = false;
+        bool result = false;
+        std::string raw;
+        std::string interp;
+    };
+
+    struct Table {
+        uint64_t owner = 0;
+        std::vector<Entry> entries;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t reported_hits = 0;
+        uint64_t reported_misses = 0;
+    };
+
+    static bool is_cacheable(field_type_t field_type);
+    Table& thread_table();
+    void report(Table& table);
+
+    static std::atomic<uint64_t> _next_id;
+
+    uint64_t _id;
+    size_t _num_entries; // 0 or a power of 2
+    std::shared_ptr<Metric> _hits_metric;
+    std::shared_ptr<Metric> _misses_metric;
+    std::shared_ptr<Metric> _hit_rate_metric;
+};
+
+// Produces the interp value for a field the same way regardless of whether it happens in the event processor or,
+// when interpretation is deferred, in an output. A single instance is shared by all outputs.
+class FieldInterpreter: public IFieldInterpreter {
+public:
+    FieldInterpreter(const std::shared_ptr<UserDB>& user_db, const std::shared_ptr<InterpretCache>& cache): _user_db(user_db), _cache(cache) {}
+
+    bool Interpret(std::string& out, const EventRecord& record, const EventRecordField& field, field_type_t field_type) override;
+
+private:
+    std::shared_ptr<UserDB> _user_db;
+    std::shared_ptr<InterpretCache> _cache;
+};
+
 #endif //AUOMS_INTERPRET_H
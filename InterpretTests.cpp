@@ -0,0 +1,164 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "InterpretTests"
+#include <boost/test/unit_test.hpp>
+
+#include "Interpret.h"
+#include "TestEventQueue.h"
+
+#include <thread>
+
+const std::vector<std::string> sockaddr_values = {
+        "02000050C0A801010000000000000000", // AF_INET 192.168.1.1:80
+        "0200ACDC0A0000020000000000000000", // AF_INET 10.0.0.2:44252
+        "0A0001BB00000000200100000000000000000000000000010000000000000000", // AF_INET6 [2001::1]:443
+        "01002F746D702F736F636B00", // AF_UNIX /tmp/sock
+        "10000000000000000000000000000000", // AF_NETLINK
+        "ZZ", // Not hex
+        "FFFF", // Unknown family
+};
+
+class TestEvent {
+public:
+    TestEvent(const std::vector<std::pair<std::string, field_type_t>>& fields) {
+        _queue = std::make_shared<TestEventQueue>();
+        EventBuilder builder(_queue);
+        BOOST_REQUIRE_EQUAL(builder.BeginEvent(1, 0, 1, 1), 1);
+        BOOST_REQUIRE_EQUAL(builder.BeginRecord(1, "test", "", fields.size()), 1);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(builder.AddField("f" + std::to_string(i), fields[i].first, nullptr, fields[i].second), 1);
+        }
+        BOOST_REQUIRE_EQUAL(builder.EndRecord(), 1);
+        BOOST_REQUIRE_EQUAL(builder.EndEvent(), 1);
+    }
+
+    Event GetEvent() {
+        return _queue->GetEvent(0);
+    }
+
+private:
+    std::shared_ptr<TestEventQueue> _queue;
+};
+
+std::shared_ptr<Metrics> new_metrics() {
+    return std::make_shared<Metrics>(std::make_shared<EventBuilder>(std::make_shared<TestEventQueue>()));
+}
+
+std::vector<std::pair<std::string, field_type_t>> sockaddr_fields() {
+    std::vector<std::pair<std::string, field_type_t>> fields;
+    for (auto& val : sockaddr_values) {
+        fields.emplace_back(val, field_type_t::SOCKADDR);
+    }
+    return fields;
+}
+
+BOOST_AUTO_TEST_CASE( cache_hits ) {
+    InterpretCache cache(16, new_metrics());
+    TestEvent test({{sockaddr_values[0], field_type_t::SOCKADDR}});
+    auto event = test.GetEvent();
+    auto rec = event.RecordAt(0);
+    auto field = rec.FieldAt(0);
+
+    std::string expected;
+    BOOST_REQUIRE(InterpretField(expected, rec, field, field_type_t::SOCKADDR));
+
+    std::string out;
+    BOOST_REQUIRE(cache.InterpretField(out, rec, field, field_type_t::SOCKADDR));
+    BOOST_REQUIRE_EQUAL(out, expected);
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits(), 0);
+    BOOST_REQUIRE_EQUAL(cache.ThreadMisses(), 1);
+
+    out = "stale";
+    BOOST_REQUIRE(cache.InterpretField(out, rec, field, field_type_t::SOCKADDR));
+    BOOST_REQUIRE_EQUAL(out, expected);
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits(), 1);
+    BOOST_REQUIRE_EQUAL(cache.ThreadMisses(), 1);
+
+    // Other threads have their own table
+    uint64_t thread_hits = 0;
+    uint64_t thread_misses = 0;
+    std::thread thread([&]() {
+        std::string thread_out;
+        cache.InterpretField(thread_out, rec, field, field_type_t::SOCKADDR);
+        thread_hits = cache.ThreadHits();
+        thread_misses = cache.ThreadMisses();
+    });
+    thread.join();
+    BOOST_REQUIRE_EQUAL(thread_hits, 0);
+    BOOST_REQUIRE_EQUAL(thread_misses, 1);
+}
+
+BOOST_AUTO_TEST_CASE( cache_eviction ) {
+    // A single slot, every different value replaces the previous one
+    InterpretCache cache(1, new_metrics());
+    TestEvent test(sockaddr_fields());
+    auto event = test.GetEvent();
+    auto rec = event.RecordAt(0);
+
+    std::string out;
+    cache.InterpretField(out, rec, rec.FieldAt(0), field_type_t::SOCKADDR);
+    cache.InterpretField(out, rec, rec.FieldAt(1), field_type_t::SOCKADDR);
+    cache.InterpretField(out, rec, rec.FieldAt(0), field_type_t::SOCKADDR);
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits(), 0);
+    BOOST_REQUIRE_EQUAL(cache.ThreadMisses(), 3);
+    cache.InterpretField(out, rec, rec.FieldAt(0), field_type_t::SOCKADDR);
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( cache_correctness ) {
+    // Fewer slots than values so that entries collide and get replaced
+    InterpretCache cache(4, new_metrics());
+    TestEvent test(sockaddr_fields());
+    auto event = test.GetEvent();
+    auto rec = event.RecordAt(0);
+
+    for (int pass = 0; pass < 3; ++pass) {
+        for (size_t i = 0; i < rec.NumFields(); ++i) {
+            auto field = rec.FieldAt(i);
+            std::string expected;
+            auto expected_ret = InterpretField(expected, rec, field, field_type_t::SOCKADDR);
+            std::string out;
+            auto ret = cache.InterpretField(out, rec, field, field_type_t::SOCKADDR);
+            BOOST_REQUIRE_MESSAGE(ret == expected_ret, "Result mismatch for " << field.RawValue());
+            BOOST_REQUIRE_MESSAGE(out == expected, "Expected '" << expected << "' got '" << out << "' for " << field.RawValue());
+        }
+    }
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits() + cache.ThreadMisses(), 3*sockaddr_values.size());
+}
+
+BOOST_AUTO_TEST_CASE( uncached_types ) {
+    InterpretCache cache(16, new_metrics());
+    TestEvent test({
+        {"c000003e", field_type_t::ARCH},
+        {"0100644", field_type_t::MODE},
+        {"040755", field_type_t::MODE},
+    });
+    auto event = test.GetEvent();
+    auto rec = event.RecordAt(0);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (auto field : {rec.FieldAt(0), rec.FieldAt(1), rec.FieldAt(2)}) {
+            std::string expected;
+            auto expected_ret = InterpretField(expected, rec, field, field.FieldType());
+            std::string out;
+            BOOST_REQUIRE_EQUAL(cache.InterpretField(out, rec, field, field.FieldType()), expected_ret);
+            BOOST_REQUIRE_EQUAL(out, expected);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(cache.ThreadHits(), 0);
+    BOOST_REQUIRE_EQUAL(cache.ThreadMisses(), 0);
+}
@@ -23,6 +23,12 @@ ssize_t JSONEventWriter::WriteEvent(const Event& event, IWriter* writer) {
     _buffer.Clear();
     _writer.Reset(_buffer);
 
+    auto flags = event.Flags();
+    bool interpret = _interpreter && (flags & EVENT_FLAG_INTERP_DEFERRED) != 0;
+    if (interpret) {
+        flags &= ~EVENT_FLAG_INTERP_DEFERRED;
+    }
+
     // Start message
     _writer.StartObject(); // Event
     _writer.Key("sec");
@@ -32,7 +38,7 @@ ssize_t JSONEventWriter::WriteEvent(const Event& event, IWriter* writer) {
     _writer.Key("serial");
     _writer.Int64(event.Serial());
     _writer.Key("flags");
-    _writer.Int64(event.Flags());
+    _writer.Int64(flags);
     _writer.Key("pid");
     _writer.Int64(event.Pid());
     _writer.Key("records");
@@ -68,6 +74,9 @@ ssize_t JSONEventWriter::WriteEvent(const Event& event, IWriter* writer) {
             if (f.InterpValueSize() > 0) {
                 _writer.Key("i");
                 _writer.Key(f.InterpValuePtr(), f.InterpValueSize(), true);
+            } else if (interpret && _interpreter->Interpret(_deferred_interp_value, rec, f, f.FieldType()) && !_deferred_interp_value.empty()) {
+                _writer.Key("i");
+                _writer.Key(_deferred_interp_value.data(), _deferred_interp_value.size(), true);
             } else {
                 _writer.Null();
             }
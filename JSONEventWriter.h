@@ -21,8 +21,7 @@
 
 #include <array>
 
-#include <rapidjson/stringbuffer.h>
-#include <rapidjson/writer.h>
+#include "RapidJSONWriter.h"
 
 
 class JSONEventWriter: public TextEventWriter {
@@ -32,10 +31,9 @@ public:
     virtual ssize_t WriteEvent(const Event& event, IWriter* writer);
 
 private:
-    void write_raw_field(const std::string& name, const char* value_data, size_t value_size) {}
     std::array<char, 1024> _header;
     rapidjson::StringBuffer _buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> _writer;
+    RapidJSONWriter _writer;
 };
 
 
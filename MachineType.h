@@ -25,6 +25,8 @@ enum class MachineType: int {
     ARM64 = 3,
 };
 
+constexpr int NUM_MACHINE_TYPES = 4;
+
 inline bool Is64BitMachineType(MachineType mtype) {
     return mtype == MachineType::X86_64 || mtype == MachineType::ARM64;
 }
@@ -24,21 +24,21 @@
 #include <sstream>
 #include <iomanip>
 
-void OMSEventWriter::write_int32_field(const std::string& name, int32_t value)
+void OMSEventWriter::write_int32_field(std::string_view name, int32_t value)
 {
-    _writer.Key(name.data(), name.length(), true);
+    _writer.Key(name.data(), name.size(), true);
     _writer.Int(value);
 }
 
-void OMSEventWriter::write_int64_field(const std::string& name, int64_t value)
+void OMSEventWriter::write_int64_field(std::string_view name, int64_t value)
 {
-    _writer.Key(name.data(), name.length(), true);
+    _writer.Key(name.data(), name.size(), true);
     _writer.Int64(value);
 }
 
-void OMSEventWriter::write_raw_field(const std::string& name, const char* value_data, size_t value_size)
+void OMSEventWriter::write_raw_field(std::string_view name, const char* value_data, size_t value_size)
 {
-    _writer.Key(name.data(), name.length(), true);
+    _writer.Key(name.data(), name.size(), true);
     _writer.String(value_data, value_size, true);
 }
 
@@ -66,7 +66,7 @@ bool OMSEventWriter::begin_event(const Event& event)
                  << std::setw(3) << std::setfill('0')
                  << event.Milliseconds();
 
-    TextEventWriter::write_string_field(_config.TimestampFieldName, timestamp_str.str());
+    write_string_field(_config.TimestampFieldName, timestamp_str.str());
     write_int64_field(_config.SerialFieldName, event.Serial());
     write_int32_field(_config.ProcessFlagsFieldName, event.Flags()>>16);
     _writer.String(_config.RecordsFieldName.data(), _config.RecordsFieldName.length(), true);
@@ -97,18 +97,12 @@ ssize_t OMSEventWriter::WriteEvent(const Event& event, IWriter* writer)
     }
 }
 
-bool OMSEventWriter::begin_record(const EventRecord& record, const std::string& record_type_name)
+bool OMSEventWriter::begin_record(const EventRecord& record, std::string_view record_type_name)
 {
     _writer.StartObject();
     write_int32_field(_config.RecordTypeFieldName, static_cast<int32_t>(record.RecordType()));
     write_string_field(_config.RecordTypeNameFieldName, record_type_name);
 
-/*
-    for (auto field : record) {
-        TextEventWriter::write_field(field);
-    }
-*/
-
     return true;
 }
 
@@ -116,3 +110,5 @@ void OMSEventWriter::end_record(const EventRecord& record)
 {
     _writer.EndObject();
 }
+
+template class TextEventWriterBase<OMSEventWriter>;
@@ -19,35 +19,39 @@
 #include "TextEventWriter.h"
 
 #include <string>
+#include <string_view>
 #include <memory>
 
-#include <rapidjson/stringbuffer.h>
-#include <rapidjson/writer.h>
+#include "RapidJSONWriter.h"
 
 
-class OMSEventWriter: public TextEventWriter {
+class OMSEventWriter: public TextEventWriterBase<OMSEventWriter> {
 public:
-    OMSEventWriter(TextEventWriterConfig config): TextEventWriter(config),
+    OMSEventWriter(TextEventWriterConfig config): TextEventWriterBase(config),
     _buffer(0, 1024*1024), _writer(_buffer)
     {}
 
     ssize_t WriteEvent(const Event& event, IWriter* writer);
 
 protected:
-    void write_int32_field(const std::string& name, int32_t value);
-    void write_int64_field(const std::string& name, int64_t value);
-    void write_raw_field(const std::string& name, const char* value_data, size_t value_size);
+    friend class TextEventWriterBase<OMSEventWriter>;
+
+    void write_int32_field(std::string_view name, int32_t value);
+    void write_int64_field(std::string_view name, int64_t value);
+    void write_raw_field(std::string_view name, const char* value_data, size_t value_size);
 
     bool begin_event(const Event& event);
     void end_event(const Event& event);
 
-    bool begin_record(const EventRecord& record, const std::string& record_type_name);
+    bool begin_record(const EventRecord& record, std::string_view record_type_name);
     void end_record(const EventRecord& record);
 
 private:
     rapidjson::StringBuffer _buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> _writer;
+    RapidJSONWriter _writer;
 };
 
+extern template class TextEventWriterBase<OMSEventWriter>;
+
 
 #endif //AUOMS_OMSEVENTTRANSFORMER_H
@@ -17,6 +17,7 @@
 #include "Output.h"
 #include "Logger.h"
 #include "UnixDomainWriter.h"
+#include "BatchWriter.h"
 
 #include "OMSEventWriter.h"
 #include "JSONEventWriter.h"
@@ -36,7 +37,10 @@ extern "C" {
  *
  ****************************************************************************/
 
-AckQueue::AckQueue(size_t max_size): _max_size(max_size), _closed(false), _have_auto_cursor(false), _next_seq(0), _auto_cursor_seq(0) {}
+const EventId AckQueue::CUMULATIVE_ACK_ID(1, 0, 0);
+
+AckQueue::AckQueue(size_t max_size): _ring(max_size), _tail(0), _head(0), _max_size(max_size), _closed(false),
+    _cumulative(false), _have_acks(false), _have_auto_cursor(false), _auto_cursor_seq(0) {}
 
 void AckQueue::Close() {
     std::unique_lock<std::mutex> _lock(_mutex);
@@ -47,10 +51,15 @@ void AckQueue::Close() {
 bool AckQueue::Add(const EventId& event_id, const QueueCursor& cursor, long timeout) {
     std::unique_lock<std::mutex> _lock(_mutex);
 
-    if (_cond.wait_for(_lock, std::chrono::milliseconds(timeout), [this]() { return _closed || _event_ids.size() < _max_size; })) {
-        auto seq = _next_seq++;
-        _event_ids.emplace(event_id, seq);
-        _cursors.emplace(seq, std::make_pair(event_id, cursor));
+    if (_cond.wait_for(_lock, std::chrono::milliseconds(timeout), [this]() { return _closed || _head - _tail < _max_size; })) {
+        if (_head - _tail >= _max_size) {
+            // Closed while full
+            return false;
+        }
+        auto& e = entry(_head++);
+        e.event_id = event_id;
+        e.cursor = cursor;
+        e.removed = false;
         return true;
     }
     return false;
@@ -59,7 +68,7 @@ bool AckQueue::Add(const EventId& event_id, const QueueCursor& cursor, long time
 void AckQueue::SetAutoCursor(const QueueCursor& cursor) {
     std::unique_lock<std::mutex> _lock(_mutex);
 
-    _auto_cursor_seq = _next_seq++;
+    _auto_cursor_seq = _head;
     _auto_cursor = cursor;
     _have_auto_cursor = true;
 }
@@ -78,23 +87,30 @@ bool AckQueue::GetAutoCursor(QueueCursor& cursor) {
 void AckQueue::Remove(const EventId& event_id) {
     std::unique_lock<std::mutex> _lock(_mutex);
 
-    auto eitr = _event_ids.find(event_id);
-    if (eitr == _event_ids.end()) {
-        return;
+    // The removed event is normally the one just added
+    for (auto seq = _head; seq > _tail; --seq) {
+        auto& e = entry(seq-1);
+        if (!e.removed && e.event_id == event_id) {
+            e.removed = true;
+            break;
+        }
+    }
+    while (_head > _tail && entry(_head-1).removed) {
+        _head--;
+    }
+    while (_tail < _head && entry(_tail).removed) {
+        _tail++;
     }
-    auto seq = eitr->second;
-    _event_ids.erase(eitr);
-
-    _cursors.erase(seq);
 }
 
 void AckQueue::Reset() {
     std::unique_lock<std::mutex> _lock(_mutex);
 
     _closed = false;
-    _event_ids.clear();
-    _cursors.clear();
-    _next_seq = 0;
+    _tail = 0;
+    _head = 0;
+    _cumulative = false;
+    _have_acks = false;
     _have_auto_cursor = false;
     _auto_cursor_seq = 0;
 }
@@ -103,39 +119,74 @@ bool AckQueue::Wait(int millis) {
     std::unique_lock<std::mutex> _lock(_mutex);
 
     auto now = std::chrono::steady_clock::now();
-    return _cond.wait_until(_lock, now + std::chrono::milliseconds(millis), [this] { return _event_ids.empty(); });
+    return _cond.wait_until(_lock, now + std::chrono::milliseconds(millis), [this] { return _tail == _head; });
+}
+
+bool AckQueue::IsFull() {
+    std::unique_lock<std::mutex> _lock(_mutex);
+
+    return _head - _tail >= _max_size;
 }
 
 bool AckQueue::Ack(const EventId& event_id, QueueCursor& cursor) {
     std::unique_lock<std::mutex> _lock(_mutex);
 
-    bool found = false;
-    uint64_t seq = 0;
+    if (!_have_acks) {
+        _have_acks = true;
+        if (event_id == CUMULATIVE_ACK_ID) {
+            _cumulative = true;
+            return false;
+        }
+    }
 
-    auto eitr = _event_ids.find(event_id);
-    if (eitr != _event_ids.end()) {
-        seq = eitr->second;
-        _event_ids.erase(eitr);
-        _cond.notify_all(); // _event_ids was modified, so notify any waiting Add calls
+    // Find the end of the range of released entries
+    uint64_t end = _tail;
+    if (_cumulative) {
+        for (auto seq = _tail; seq < _head; ++seq) {
+            auto& e = entry(seq);
+            if (!e.removed) {
+                if (e.event_id > event_id) {
+                    break;
+                }
+                end = seq+1;
+                if (e.event_id == event_id) {
+                    break;
+                }
+            }
+        }
+    } else {
+        for (auto seq = _tail; seq < _head; ++seq) {
+            auto& e = entry(seq);
+            if (!e.removed && e.event_id == event_id) {
+                end = seq+1;
+                break;
+            }
+        }
+    }
 
-        // Find and remove all from cursors that are <= seq
-        while (!_cursors.empty() && _cursors.begin()->first <= seq) {
-            cursor = _cursors.begin()->second.second;
-            found = true;
-            // Make sure to remove any associated event ids from _event_ids.
-            _event_ids.erase(_cursors.begin()->second.first);
-            _cursors.erase(_cursors.begin());
+    bool found = false;
+    if (end > _tail) {
+        for (; _tail < end; ++_tail) {
+            auto& e = entry(_tail);
+            if (!e.removed) {
+                cursor = e.cursor;
+                found = true;
+            }
         }
+        while (_tail < _head && entry(_tail).removed) {
+            _tail++;
+        }
+        _cond.notify_all(); // Entries were released, so notify any waiting Add calls
     }
 
     /*
      * If the auto cursor is present return it instead if:
-     *      1) The acked event id isn't present or _auto_cursor_seq is newer than the acked seq
-     *      2) and, _cursors is empty or the oldest seq in _cursors is > than _auto_cursor_seq
+     *      1) Nothing was released or the auto cursor is newer than the last released entry
+     *      2) and, the queue is empty or the oldest entry is newer than the auto cursor
      */
     if (_have_auto_cursor) {
-        if (!found || _auto_cursor_seq > seq) {
-            if (_cursors.empty() || _cursors.begin()->first > _auto_cursor_seq) {
+        if (!found || _auto_cursor_seq >= end) {
+            if (_tail == _head || _tail >= _auto_cursor_seq) {
                 found = true;
                 cursor = _auto_cursor;
                 _have_auto_cursor = false;
@@ -321,8 +372,9 @@ bool Output::Load(std::unique_ptr<Config>& config) {
         format = _config->GetString("output_format");
     }
 
-    // For syslog skip the socket check as this writes directly to Syslog
+    // Syslog messages are sent as datagrams to the local syslog socket instead of output_socket
     std::string socket_path = "";
+    bool datagram = false;
 
     if (format.compare("syslog")) {
         if (!_config->HasKey("output_socket")) {
@@ -330,6 +382,17 @@ bool Output::Load(std::unique_ptr<Config>& config) {
             return false;
         } 
         socket_path = _config->GetString("output_socket");
+    } else {
+        socket_path = DEFAULT_SYSLOG_SOCKET;
+        if (_config->HasKey("syslog_socket")) {
+            socket_path = _config->GetString("syslog_socket");
+            // Outputs only allows the default socket or one in the allowed output socket dirs
+            if (socket_path.empty() || socket_path[0] != '/') {
+                Logger::Error("Output(%s): Invalid syslog_socket parameter value: '%s'", _name.c_str(), socket_path.c_str());
+                return false;
+            }
+        }
+        datagram = true;
     }
 
     _event_writer = _writer_factory->CreateEventWriter(_name, *_config);
@@ -343,9 +406,9 @@ bool Output::Load(std::unique_ptr<Config>& config) {
         _event_filter.reset();
     }
 
-    if (socket_path != _socket_path || !_writer) {
+    if (socket_path != _socket_path || !_writer || _writer->IsDatagram() != datagram) {
         _socket_path = socket_path;
-        _writer = std::unique_ptr<UnixDomainWriter>(new UnixDomainWriter(_socket_path));
+        _writer = std::unique_ptr<UnixDomainWriter>(new UnixDomainWriter(_socket_path, datagram));
     }
 
     if (_config->HasKey("enable_ack_mode")) {
@@ -357,6 +420,11 @@ bool Output::Load(std::unique_ptr<Config>& config) {
         }
     }
 
+    if (_ack_mode && datagram) {
+        Logger::Error("Output(%s): enable_ack_mode is not supported by the syslog output format", _name.c_str());
+        return false;
+    }
+
     if (_ack_mode) {
         uint64_t ack_queue_size = DEFAULT_ACK_QUEUE_SIZE;
         if (_config->HasKey("ack_queue_size")) {
@@ -393,6 +461,30 @@ bool Output::Load(std::unique_ptr<Config>& config) {
             _ack_queue.reset();
         }
     }
+
+    _batch_max_bytes = DEFAULT_BATCH_MAX_BYTES;
+    if (_config->HasKey("batch_max_bytes")) {
+        try {
+            _batch_max_bytes = _config->GetUint64("batch_max_bytes");
+        } catch (std::exception) {
+            Logger::Error("Output(%s): Invalid batch_max_bytes parameter value", _name.c_str());
+            return false;
+        }
+    }
+
+    _batch_max_latency = DEFAULT_BATCH_MAX_LATENCY;
+    if (_config->HasKey("batch_max_latency")) {
+        try {
+            _batch_max_latency = _config->GetInt64("batch_max_latency");
+        } catch (std::exception) {
+            Logger::Error("Output(%s): Invalid batch_max_latency parameter value", _name.c_str());
+            return false;
+        }
+    }
+    if (_batch_max_latency < 0) {
+        Logger::Error("Output(%s): Invalid batch_max_latency parameter value", _name.c_str());
+        return false;
+    }
     return true;
 
 }
@@ -444,20 +536,88 @@ bool Output::handle_events(bool checkOpen) {
     _cursor_writer->Start();
 
     if (_ack_mode) {
+        // Reset before starting the reader, so that the first ack is not lost
+        _ack_queue->Reset();
         _ack_reader->Init(_event_writer, _writer, _ack_queue, _cursor_writer);
         _ack_reader->Start();
-        _ack_queue->Reset();
     }
 
+    // When batching is enabled, events are accumulated in the BatchWriter and written with writev()
+    // once batch_max_bytes is reached, batch_max_latency has elapsed, or the queue is idle.
+    std::unique_ptr<BatchWriter> batch;
+    IWriter* writer = _writer.get();
+    if (_batch_max_bytes > 0) {
+        batch = std::unique_ptr<BatchWriter>(new BatchWriter(_writer, _batch_max_bytes));
+        writer = batch.get();
+    }
+
+    // The event writer may also hold events (e.g. fluent packed forward mode), they are flushed along with the batch.
+    _event_writer->Discard();
+    auto has_pending = [&]() -> bool {
+        return (batch && batch->Pending() > 0) || _event_writer->HasPending();
+    };
+    std::chrono::steady_clock::time_point pending_since;
+
+    // In non-ack mode, the cursor is only advanced once the batch containing the event has been written.
+    bool have_pending_cursor = false;
+    QueueCursor pending_cursor;
+
+    auto update_cursor = [&](const QueueCursor& cursor) {
+        if (has_pending()) {
+            pending_cursor = cursor;
+            have_pending_cursor = true;
+        } else {
+            _cursor_writer->UpdateCursor(cursor);
+        }
+    };
+
+    auto flush = [&]() -> bool {
+        if (_event_writer->HasPending() && _event_writer->Flush(writer) != IWriter::OK) {
+            return false;
+        }
+        if (batch && batch->Pending() > 0) {
+            if (batch->Flush(-1, nullptr) != IO::OK) {
+                return false;
+            }
+        }
+        if (have_pending_cursor) {
+            _cursor_writer->UpdateCursor(pending_cursor);
+            have_pending_cursor = false;
+        }
+        return true;
+    };
+
+    bool write_failed = false;
     while(!IsStopping() && (!checkOpen || _writer->IsOpen())) {
         QueueCursor cursor;
         size_t size = data.size();
 
         int ret;
         do {
-            ret = _queue->Get(_cursor, data.data(), &size, &cursor, 100);
+            long timeout = 100;
+            if (has_pending()) {
+                auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pending_since).count();
+                if (age >= _batch_max_latency) {
+                    if (!flush()) {
+                        write_failed = true;
+                        break;
+                    }
+                } else {
+                    // Don't block while there is data waiting to be written
+                    timeout = 0;
+                }
+            }
+            ret = _queue->Get(_cursor, data.data(), &size, &cursor, timeout);
+            if (ret == Queue::TIMEOUT && timeout == 0 && !flush()) {
+                write_failed = true;
+                break;
+            }
         } while(ret == Queue::TIMEOUT && (!checkOpen || _writer->IsOpen()));
 
+        if (write_failed) {
+            break;
+        }
+
         if (ret == Queue::INTERRUPTED) {
             continue;
         }
@@ -480,17 +640,27 @@ bool Output::handle_events(bool checkOpen) {
             bool filtered = _event_filter && _event_filter->IsEventFiltered(event);
             if (!filtered) {
                 if (_ack_mode) {
+                    EventId event_id(event.Seconds(), event.Milliseconds(), event.Serial());
                     // Avoid racing with receiver, add ack before sending event
-                    if (!_ack_queue->Add(EventId(event.Seconds(), event.Milliseconds(), event.Serial()), cursor,
-                                         _ack_timeout)) {
-                        if (_writer->IsOpen()) {
-                            Logger::Error("Output(%s): Timeout waiting for Acks", _name.c_str());
+                    if (!_ack_queue->Add(event_id, cursor, 0)) {
+                        // The ack queue is full, the pending events must be sent before waiting for their acks
+                        if (!flush()) {
+                            break;
+                        }
+                        if (!_ack_queue->Add(event_id, cursor, _ack_timeout)) {
+                            if (_writer->IsOpen()) {
+                                Logger::Error("Output(%s): Timeout waiting for Acks", _name.c_str());
+                            }
+                            break;
                         }
-                        break;
                     }
                 }
 
-                auto ret = _event_writer->WriteEvent(event, _writer.get());
+                bool was_pending = has_pending();
+                auto ret = _event_writer->WriteEvent(event, writer);
+                if (!was_pending && has_pending()) {
+                    pending_since = std::chrono::steady_clock::now();
+                }
                 if (ret == IEventWriter::NOOP) {
                     if (_ack_mode) {
                         // The event was not sent, so remove it's ack
@@ -504,19 +674,23 @@ bool Output::handle_events(bool checkOpen) {
                 _cursor = cursor;
 
                 if (!_ack_mode) {
-                    _cursor_writer->UpdateCursor(cursor);
+                    update_cursor(cursor);
                 }
             } else {
                 _cursor = cursor;
                 if (_ack_mode) {
                     _ack_queue->SetAutoCursor(cursor);
                 } else {
-                    _cursor_writer->UpdateCursor(cursor);
+                    update_cursor(cursor);
                 }
             }
         }
     }
 
+    if (!write_failed && _writer->IsOpen()) {
+        flush();
+    }
+
     if (_ack_mode) {
         // Wait a short time for final acks to arrive
         _ack_queue->Wait(100);
@@ -571,12 +745,9 @@ void Output::run() {
         return;
     }
 
-    bool checkOpen = true;
+    bool checkOpen = HasSocket();
 
     _cursor = _cursor_writer->GetCursor();
-     if (!_config->HasKey("output_socket")) {
-           checkOpen = false;
-    }
 
 
     while(!IsStopping()) {
@@ -34,8 +34,20 @@
  *
  ****************************************************************************/
 
+/*
+ * Tracks the un-acked events, in send order, in a ring of max_size entries.
+ *
+ * An ack releases the acked event and all the events sent before it, and returns the cursor of the newest
+ * one released. Acks are matched starting from the oldest event, so they are O(1) when they arrive in send order.
+ *
+ * If the first ack received after Reset() is CUMULATIVE_ACK_ID, the receiver is acking "everything up to X":
+ * an ack of X releases, in send order, the events up to and including X, stopping at the first event newer than X.
+ * X itself need not be present, so stale or duplicate acks are rejected without searching the queue.
+ */
 class AckQueue {
 public:
+    static const EventId CUMULATIVE_ACK_ID;
+
     AckQueue(size_t max_size);
 
     size_t MaxSize() {
@@ -62,15 +74,32 @@ public:
 
     bool Ack(const EventId& event_id, QueueCursor& cursor);
 
+    // Return true if Add() would have to wait for an ack to make room
+    bool IsFull();
+
 private:
+    struct Entry {
+        EventId event_id;
+        QueueCursor cursor;
+        bool removed;
+    };
+
+    inline Entry& entry(uint64_t seq) {
+        return _ring[seq % _ring.size()];
+    }
+
     std::mutex _mutex;
     std::condition_variable _cond;
-    std::unordered_map<EventId, uint64_t> _event_ids;
-    std::map<uint64_t, std::pair<EventId,QueueCursor>> _cursors;
+    std::vector<Entry> _ring;
+    // The seq of the oldest entry, and of the next entry to be added
+    uint64_t _tail;
+    uint64_t _head;
     size_t _max_size;
     bool _closed;
+    bool _cumulative;
+    bool _have_acks;
     bool _have_auto_cursor;
-    uint64_t _next_seq;
+    // The seq of the first entry added after the auto cursor was set
     uint64_t _auto_cursor_seq;
     QueueCursor _auto_cursor;
 };
@@ -175,9 +204,13 @@ public:
     static constexpr int MAX_SLEEP_PERIOD = 60;
     static constexpr int DEFAULT_ACK_QUEUE_SIZE = 1000;
     static constexpr long MIN_ACK_TIMEOUT = 100;
+    static constexpr uint64_t DEFAULT_BATCH_MAX_BYTES = 64*1024;
+    static constexpr long DEFAULT_BATCH_MAX_LATENCY = 100;
+    static constexpr const char* DEFAULT_SYSLOG_SOCKET = "/dev/log";
 
     Output(const std::string& name, const std::string& cursor_path, const std::shared_ptr<Queue>& queue, const std::shared_ptr<IEventWriterFactory>& writer_factory, const std::shared_ptr<IEventFilterFactory>& filter_factory):
-            _name(name), _cursor_path(cursor_path), _queue(queue), _writer_factory(writer_factory), _filter_factory(filter_factory), _ack_mode(false), _ack_timeout(10000)
+            _name(name), _cursor_path(cursor_path), _queue(queue), _writer_factory(writer_factory), _filter_factory(filter_factory), _ack_mode(false), _ack_timeout(10000),
+            _batch_max_bytes(DEFAULT_BATCH_MAX_BYTES), _batch_max_latency(DEFAULT_BATCH_MAX_LATENCY)
     {
         _cursor_writer = std::make_shared<CursorWriter>(name, cursor_path);
         _ack_reader = std::unique_ptr<AckReader>(new AckReader(name));
@@ -191,8 +224,14 @@ public:
     // Delete any resources associated with the output
     void Delete();
 
+    // Return true if the output writes to a socket
+    bool HasSocket() const {
+        return !_socket_path.empty();
+    }
+
 protected:
     friend class AckReader;
+    friend class OutputEventLoop;
 
     virtual void on_stopping();
     virtual void on_stop();
@@ -213,6 +252,8 @@ protected:
     std::shared_ptr<IEventFilterFactory> _filter_factory;
     bool _ack_mode;
     long _ack_timeout;
+    uint64_t _batch_max_bytes;
+    long _batch_max_latency;
     std::unique_ptr<Config> _config;
     QueueCursor _cursor;
     std::shared_ptr<IEventWriter> _event_writer;
@@ -0,0 +1,668 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "OutputEventLoop.h"
+#include "BatchWriter.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+}
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+
+namespace {
+
+/*
+ * Holds the ack bytes read from a non-blocking socket so that IEventWriter::ReadAck can parse them.
+ * ReadAll returns TIMEOUT, without consuming anything, if not enough data is available yet.
+ * An ack may be parsed with several ReadAll calls, so the caller saves the offset with Mark() before each
+ * ReadAck and restores it with Rewind() if the ack is incomplete.
+ */
+class AckBuffer: public IReader {
+public:
+    static constexpr size_t READ_SIZE = 4096;
+
+    AckBuffer(): _offset(0) {}
+
+    void Clear() {
+        _data.clear();
+        _offset = 0;
+    }
+
+    size_t Mark() const {
+        return _offset;
+    }
+
+    void Rewind(size_t mark) {
+        _offset = mark;
+    }
+
+    // Read whatever is available from io
+    ssize_t Fill(IOBase& io) {
+        if (_offset > 0) {
+            _data.erase(_data.begin(), _data.begin() + _offset);
+            _offset = 0;
+        }
+        auto size = _data.size();
+        _data.resize(size + READ_SIZE);
+        auto ret = io.Read(_data.data() + size, READ_SIZE, nullptr);
+        _data.resize(size + (ret > 0 ? ret : 0));
+        return ret;
+    }
+
+    ssize_t WaitReadable(long timeout) override {
+        return available() > 0 ? OK : TIMEOUT;
+    }
+
+    ssize_t Read(void *buf, size_t buf_size, const std::function<bool()>& fn) override {
+        if (available() == 0) {
+            return TIMEOUT;
+        }
+        auto n = std::min(buf_size, available());
+        memcpy(buf, _data.data() + _offset, n);
+        _offset += n;
+        return n;
+    }
+
+    ssize_t Read(void *buf, size_t buf_size, long timeout, const std::function<bool()>& fn) override {
+        return Read(buf, buf_size, fn);
+    }
+
+    ssize_t ReadAll(void *buf, size_t buf_size, const std::function<bool()>& fn) override {
+        if (available() < buf_size) {
+            return TIMEOUT;
+        }
+        memcpy(buf, _data.data() + _offset, buf_size);
+        _offset += buf_size;
+        return OK;
+    }
+
+    ssize_t DiscardAll(size_t size, const std::function<bool()>& fn) override {
+        if (available() < size) {
+            return TIMEOUT;
+        }
+        _offset += size;
+        return OK;
+    }
+
+private:
+    size_t available() const {
+        return _data.size() - _offset;
+    }
+
+    std::vector<uint8_t> _data;
+    size_t _offset;
+};
+
+long millis_until(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point when) {
+    if (when <= now) {
+        return 0;
+    }
+    // Round up so that the loop doesn't wake up just before the deadline
+    return std::chrono::duration_cast<std::chrono::milliseconds>(when - now).count() + 1;
+}
+
+}
+
+struct OutputEventLoop::OutputState {
+    explicit OutputState(std::shared_ptr<Output> o): output(std::move(o)), connected(false), want_write(false),
+        ack_blocked(false), sleep_period(Output::START_SLEEP_PERIOD), have_pending_cursor(false), cursor_dirty(false) {}
+
+    std::shared_ptr<Output> output;
+    std::unique_ptr<BatchWriter> batch;
+    AckBuffer acks;
+    bool connected;
+    bool want_write;
+    bool ack_blocked;
+    time_point ack_blocked_since;
+    time_point next_connect;
+    int sleep_period;
+    // In non-ack mode, the cursor of the last event in the batch. It is saved once the batch is written.
+    bool have_pending_cursor;
+    QueueCursor pending_cursor;
+    bool cursor_dirty;
+    time_point last_cursor_save;
+};
+
+/****************************************************************************
+ *
+ ****************************************************************************/
+
+OutputEventLoop::OutputEventLoop(const std::string& name, std::shared_ptr<Queue> queue):
+    _name(name), _queue(std::move(queue)), _epoll_fd(-1), _wake_fd(-1), _queue_fd(-1), _data(Queue::MAX_ITEM_SIZE),
+    _running(false), _remove_seq(0), _removed_seq(0)
+{}
+
+OutputEventLoop::~OutputEventLoop() {
+    if (_queue_fd >= 0) {
+        _queue->RemoveNotifyFd(_queue_fd);
+        close(_queue_fd);
+    }
+    if (_wake_fd >= 0) {
+        close(_wake_fd);
+    }
+    if (_epoll_fd >= 0) {
+        close(_epoll_fd);
+    }
+}
+
+bool OutputEventLoop::Initialize() {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_fd < 0) {
+        Logger::Error("OutputEventLoop(%s): epoll_create1() failed: %s", _name.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    _wake_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    _queue_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (_wake_fd < 0 || _queue_fd < 0) {
+        Logger::Error("OutputEventLoop(%s): eventfd() failed: %s", _name.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    for (int* fd : {&_wake_fd, &_queue_fd}) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, *fd, &ev) != 0) {
+            Logger::Error("OutputEventLoop(%s): epoll_ctl() failed: %s", _name.c_str(), std::strerror(errno));
+            return false;
+        }
+    }
+
+    _queue->AddNotifyFd(_queue_fd);
+    return true;
+}
+
+void OutputEventLoop::AddOutput(const std::shared_ptr<Output>& output) {
+    std::lock_guard<std::mutex> lock(_run_mutex);
+    _to_add.emplace_back(output);
+    wake();
+}
+
+void OutputEventLoop::RemoveOutput(const std::shared_ptr<Output>& output) {
+    std::unique_lock<std::mutex> lock(_run_mutex);
+    auto itr = std::find(_to_add.begin(), _to_add.end(), output);
+    if (itr != _to_add.end()) {
+        _to_add.erase(itr);
+    }
+    if (!_running) {
+        return;
+    }
+    _to_remove.emplace_back(output);
+    auto seq = ++_remove_seq;
+    wake();
+    _run_cond.wait(lock, [this,seq]() { return !_running || _removed_seq >= seq; });
+}
+
+void OutputEventLoop::on_stopping() {
+    wake();
+}
+
+void OutputEventLoop::wake() {
+    uint64_t val = 1;
+    auto ret = ::write(_wake_fd, &val, sizeof(val));
+    (void)ret;
+}
+
+void OutputEventLoop::run() {
+    Logger::Info("OutputEventLoop(%s): Started", _name.c_str());
+
+    {
+        std::lock_guard<std::mutex> lock(_run_mutex);
+        _running = true;
+    }
+
+    std::array<struct epoll_event, 64> events;
+
+    while (!IsStopping()) {
+        apply_changes();
+
+        // Arm before servicing the outputs so that items added after the last Get() will wake the loop.
+        _queue->ArmNotify(_queue_fd);
+
+        long timeout = MAX_WAIT;
+        for (auto& ent : _states) {
+            timeout = std::min(timeout, service(*ent.second));
+        }
+
+        auto n = epoll_wait(_epoll_fd, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Logger::Error("OutputEventLoop(%s): epoll_wait() failed: %s", _name.c_str(), std::strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            auto ptr = events[i].data.ptr;
+            if (ptr == &_wake_fd || ptr == &_queue_fd) {
+                uint64_t val;
+                auto ret = ::read(*reinterpret_cast<int*>(ptr), &val, sizeof(val));
+                (void)ret;
+            } else {
+                handle_io(*reinterpret_cast<OutputState*>(ptr), events[i].events);
+            }
+        }
+    }
+
+    std::vector<Output*> outputs;
+    for (auto& ent : _states) {
+        outputs.emplace_back(ent.first);
+    }
+    for (auto output : outputs) {
+        remove_state(output);
+    }
+
+    std::lock_guard<std::mutex> lock(_run_mutex);
+    _running = false;
+    _to_add.clear();
+    _to_remove.clear();
+    _run_cond.notify_all();
+
+    Logger::Info("OutputEventLoop(%s): Stopped", _name.c_str());
+}
+
+void OutputEventLoop::apply_changes() {
+    std::vector<std::shared_ptr<Output>> to_add;
+    std::vector<std::shared_ptr<Output>> to_remove;
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(_run_mutex);
+        if (_to_add.empty() && _to_remove.empty()) {
+            return;
+        }
+        to_add.swap(_to_add);
+        to_remove.swap(_to_remove);
+        seq = _remove_seq;
+    }
+
+    for (auto& output : to_remove) {
+        remove_state(output.get());
+    }
+
+    for (auto& output : to_add) {
+        add_state(output);
+    }
+
+    std::lock_guard<std::mutex> lock(_run_mutex);
+    _removed_seq = seq;
+    _run_cond.notify_all();
+}
+
+bool OutputEventLoop::add_state(const std::shared_ptr<Output>& output) {
+    Logger::Info("Output(%s): Started", output->_name.c_str());
+
+    if (!output->_cursor_writer->Read()) {
+        Logger::Error("Output(%s): Aborting because cursor file is unreadable", output->_name.c_str());
+        return false;
+    }
+
+    std::unique_ptr<OutputState> state(new OutputState(output));
+    // The loop decides when to write, so the BatchWriter must never flush on its own.
+    state->batch = std::unique_ptr<BatchWriter>(new BatchWriter(output->_writer, std::numeric_limits<size_t>::max()));
+    state->next_connect = std::chrono::steady_clock::now();
+    state->last_cursor_save = state->next_connect;
+
+    _states[output.get()] = std::move(state);
+    return true;
+}
+
+void OutputEventLoop::remove_state(Output* output) {
+    auto itr = _states.find(output);
+    if (itr == _states.end()) {
+        return;
+    }
+    auto& state = *itr->second;
+
+    Logger::Info("Output(%s): Stopping", output->_name.c_str());
+
+    disconnect(state);
+    if (state.cursor_dirty) {
+        output->_cursor_writer->Write();
+    }
+    _states.erase(itr);
+}
+
+long OutputEventLoop::service(OutputState& state) {
+    auto& output = *state.output;
+    auto now = std::chrono::steady_clock::now();
+
+    if (!state.connected) {
+        if (now < state.next_connect) {
+            return millis_until(now, state.next_connect);
+        }
+        if (!connect(state)) {
+            return millis_until(now, state.next_connect);
+        }
+    }
+
+    long timeout = MAX_WAIT;
+
+    if (state.ack_blocked && output._ack_timeout > 0) {
+        auto deadline = state.ack_blocked_since + std::chrono::milliseconds(output._ack_timeout);
+        if (now >= deadline) {
+            Logger::Error("Output(%s): Timeout waiting for Acks", output._name.c_str());
+            disconnect(state);
+            return 0;
+        }
+        timeout = std::min(timeout, millis_until(now, deadline));
+    }
+
+    bool idle = true;
+    if (!state.want_write) {
+        if (!fill(state, idle)) {
+            return 0;
+        }
+        // Events packed by the event writer are moved to the batch at the end of each pass
+        if (output._event_writer->HasPending() && output._event_writer->Flush(state.batch.get()) != IWriter::OK) {
+            disconnect(state);
+            return 0;
+        }
+    }
+
+    if (state.connected && state.batch->Pending() > 0 && !state.want_write) {
+        now = std::chrono::steady_clock::now();
+        auto deadline = state.batch->PendingSince() + std::chrono::milliseconds(output._batch_max_latency);
+        if (idle || state.ack_blocked || state.batch->Pending() >= output._batch_max_bytes || now >= deadline) {
+            if (!write(state)) {
+                return 0;
+            }
+        } else {
+            timeout = std::min(timeout, millis_until(now, deadline));
+        }
+    }
+
+    if (state.connected && !idle && !state.ack_blocked && !state.want_write) {
+        // There is more data waiting in the queue
+        timeout = 0;
+    }
+
+    if (state.cursor_dirty) {
+        auto deadline = state.last_cursor_save + std::chrono::milliseconds(CURSOR_SAVE_INTERVAL);
+        if (now >= deadline) {
+            output._cursor_writer->Write();
+            state.cursor_dirty = false;
+            state.last_cursor_save = now;
+        } else {
+            timeout = std::min(timeout, millis_until(now, deadline));
+        }
+    }
+
+    return timeout;
+}
+
+void OutputEventLoop::handle_io(OutputState& state, uint32_t events) {
+    if (!state.connected) {
+        return;
+    }
+
+    if ((events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) != 0) {
+        if (!read_acks(state)) {
+            disconnect(state);
+            return;
+        }
+    }
+
+    if ((events & EPOLLOUT) != 0 && state.want_write) {
+        write(state);
+    }
+}
+
+bool OutputEventLoop::connect(OutputState& state) {
+    auto& output = *state.output;
+
+    Logger::Info("Output(%s): Connecting to %s", output._name.c_str(), output._socket_path.c_str());
+    if (!output._writer->Open()) {
+        Logger::Warn("Output(%s): Failed to connect to '%s': %s", output._name.c_str(), output._socket_path.c_str(), std::strerror(errno));
+        Logger::Info("Output(%s): Sleeping %d seconds before re-trying connection", output._name.c_str(), state.sleep_period);
+        state.next_connect = std::chrono::steady_clock::now() + std::chrono::seconds(state.sleep_period);
+        state.sleep_period = std::min(state.sleep_period * 2, Output::MAX_SLEEP_PERIOD);
+        return false;
+    }
+
+    output._writer->SetNonBlock(true);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN|EPOLLRDHUP;
+    ev.data.ptr = &state;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, output._writer->GetFd(), &ev) != 0) {
+        Logger::Error("Output(%s): epoll_ctl() failed: %s", output._name.c_str(), std::strerror(errno));
+        output._writer->Close();
+        state.next_connect = std::chrono::steady_clock::now() + std::chrono::seconds(state.sleep_period);
+        return false;
+    }
+
+    Logger::Info("Output(%s): Connected", output._name.c_str());
+
+    state.connected = true;
+    state.want_write = false;
+    state.ack_blocked = false;
+    state.have_pending_cursor = false;
+    state.sleep_period = Output::START_SLEEP_PERIOD;
+    state.batch->Clear();
+    state.acks.Clear();
+    output._event_writer->Discard();
+
+    // Resume from the last saved cursor, un-acked or unsent events will be re-transmitted.
+    output._cursor = output._cursor_writer->GetCursor();
+    if (output._cursor.IsHead()) {
+        output._cursor = _queue->HeadCursor();
+    }
+    if (output._ack_mode) {
+        output._ack_queue->Reset();
+    }
+
+    return true;
+}
+
+void OutputEventLoop::disconnect(OutputState& state) {
+    if (!state.connected) {
+        return;
+    }
+    auto& output = *state.output;
+
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, output._writer->GetFd(), nullptr);
+    output._writer->Close();
+
+    state.connected = false;
+    state.want_write = false;
+    state.ack_blocked = false;
+    state.have_pending_cursor = false;
+    state.batch->Clear();
+    state.acks.Clear();
+    output._event_writer->Discard();
+    state.next_connect = std::chrono::steady_clock::now();
+
+    if (output._ack_mode) {
+        QueueCursor cursor;
+        if (output._ack_queue->GetAutoCursor(cursor)) {
+            // There was still a pending auto cursor, so update the _cursor_writer
+            output._cursor_writer->UpdateCursor(cursor);
+            state.cursor_dirty = true;
+        }
+    }
+
+    if (!IsStopping()) {
+        Logger::Info("Output(%s): Connection lost", output._name.c_str());
+    }
+}
+
+// Return false if the output was disconnected
+bool OutputEventLoop::fill(OutputState& state, bool& idle) {
+    auto& output = *state.output;
+
+    idle = false;
+    for (int i = 0; i < MAX_EVENTS_PER_PASS && !state.ack_blocked && state.batch->Pending() < std::max<uint64_t>(output._batch_max_bytes, 1); ++i) {
+        QueueCursor cursor;
+        size_t size = _data.size();
+
+        auto ret = _queue->Get(output._cursor, _data.data(), &size, &cursor, 0);
+        if (ret == Queue::TIMEOUT || ret == Queue::INTERRUPTED || ret == Queue::CLOSED) {
+            idle = true;
+            return true;
+        }
+
+        if (ret == Queue::BUFFER_TOO_SMALL || Event::GetVersionAndSize(_data.data()).second != size) {
+            Logger::Error("Output(%s): Encountered possible corruption in queue, resetting queue", output._name.c_str());
+            _queue->Reset();
+            disconnect(state);
+            return false;
+        }
+
+        Event event(_data.data(), size);
+        bool filtered = output._event_filter && output._event_filter->IsEventFiltered(event);
+        if (!filtered) {
+            EventId event_id(event.Seconds(), event.Milliseconds(), event.Serial());
+            if (output._ack_mode) {
+                // Avoid racing with receiver, add ack before sending event.
+                // If the ack queue is full, stop here, the same event will be fetched again once acks arrive.
+                if (!output._ack_queue->Add(event_id, cursor, 0)) {
+                    state.ack_blocked = true;
+                    state.ack_blocked_since = std::chrono::steady_clock::now();
+                    return true;
+                }
+            }
+
+            auto wret = output._event_writer->WriteEvent(event, state.batch.get());
+            if (wret == IEventWriter::NOOP) {
+                if (output._ack_mode) {
+                    // The event was not sent, so remove it's ack
+                    output._ack_queue->Remove(event_id);
+                    // And update the auto cursor
+                    output._ack_queue->SetAutoCursor(cursor);
+                }
+            } else if (wret != IWriter::OK) {
+                disconnect(state);
+                return false;
+            }
+            output._cursor = cursor;
+
+            if (!output._ack_mode) {
+                update_cursor(state, cursor);
+            }
+        } else {
+            output._cursor = cursor;
+            if (output._ack_mode) {
+                output._ack_queue->SetAutoCursor(cursor);
+            } else {
+                update_cursor(state, cursor);
+            }
+        }
+    }
+
+    return true;
+}
+
+// Return false if the output was disconnected
+bool OutputEventLoop::write(OutputState& state) {
+    auto ret = state.batch->WriteSome();
+    if (ret == IO::TIMEOUT) {
+        set_want_write(state, true);
+        return true;
+    } else if (ret != IO::OK) {
+        disconnect(state);
+        return false;
+    }
+
+    set_want_write(state, false);
+    if (state.have_pending_cursor) {
+        state.output->_cursor_writer->UpdateCursor(state.pending_cursor);
+        state.have_pending_cursor = false;
+        state.cursor_dirty = true;
+    }
+    return true;
+}
+
+// Return false if the connection was lost or an invalid ack was received
+bool OutputEventLoop::read_acks(OutputState& state) {
+    auto& output = *state.output;
+
+    while (true) {
+        auto ret = state.acks.Fill(*output._writer);
+        if (ret == IO::TIMEOUT) {
+            return true;
+        } else if (ret <= 0) {
+            return false;
+        }
+
+        if (!output._ack_mode) {
+            // Nothing is expected from the receiver
+            state.acks.Clear();
+            continue;
+        }
+
+        EventId id;
+        QueueCursor cursor;
+        auto mark = state.acks.Mark();
+        while ((ret = output._event_writer->ReadAck(id, &state.acks)) == IO::OK) {
+            if (output._ack_queue->Ack(id, cursor)) {
+                output._cursor_writer->UpdateCursor(cursor);
+                state.cursor_dirty = true;
+            }
+            mark = state.acks.Mark();
+        }
+        // Stale or duplicate acks release nothing, only unblock (and restart the ack timeout) once there is room
+        if (state.ack_blocked && !output._ack_queue->IsFull()) {
+            state.ack_blocked = false;
+        }
+        if (ret != IO::TIMEOUT) {
+            return false;
+        }
+        // Partial ack, it will be re-parsed from the start once the rest arrives
+        state.acks.Rewind(mark);
+    }
+}
+
+void OutputEventLoop::update_cursor(OutputState& state, const QueueCursor& cursor) {
+    if (state.batch->Pending() > 0 || state.output->_event_writer->HasPending()) {
+        state.pending_cursor = cursor;
+        state.have_pending_cursor = true;
+    } else {
+        state.output->_cursor_writer->UpdateCursor(cursor);
+        state.cursor_dirty = true;
+    }
+}
+
+void OutputEventLoop::set_want_write(OutputState& state, bool want_write) {
+    if (state.want_write == want_write) {
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN|EPOLLRDHUP;
+    if (want_write) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.ptr = &state;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, state.output->_writer->GetFd(), &ev);
+    state.want_write = want_write;
+}
@@ -0,0 +1,99 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef AUOMS_OUTPUTEVENTLOOP_H
+#define AUOMS_OUTPUTEVENTLOOP_H
+
+#include "RunBase.h"
+#include "Output.h"
+#include "Queue.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Drives any number of socket Outputs from a single thread.
+ *
+ * The output sockets are non-blocking and multiplexed with epoll. Events are pulled from the queue,
+ * serialized into a per-output BatchWriter, and written whenever the socket is writable. Acks are read
+ * as they arrive. The Output's own threads (Output, AckReader and CursorWriter) are not started.
+ */
+class OutputEventLoop: public RunBase {
+public:
+    static constexpr int MAX_EVENTS_PER_PASS = 256;
+    static constexpr long CURSOR_SAVE_INTERVAL = 100;
+    static constexpr long MAX_WAIT = 1000;
+
+    OutputEventLoop(const std::string& name, std::shared_ptr<Queue> queue);
+    ~OutputEventLoop() override;
+
+    // Return false if the epoll or eventfd fds could not be created
+    bool Initialize();
+
+    // The output must be loaded (Output::Load) but not started
+    void AddOutput(const std::shared_ptr<Output>& output);
+
+    // Does not return until the loop has released the output
+    void RemoveOutput(const std::shared_ptr<Output>& output);
+
+protected:
+    void on_stopping() override;
+    void run() override;
+
+private:
+    struct OutputState;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    void wake();
+    void apply_changes();
+    bool add_state(const std::shared_ptr<Output>& output);
+    void remove_state(Output* output);
+
+    // Return the number of milliseconds until the output next needs attention
+    long service(OutputState& state);
+    void handle_io(OutputState& state, uint32_t events);
+
+    bool connect(OutputState& state);
+    void disconnect(OutputState& state);
+    bool fill(OutputState& state, bool& idle);
+    bool write(OutputState& state);
+    bool read_acks(OutputState& state);
+    void update_cursor(OutputState& state, const QueueCursor& cursor);
+    void set_want_write(OutputState& state, bool want_write);
+
+    std::string _name;
+    std::shared_ptr<Queue> _queue;
+    int _epoll_fd;
+    int _wake_fd;
+    int _queue_fd;
+    std::vector<uint8_t> _data;
+
+    // Protected by _run_mutex
+    bool _running;
+    uint64_t _remove_seq;
+    uint64_t _removed_seq;
+    std::vector<std::shared_ptr<Output>> _to_add;
+    std::vector<std::shared_ptr<Output>> _to_remove;
+
+    // Only accessed by the loop thread
+    std::unordered_map<Output*, std::unique_ptr<OutputState>> _states;
+};
+
+#endif //AUOMS_OUTPUTEVENTLOOP_H
@@ -16,6 +16,7 @@
 
 
 #include "Output.h"
+#include "OutputEventLoop.h"
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE "OutputInputTests"
@@ -528,3 +529,303 @@ BOOST_AUTO_TEST_CASE( dropped_conn_test ) {
         BOOST_REQUIRE_EQUAL(i, event_seq);
     }
 }
+
+BOOST_AUTO_TEST_CASE( event_loop_test ) {
+    TempDir dir("/tmp/OutputInputTests");
+
+    std::string cursor_path = dir.Path() + "/input.cursor";
+    std::string queue_path = dir.Path() + "/input.queue";
+    std::string socket_path = dir.Path() + "/input.socket";
+
+    std::mutex log_mutex;
+    std::vector<std::string> log_lines;
+    Logger::SetLogFunction([&log_mutex,&log_lines](const char* ptr, size_t size){
+        std::lock_guard<std::mutex> lock(log_mutex);
+        log_lines.emplace_back(ptr, size);
+    });
+
+    Signals::Init();
+    Signals::Start();
+
+    auto queue = std::make_shared<Queue>(queue_path, 1024*1024);
+    queue->Open();
+
+    auto event_queue = std::make_shared<EventQueue>(queue);
+    auto builder = std::make_shared<EventBuilder>(event_queue);
+
+    auto output_config = std::make_unique<Config>(std::unordered_map<std::string, std::string>({
+        {"output_format","raw"},
+        {"output_socket", socket_path},
+        {"enable_ack_mode", "true"},
+        {"ack_queue_size", "10"},
+        {"ack_timeout", "1000"}
+    }));
+    auto writer_factory = std::shared_ptr<IEventWriterFactory>(static_cast<IEventWriterFactory*>(new RawOnlyEventWriterFactory()));
+    auto output = std::make_shared<Output>("output", cursor_path, queue, writer_factory, nullptr);
+    output->Load(output_config);
+
+    OutputEventLoop loop("test", queue);
+    if (!loop.Initialize()) {
+        BOOST_FAIL("Failed to initialize event loop");
+    }
+
+    auto operational_status = std::make_shared<OperationalStatus>("", nullptr);
+
+    Inputs inputs(socket_path, operational_status);
+    if (!inputs.Initialize()) {
+        BOOST_FAIL("Failed to initialize inputs");
+    }
+
+    Gate done_gate;
+    std::vector<std::string> _outputs;
+
+    constexpr int num_events = 100;
+
+    std::thread input_thread([&]() {
+        Signals::InitThread();
+        int num_received = 0;
+        while (num_received < num_events) {
+            if (!inputs.HandleData([&num_received,&_outputs](void* ptr, size_t size) {
+                _outputs.emplace_back(reinterpret_cast<char*>(ptr), size);
+                num_received += 1;
+            })) {
+                break;
+            };
+        }
+        done_gate.Open();
+    });
+
+    inputs.Start();
+    loop.Start();
+    loop.AddOutput(output);
+
+    // Wait for output to connect
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (int i = 0; i < num_events; i++) {
+        if (!BuildEvent(builder, 1, 1, i, i)) {
+            BOOST_FAIL("Failed to build event");
+        }
+    }
+
+    if (!done_gate.Wait(Gate::OPEN, 1000)) {
+        BOOST_FAIL("Time out waiting for inputs");
+    }
+
+    loop.RemoveOutput(output);
+    loop.Stop();
+    inputs.Stop();
+    queue->Close();
+    input_thread.join();
+
+    for (auto& msg : log_lines) {
+        if (starts_with(msg, "Output(output): Timeout waiting for Acks")) {
+            BOOST_FAIL("Found 'Timeout waiting for Acks' in log output");
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(num_events, _outputs.size());
+
+    for (int i = 0; i < num_events; i++) {
+        Event event(_outputs[i].data(), _outputs[i].size());
+        BOOST_REQUIRE_EQUAL(i, event.Serial());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( event_loop_stale_ack_test ) {
+    TempDir dir("/tmp/OutputInputTests");
+
+    std::string cursor_path = dir.Path() + "/input.cursor";
+    std::string queue_path = dir.Path() + "/input.queue";
+    std::string socket_path = dir.Path() + "/input.socket";
+
+    std::mutex log_mutex;
+    std::vector<std::string> log_lines;
+    Logger::SetLogFunction([&log_mutex,&log_lines](const char* ptr, size_t size){
+        std::lock_guard<std::mutex> lock(log_mutex);
+        log_lines.emplace_back(ptr, size);
+    });
+
+    auto have_ack_timeout = [&log_mutex,&log_lines]() {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        for (auto& msg : log_lines) {
+            if (starts_with(msg, "Output(output): Timeout waiting for Acks")) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    Signals::Init();
+    Signals::Start();
+
+    auto queue = std::make_shared<Queue>(queue_path, 1024*1024);
+    queue->Open();
+
+    auto event_queue = std::make_shared<EventQueue>(queue);
+    auto builder = std::make_shared<EventBuilder>(event_queue);
+
+    auto output_config = std::make_unique<Config>(std::unordered_map<std::string, std::string>({
+        {"output_format","raw"},
+        {"output_socket", socket_path},
+        {"enable_ack_mode", "true"},
+        {"ack_queue_size", "10"},
+        {"ack_timeout", "200"}
+    }));
+    auto writer_factory = std::shared_ptr<IEventWriterFactory>(static_cast<IEventWriterFactory*>(new RawOnlyEventWriterFactory()));
+    auto output = std::make_shared<Output>("output", cursor_path, queue, writer_factory, nullptr);
+    output->Load(output_config);
+
+    OutputEventLoop loop("test", queue);
+    if (!loop.Initialize()) {
+        BOOST_FAIL("Failed to initialize event loop");
+    }
+
+    Gate done_gate;
+    bool timed_out = false;
+
+    done_gate.Open();
+
+    std::thread input_thread([&]() {
+        Signals::InitThread();
+
+        UnixDomainListener udl(socket_path);
+        if (!udl.Open()) {
+            return;
+        }
+
+        done_gate.Close();
+
+        auto fd = udl.Accept();
+        IOBase io(fd);
+        std::array<uint8_t, 1024> data;
+        std::vector<uint8_t> first;
+        RawEventReader reader;
+
+        // Read until the ack queue is full
+        for (int i = 0; i < 10; i++) {
+            auto ret = reader.ReadEvent(data.data(), data.size(), &io, nullptr);
+            if (ret <= 0) {
+                break;
+            }
+            if (first.empty()) {
+                first.assign(data.data(), data.data()+ret);
+            }
+        }
+
+        // Keep acking the first event. Only the first ack releases anything, the rest must not hold off the ack timeout.
+        if (!first.empty()) {
+            Event event(first.data(), first.size());
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < std::chrono::seconds(3)) {
+                reader.WriteAck(event, &io);
+                if (have_ack_timeout()) {
+                    timed_out = true;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+        io.Close();
+        done_gate.Open();
+    });
+
+    if (!done_gate.Wait(Gate::CLOSED, 10000)) {
+        BOOST_FAIL("Time out waiting input thread to be ready");
+    }
+
+    loop.Start();
+    loop.AddOutput(output);
+
+    // Wait for output to connect
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (int i = 0; i < 100; i++) {
+        if (!BuildEvent(builder, 1, 1, i, i)) {
+            BOOST_FAIL("Failed to build event");
+        }
+    }
+
+    if (!done_gate.Wait(Gate::OPEN, 10000)) {
+        BOOST_FAIL("Time out waiting for input thread");
+    }
+
+    loop.RemoveOutput(output);
+    loop.Stop();
+    queue->Close();
+    input_thread.join();
+
+    BOOST_REQUIRE(timed_out);
+}
+
+BOOST_AUTO_TEST_CASE( ack_queue_test ) {
+    AckQueue queue(4);
+    QueueCursor cursor;
+
+    for (uint64_t i = 1; i <= 4; i++) {
+        BOOST_REQUIRE(queue.Add(EventId(100, 0, i), QueueCursor(1, i), 0));
+    }
+    // Full
+    BOOST_REQUIRE(queue.IsFull());
+    BOOST_REQUIRE(!queue.Add(EventId(100, 0, 5), QueueCursor(1, 5), 0));
+
+    // Unknown ids are ignored
+    BOOST_REQUIRE(!queue.Ack(EventId(100, 0, 10), cursor));
+
+    // An ack releases all the events sent before the acked event
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 2), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 2));
+    BOOST_REQUIRE(!queue.IsFull());
+    BOOST_REQUIRE(!queue.Ack(EventId(100, 0, 1), cursor));
+
+    // A removed event is never returned
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 5), QueueCursor(1, 5), 0));
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 6), QueueCursor(1, 6), 0));
+    queue.Remove(EventId(100, 0, 4));
+    BOOST_REQUIRE(!queue.Ack(EventId(100, 0, 4), cursor));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 5), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 5));
+
+    // The auto cursor is returned once all the events sent before it are acked
+    queue.SetAutoCursor(QueueCursor(1, 7));
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 8), QueueCursor(1, 8), 0));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 6), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 7));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 8), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 8));
+    BOOST_REQUIRE(queue.Wait(0));
+}
+
+BOOST_AUTO_TEST_CASE( cumulative_ack_queue_test ) {
+    AckQueue queue(1000);
+    QueueCursor cursor;
+
+    BOOST_REQUIRE(!queue.Ack(AckQueue::CUMULATIVE_ACK_ID, cursor));
+
+    for (uint64_t i = 1; i <= 1000; i++) {
+        BOOST_REQUIRE(queue.Add(EventId(100, 0, i), QueueCursor(1, i), 0));
+    }
+
+    // The acked id doesn't need to be present
+    queue.Remove(EventId(100, 0, 1000));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 1000), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 999));
+    BOOST_REQUIRE(queue.Wait(0));
+
+    // Stop at the first event newer than the acked id
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 1001), QueueCursor(1, 1001), 0));
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 1003), QueueCursor(1, 1003), 0));
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 1002), QueueCursor(1, 1002), 0));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 1002), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 1001));
+    BOOST_REQUIRE(!queue.Ack(EventId(100, 0, 1002), cursor));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 1003), cursor));
+    BOOST_REQUIRE(cursor == QueueCursor(1, 1003));
+    BOOST_REQUIRE(!queue.Wait(0));
+
+    // The mode is reset along with the queue
+    queue.Reset();
+    BOOST_REQUIRE(queue.Add(EventId(100, 0, 1), QueueCursor(1, 1), 0));
+    BOOST_REQUIRE(!queue.Ack(EventId(100, 0, 2), cursor));
+    BOOST_REQUIRE(queue.Ack(EventId(100, 0, 1), cursor));
+}
@@ -25,6 +25,7 @@
 #include "SyslogEventWriter.h"
 #include "EventFilter.h"
 
+#include <algorithm>
 #include <cstring>
 
 extern "C" {
@@ -32,7 +33,72 @@ extern "C" {
 #include <unistd.h>
 }
 
+namespace {
+
+// Return the config values that determine the event writer output, or an empty string if the writer can't be shared
+std::string shared_writer_key(const Config& config) {
+    std::string format = "oms";
+    if (config.HasKey("output_format")) {
+        format = config.GetString("output_format");
+    }
+
+    // In the packed modes, the fluent writer holds events between calls
+    if (format == "fluent" && config.HasKey("fluent_mode") && config.GetString("fluent_mode") != "forward") {
+        return std::string();
+    }
+
+    auto keys = TextEventWriterConfig::ConfigKeys();
+    keys.insert(keys.end(), {"fluent_message_tag", "fluent_mode", "syslog_format"});
+    std::sort(keys.begin(), keys.end());
+
+    std::string key = format;
+    for (auto& k : keys) {
+        if (config.HasKey(k)) {
+            key.append("\n").append(k).append("=").append(config.GetString(k));
+        }
+    }
+    return key;
+}
+
+}
+
 std::shared_ptr<IEventWriter> OutputsEventWriterFactory::CreateEventWriter(const std::string& name, const Config& config) {
+    auto writer = create_event_writer(name, config);
+    if (!writer) {
+        return nullptr;
+    }
+
+    auto key = shared_writer_key(config);
+    if (key.empty()) {
+        return writer;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (auto itr = _caches.begin(); itr != _caches.end();) {
+        if (itr->second.expired()) {
+            itr = _caches.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+
+    auto cache = _caches[key].lock();
+    if (cache) {
+        Logger::Info("Output(%s): Sharing event serialization with other outputs that have the same output format config", name.c_str());
+    } else {
+        auto cache_writer = create_event_writer(name, config);
+        if (!cache_writer) {
+            return nullptr;
+        }
+        cache = std::make_shared<SerializedEventCache>(cache_writer);
+        _caches[key] = cache;
+    }
+
+    return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new SharedEventWriter(cache, writer)));
+}
+
+std::shared_ptr<IEventWriter> OutputsEventWriterFactory::create_event_writer(const std::string& name, const Config& config) {
     TextEventWriterConfig writer_config;
     writer_config.LoadFromConfig(name, config);
 
@@ -43,21 +109,70 @@ std::shared_ptr<IEventWriter> OutputsEventWriterFactory::CreateEventWriter(const
     }
 
     if (format == "oms") {
-        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new OMSEventWriter(writer_config)));
+        auto writer = new OMSEventWriter(writer_config);
+        writer->SetFieldInterpreter(_interpreter);
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(writer));
     } else if (format == "json") {
-        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new JSONEventWriter(writer_config)));
+        auto writer = new JSONEventWriter(writer_config);
+        writer->SetFieldInterpreter(_interpreter);
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(writer));
     } else if (format == "msgpack") {
+        if (_defer_interpretation) {
+            Logger::Warn("Output(%s): output_format 'msgpack' forwards events as is, with defer_interpretation enabled its events will not have interp values", name.c_str());
+        }
         return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new MsgPackEventWriter()));
     } else if (format == "fluent") {
         std::string fluentTag = "LINUX_AUDITD_BLOB";
         if (config.HasKey("fluent_message_tag")) {
             fluentTag = config.GetString("fluent_message_tag");
         }
-        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new FluentEventWriter(writer_config, fluentTag)));
+        FluentMode mode = FluentMode::FORWARD;
+        if (config.HasKey("fluent_mode")) {
+            auto mode_str = config.GetString("fluent_mode");
+            if (!FluentEventWriter::ParseMode(mode_str, mode)) {
+                Logger::Error("Output(%s): Invalid fluent_mode parameter value: '%s'", name.c_str(), mode_str.c_str());
+                return nullptr;
+            }
+        }
+        uint64_t pack_max_bytes = FluentEventWriter::DEFAULT_PACK_MAX_BYTES;
+        if (config.HasKey("fluent_pack_max_bytes")) {
+            try {
+                pack_max_bytes = config.GetUint64("fluent_pack_max_bytes");
+            } catch (std::exception) {
+                Logger::Error("Output(%s): Invalid fluent_pack_max_bytes parameter value", name.c_str());
+                return nullptr;
+            }
+        }
+        // In the packed modes, acks use the forward protocol chunk option
+        bool chunk_ack = false;
+        if (config.HasKey("enable_ack_mode")) {
+            try {
+                chunk_ack = config.GetBool("enable_ack_mode");
+            } catch (std::exception) {
+                Logger::Error("Output(%s): Invalid enable_ack_mode parameter value", name.c_str());
+                return nullptr;
+            }
+        }
+        auto writer = new FluentEventWriter(writer_config, fluentTag, mode, chunk_ack, pack_max_bytes);
+        writer->SetFieldInterpreter(_interpreter);
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(writer));
     } else if (format == "raw") {
+        if (_defer_interpretation) {
+            Logger::Warn("Output(%s): output_format 'raw' forwards events as is, with defer_interpretation enabled its events will not have interp values", name.c_str());
+        }
         return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new RawEventWriter()));
     } else if (format == "syslog") {
-        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new SyslogEventWriter(writer_config)));
+        SyslogFormat syslog_format = SyslogFormat::RFC3164;
+        if (config.HasKey("syslog_format")) {
+            auto format_str = config.GetString("syslog_format");
+            if (!SyslogEventWriter::ParseFormat(format_str, syslog_format)) {
+                Logger::Error("Output(%s): Invalid syslog_format parameter value: '%s'", name.c_str(), format_str.c_str());
+                return nullptr;
+            }
+        }
+        auto writer = new SyslogEventWriter(writer_config, syslog_format);
+        writer->SetFieldInterpreter(_interpreter);
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(writer));
     } else {
         Logger::Error("Output(%s): Invalid output_format parameter value: '%s'", name.c_str(), format.c_str());
         return nullptr;
@@ -78,12 +193,29 @@ void Outputs::Reload(const std::vector<std::string>& allowed_socket_dirs) {
 
 void Outputs::on_stop() {
     for( auto ent: _outputs) {
-        ent.second->Stop();
+        stop_output(ent.first, ent.second);
     }
     _outputs.clear();
+    for (auto& loop : _event_loops) {
+        loop->Stop();
+    }
+    _event_loops.clear();
 }
 
 void Outputs::run() {
+    for (size_t i = 0; i < _num_event_loops; ++i) {
+        auto loop = std::make_shared<OutputEventLoop>(std::to_string(i), _queue);
+        if (!loop->Initialize()) {
+            Logger::Error("Outputs: Failed to initialize event loop, outputs will use their own threads");
+            _event_loops.clear();
+            break;
+        }
+        _event_loops.emplace_back(loop);
+    }
+    for (auto& loop : _event_loops) {
+        loop->Start();
+    }
+
     do_conf_sync();
 
     std::unique_lock<std::mutex> lock(_run_mutex);
@@ -127,30 +259,36 @@ std::unique_ptr<Config> Outputs::read_and_validate_config(const std::string& nam
         format = config->GetString("output_format");
     }
 
-    // Skip the socket check for the syslog event writer. This writes directly to Syslog so no output socket is required
+    auto is_allowed_socket_path = [this](const std::string& socket_path) {
+        for (auto dir: _allowed_socket_dirs) {
+            if (socket_path.length() > dir.length() && socket_path.substr(0, dir.length()) == dir) {
+                return true;
+            }
+        }
+        return false;
+    };
+
     if (format.compare("syslog")) {
         if (!config->HasKey("output_socket")) {
             Logger::Error("Output(%s): Missing required parameter: output_socket", name.c_str());
             return nullptr;
         }
-    
 
         auto socket_path = config->GetString("output_socket");
-        bool socket_path_valid = false;
-        for (auto dir: _allowed_socket_dirs) {
-            if (socket_path.length() > dir.length() && socket_path.substr(0, dir.length()) == dir) {
-                socket_path_valid = true;
-                break;
-            }
-        }
-    
-
-        if (!socket_path_valid) {
+        if (!is_allowed_socket_path(socket_path)) {
             Logger::Error("Output(%s): Invalid output_socket parameter value: '%s'", name.c_str(), socket_path.c_str());
             return nullptr;
         }
+    } else if (config->HasKey("syslog_socket")) {
+        // The syslog event writer sends to the local syslog socket instead of output_socket. Only the default
+        // socket is implicitly allowed, any other must be in one of the allowed dirs like output_socket.
+        auto socket_path = config->GetString("syslog_socket");
+        if (socket_path != Output::DEFAULT_SYSLOG_SOCKET && !is_allowed_socket_path(socket_path)) {
+            Logger::Error("Output(%s): Invalid syslog_socket parameter value: '%s'", name.c_str(), socket_path.c_str());
+            return nullptr;
+        }
     }
-    
+
     if (format != "oms" && format != "json" && format != "msgpack" && format != "raw" && format != "syslog" && format != "fluent") {
         Logger::Error("Output(%s): Invalid output_format parameter value: '%s'", name.c_str(), format.c_str());
         return nullptr;
@@ -220,7 +358,7 @@ void Outputs::do_conf_sync() {
 
     for(auto ent: to_delete) {
         _outputs.erase(ent.first);
-        ent.second->Stop();
+        stop_output(ent.first, ent.second);
         ent.second->Delete();
     }
 
@@ -238,7 +376,7 @@ void Outputs::do_conf_sync() {
         if (it != _outputs.end()) {
             if (it->second->IsConfigDifferent(*config)) {
                 Logger::Error("Output(%s): Config has changed", ent.first.c_str());
-                it->second->Stop();
+                stop_output(ent.first, it->second);
                 load = true;
             }
         } else {
@@ -252,8 +390,32 @@ void Outputs::do_conf_sync() {
             if (!it->second->Load(config)) {
                 Logger::Error("Output(%s): Failed to load config: Not started", ent.first.c_str());
             } else {
-                it->second->Start();
+                start_output(ent.first, it->second);
             }
         }
     }
 }
+
+void Outputs::start_output(const std::string& name, const std::shared_ptr<Output>& output) {
+    // Outputs without a socket have nothing to multiplex, so they always use their own thread
+    if (_event_loops.empty() || !output->HasSocket()) {
+        output->Start();
+        return;
+    }
+
+    auto& loop = _event_loops[_next_event_loop % _event_loops.size()];
+    _next_event_loop++;
+    _output_loops[name] = loop;
+    loop->AddOutput(output);
+}
+
+void Outputs::stop_output(const std::string& name, const std::shared_ptr<Output>& output) {
+    auto itr = _output_loops.find(name);
+    if (itr == _output_loops.end()) {
+        output->Stop();
+        return;
+    }
+
+    itr->second->RemoveOutput(output);
+    _output_loops.erase(itr);
+}
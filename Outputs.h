@@ -19,7 +19,10 @@
 
 #include "RunBase.h"
 #include "Output.h"
+#include "OutputEventLoop.h"
 #include "Queue.h"
+#include "IFieldInterpreter.h"
+#include "SharedEventWriter.h"
 
 #include <string>
 #include <unordered_map>
@@ -28,11 +31,23 @@
 #include <memory>
 #include <vector>
 
+/*
+ * Outputs with identical event writer configs get a SharedEventWriter, so that each event is serialized once
+ * for all of them.
+ */
 class OutputsEventWriterFactory: public IEventWriterFactory {
 public:
-    OutputsEventWriterFactory() {}
+    OutputsEventWriterFactory(std::shared_ptr<IFieldInterpreter> interpreter, bool defer_interpretation): _interpreter(interpreter), _defer_interpretation(defer_interpretation) {}
 
     virtual std::shared_ptr<IEventWriter> CreateEventWriter(const std::string& name, const Config& config) override;
+private:
+    std::shared_ptr<IEventWriter> create_event_writer(const std::string& name, const Config& config);
+
+    std::shared_ptr<IFieldInterpreter> _interpreter;
+    bool _defer_interpretation;
+    std::mutex _mutex;
+    // Keyed by the event writer config
+    std::unordered_map<std::string, std::weak_ptr<SerializedEventCache>> _caches;
 };
 
 class OutputsEventFilterFactory: public IEventFilterFactory {
@@ -50,9 +65,9 @@ private:
 
 class Outputs: public RunBase {
 public:
-    Outputs(std::shared_ptr<Queue>& queue, const std::string& conf_dir, const std::string& cursor_dir, const std::vector<std::string>& allowed_socket_dirs, std::shared_ptr<UserDB>& user_db, std::shared_ptr<FiltersEngine> filtersEngine, std::shared_ptr<ProcessTree> processTree):
-            _queue(queue), _conf_dir(conf_dir), _cursor_dir(cursor_dir), _allowed_socket_dirs(allowed_socket_dirs), _do_reload(false) {
-        _writer_factory = std::shared_ptr<IEventWriterFactory>(static_cast<IEventWriterFactory*>(new OutputsEventWriterFactory()));
+    Outputs(std::shared_ptr<Queue>& queue, const std::string& conf_dir, const std::string& cursor_dir, const std::vector<std::string>& allowed_socket_dirs, std::shared_ptr<UserDB>& user_db, std::shared_ptr<FiltersEngine> filtersEngine, std::shared_ptr<ProcessTree> processTree, std::shared_ptr<IFieldInterpreter> interpreter, bool defer_interpretation, size_t num_event_loops = 0):
+            _queue(queue), _conf_dir(conf_dir), _cursor_dir(cursor_dir), _allowed_socket_dirs(allowed_socket_dirs), _do_reload(false), _num_event_loops(num_event_loops), _next_event_loop(0) {
+        _writer_factory = std::shared_ptr<IEventWriterFactory>(static_cast<IEventWriterFactory*>(new OutputsEventWriterFactory(interpreter, defer_interpretation)));
         _filter_factory = std::shared_ptr<IEventFilterFactory>(static_cast<IEventFilterFactory*>(new OutputsEventFilterFactory(user_db, filtersEngine, processTree)));
     }
 
@@ -65,6 +80,9 @@ protected:
 private:
     void do_conf_sync();
 
+    void start_output(const std::string& name, const std::shared_ptr<Output>& output);
+    void stop_output(const std::string& name, const std::shared_ptr<Output>& output);
+
     std::unique_ptr<Config> read_and_validate_config(const std::string& name, const std::string& path);
 
     std::shared_ptr<Queue> _queue;
@@ -77,6 +95,11 @@ private:
     std::mutex _mutex;
     std::condition_variable _cond;
     std::unordered_map<std::string, std::shared_ptr<Output>> _outputs;
+    // When event loops are enabled, socket outputs are driven by the event loops instead of their own threads
+    size_t _num_event_loops;
+    size_t _next_event_loop;
+    std::vector<std::shared_ptr<OutputEventLoop>> _event_loops;
+    std::unordered_map<std::string, std::shared_ptr<OutputEventLoop>> _output_loops;
 };
 
 
@@ -0,0 +1,247 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PatternMatcher.h"
+
+#include <cstring>
+#include <queue>
+
+namespace {
+
+// If the regex is just a literal string, optionally anchored with ^ and/or $, return the equivalent literal pattern.
+bool regex_to_literal(const std::string& re, PatternType& type, std::string& literal) {
+    size_t start = 0;
+    size_t end = re.size();
+    bool anchored_start = false;
+    bool anchored_end = false;
+
+    if (start < end && re[start] == '^') {
+        anchored_start = true;
+        start++;
+    }
+    if (end > start && re[end-1] == '$') {
+        // An escaped $ is a literal $
+        size_t num_escapes = 0;
+        for (size_t i = end-1; i > start && re[i-1] == '\\'; --i) {
+            num_escapes++;
+        }
+        if (num_escapes % 2 == 0) {
+            anchored_end = true;
+            end--;
+        }
+    }
+
+    literal.clear();
+    for (size_t i = start; i < end; ++i) {
+        char c = re[i];
+        if (c == '\\') {
+            // Escaped letters and digits are character classes, backreferences etc.
+            if (i+1 >= end || isalnum(static_cast<unsigned char>(re[i+1]))) {
+                return false;
+            }
+            literal.push_back(re[i+1]);
+            i++;
+        } else if (strchr(".[]{}()*+?|^$", c) != nullptr) {
+            return false;
+        } else {
+            literal.push_back(c);
+        }
+    }
+
+    if (anchored_start && anchored_end) {
+        type = PatternType::EQUALS;
+    } else if (anchored_start) {
+        type = PatternType::STARTS_WITH;
+    } else if (anchored_end) {
+        type = PatternType::ENDS_WITH;
+    } else {
+        type = PatternType::CONTAINS;
+    }
+    return true;
+}
+
+inline void set_result(PatternType type, size_t start, size_t end, size_t size, int8_t& result) {
+    switch (type) {
+        case PatternType::EQUALS:
+            if (start == 0 && end == size) {
+                result = 1;
+            }
+            break;
+        case PatternType::STARTS_WITH:
+            if (start == 0) {
+                result = 1;
+            }
+            break;
+        case PatternType::ENDS_WITH:
+            if (end == size) {
+                result = 1;
+            }
+            break;
+        default:
+            result = 1;
+            break;
+    }
+}
+
+}
+
+size_t MultiPatternMatcher::Add(PatternType type, const std::string& pattern) {
+    std::string key;
+    key.push_back(static_cast<char>('0' + static_cast<int>(type)));
+    key.append(pattern);
+
+    auto it = _pattern_ids.find(key);
+    if (it != _pattern_ids.end()) {
+        return it->second;
+    }
+
+    size_t id = _patterns.size();
+    std::string literal = pattern;
+    if (type == PatternType::REGEX && !regex_to_literal(pattern, type, literal)) {
+        _patterns.emplace_back(Pattern{PatternType::REGEX, 0, std::regex(pattern, std::regex::optimize)});
+    } else {
+        auto lit = _literal_ids.emplace(literal, _literals.size());
+        if (lit.second) {
+            _literal_strs.emplace_back(literal);
+            _literals.emplace_back(Literal{literal.size(), std::vector<size_t>()});
+        }
+        _literals[lit.first->second].patterns.emplace_back(id);
+        _patterns.emplace_back(Pattern{type, lit.first->second, std::regex()});
+    }
+    _pattern_ids.emplace(key, id);
+
+    return id;
+}
+
+void MultiPatternMatcher::Compile() {
+    _initial_results.assign(_patterns.size(), 0);
+    for (size_t i = 0; i < _patterns.size(); ++i) {
+        if (_patterns[i].type == PatternType::REGEX) {
+            _initial_results[i] = -1;
+        }
+    }
+
+    // Each byte that appears in a literal gets its own class, all other bytes share class 0
+    _byte_class.fill(0);
+    _num_classes = 1;
+    for (auto& lit : _literal_strs) {
+        for (auto c : lit) {
+            auto& bc = _byte_class[static_cast<uint8_t>(c)];
+            if (bc == 0) {
+                bc = static_cast<uint8_t>(_num_classes++);
+            }
+        }
+    }
+
+    // Build the trie
+    _nodes.assign(1, Node{0, -1, -1});
+    _delta.assign(_num_classes, -1);
+    _empty_literal = -1;
+    for (size_t l = 0; l < _literal_strs.size(); ++l) {
+        auto& lit = _literal_strs[l];
+        if (lit.empty()) {
+            _empty_literal = static_cast<int32_t>(l);
+            continue;
+        }
+        int32_t s = 0;
+        for (auto c : lit) {
+            auto& next = _delta[s*_num_classes + _byte_class[static_cast<uint8_t>(c)]];
+            if (next < 0) {
+                next = static_cast<int32_t>(_nodes.size());
+                _nodes.emplace_back(Node{0, -1, -1});
+                _delta.resize(_delta.size() + _num_classes, -1);
+            }
+            s = _delta[s*_num_classes + _byte_class[static_cast<uint8_t>(c)]];
+        }
+        _nodes[s].literal = static_cast<int32_t>(l);
+    }
+
+    // Compute fail links (breadth first) and turn the trie into a DFA
+    std::queue<int32_t> queue;
+    for (size_t c = 0; c < _num_classes; ++c) {
+        auto& next = _delta[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            _nodes[next].fail = 0;
+            queue.push(next);
+        }
+    }
+    while (!queue.empty()) {
+        auto s = queue.front();
+        queue.pop();
+        auto& node = _nodes[s];
+        node.output = node.literal >= 0 ? s : _nodes[node.fail].output;
+        for (size_t c = 0; c < _num_classes; ++c) {
+            auto next = _delta[s*_num_classes + c];
+            auto fail_next = _delta[node.fail*_num_classes + c];
+            if (next < 0) {
+                _delta[s*_num_classes + c] = fail_next;
+            } else {
+                _nodes[next].fail = fail_next;
+                queue.push(next);
+            }
+        }
+    }
+}
+
+void MultiPatternMatcher::Clear() {
+    _pattern_ids.clear();
+    _patterns.clear();
+    _literal_ids.clear();
+    _literal_strs.clear();
+    _literals.clear();
+    _empty_literal = -1;
+    _initial_results.clear();
+    _num_classes = 0;
+    _nodes.clear();
+    _delta.clear();
+}
+
+void MultiPatternMatcher::Scan(const std::string_view& str, State& state) const {
+    state._results = _initial_results;
+
+    if (_empty_literal >= 0) {
+        for (auto id : _literals[_empty_literal].patterns) {
+            set_result(_patterns[id].type, 0, 0, str.size(), state._results[id]);
+        }
+    }
+
+    if (_nodes.size() <= 1) {
+        return;
+    }
+
+    int32_t s = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        s = _delta[s*_num_classes + _byte_class[static_cast<uint8_t>(str[i])]];
+        for (auto o = _nodes[s].output; o >= 0; o = _nodes[_nodes[o].fail].output) {
+            auto& lit = _literals[_nodes[o].literal];
+            auto end = i+1;
+            auto start = end - lit.size;
+            for (auto id : lit.patterns) {
+                set_result(_patterns[id].type, start, end, str.size(), state._results[id]);
+            }
+        }
+    }
+}
+
+bool MultiPatternMatcher::Matches(const std::string_view& str, size_t id, State& state) const {
+    auto& result = state._results[id];
+    if (result < 0) {
+        result = std::regex_search(str.begin(), str.end(), _patterns[id].regex) ? 1 : 0;
+    }
+    return result > 0;
+}
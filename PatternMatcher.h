@@ -0,0 +1,99 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUOMS_PATTERN_MATCHER_H
+#define AUOMS_PATTERN_MATCHER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <regex>
+
+enum class PatternType: int {
+    EQUALS,
+    STARTS_WITH,
+    ENDS_WITH,
+    CONTAINS,
+    REGEX,
+};
+
+// Matches a string against a set of patterns. All literal patterns (and regexes that are simple literals,
+// e.g. "^/usr/bin/") are compiled into a single Aho-Corasick automaton so they are all evaluated in one pass.
+// The remaining regexes are only evaluated, at most once per string, when a caller asks for them.
+class MultiPatternMatcher {
+public:
+    // Per string match results. Reusing the same instance avoids reallocation.
+    class State {
+    public:
+        friend class MultiPatternMatcher;
+    private:
+        std::vector<int8_t> _results;
+    };
+
+    MultiPatternMatcher(): _empty_literal(-1), _num_classes(0) {}
+
+    // Returns the id of the pattern. Adding the same pattern more than once returns the same id.
+    // Throws std::regex_error if the pattern is an invalid regex.
+    size_t Add(PatternType type, const std::string& pattern);
+
+    // Must be called after the last Add() and before Scan().
+    void Compile();
+
+    void Clear();
+
+    inline size_t Size() const { return _patterns.size(); }
+
+    // Evaluate all literal patterns against str.
+    void Scan(const std::string_view& str, State& state) const;
+
+    // Returns true if pattern id matches str. State must be the result of Scan() on the same str.
+    bool Matches(const std::string_view& str, size_t id, State& state) const;
+
+private:
+    struct Pattern {
+        PatternType type;
+        size_t literal; // Index into _literals, unused for non-literal regexes
+        std::regex regex;
+    };
+
+    struct Literal {
+        size_t size;
+        std::vector<size_t> patterns;
+    };
+
+    struct Node {
+        int32_t fail;
+        int32_t output; // Next node (including this one) along the fail chain that ends a literal, or -1
+        int32_t literal; // Literal ending at this node, or -1
+    };
+
+    std::unordered_map<std::string, size_t> _pattern_ids;
+    std::vector<Pattern> _patterns;
+    std::unordered_map<std::string, size_t> _literal_ids;
+    std::vector<std::string> _literal_strs;
+    std::vector<Literal> _literals;
+    int32_t _empty_literal;
+    std::vector<int8_t> _initial_results;
+
+    std::array<uint8_t, 256> _byte_class;
+    size_t _num_classes;
+    std::vector<Node> _nodes;
+    std::vector<int32_t> _delta; // DFA transitions, _num_classes per node
+};
+
+#endif //AUOMS_PATTERN_MATCHER_H
@@ -0,0 +1,117 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "PatternMatcherTests"
+#include <boost/test/unit_test.hpp>
+
+#include "PatternMatcher.h"
+
+bool match(MultiPatternMatcher& matcher, const std::string& str, size_t id) {
+    MultiPatternMatcher::State state;
+    matcher.Scan(str, state);
+    return matcher.Matches(str, id, state);
+}
+
+BOOST_AUTO_TEST_CASE( literal_test ) {
+    MultiPatternMatcher matcher;
+
+    auto eq = matcher.Add(PatternType::EQUALS, "/usr/bin/bash");
+    auto sw = matcher.Add(PatternType::STARTS_WITH, "/usr/bin/");
+    auto ew = matcher.Add(PatternType::ENDS_WITH, "bash");
+    auto co = matcher.Add(PatternType::CONTAINS, "bin/b");
+    auto co2 = matcher.Add(PatternType::CONTAINS, "in/");
+    BOOST_REQUIRE_EQUAL(matcher.Add(PatternType::STARTS_WITH, "/usr/bin/"), sw);
+    BOOST_REQUIRE_EQUAL(matcher.Size(), 5);
+    matcher.Compile();
+
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bash", eq));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bash", sw));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bash", ew));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bash", co));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bash", co2));
+
+    BOOST_REQUIRE(!match(matcher, "/usr/bin/bashx", eq));
+    BOOST_REQUIRE(!match(matcher, "/usr/bin/bashx", ew));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/bashx", co));
+    BOOST_REQUIRE(!match(matcher, "x/usr/bin/bash", eq));
+    BOOST_REQUIRE(!match(matcher, "x/usr/bin/bash", sw));
+    BOOST_REQUIRE(match(matcher, "x/usr/bin/bash", ew));
+    BOOST_REQUIRE(!match(matcher, "/usr/sbin/sshd", co));
+    BOOST_REQUIRE(match(matcher, "/usr/sbin/sshd", co2));
+    BOOST_REQUIRE(!match(matcher, "", co2));
+}
+
+BOOST_AUTO_TEST_CASE( overlap_test ) {
+    MultiPatternMatcher matcher;
+
+    // Patterns that are suffixes of each other exercise the fail and output links
+    auto he = matcher.Add(PatternType::CONTAINS, "he");
+    auto she = matcher.Add(PatternType::CONTAINS, "she");
+    auto hers = matcher.Add(PatternType::CONTAINS, "hers");
+    auto his = matcher.Add(PatternType::ENDS_WITH, "his");
+    matcher.Compile();
+
+    MultiPatternMatcher::State state;
+    std::string str = "ushers";
+    matcher.Scan(str, state);
+    BOOST_REQUIRE(matcher.Matches(str, he, state));
+    BOOST_REQUIRE(matcher.Matches(str, she, state));
+    BOOST_REQUIRE(matcher.Matches(str, hers, state));
+    BOOST_REQUIRE(!matcher.Matches(str, his, state));
+
+    str = "ahishe";
+    matcher.Scan(str, state);
+    BOOST_REQUIRE(matcher.Matches(str, he, state));
+    BOOST_REQUIRE(matcher.Matches(str, she, state));
+    BOOST_REQUIRE(!matcher.Matches(str, hers, state));
+    BOOST_REQUIRE(!matcher.Matches(str, his, state));
+}
+
+BOOST_AUTO_TEST_CASE( empty_test ) {
+    MultiPatternMatcher matcher;
+
+    auto eq = matcher.Add(PatternType::EQUALS, "");
+    auto co = matcher.Add(PatternType::CONTAINS, "");
+    matcher.Compile();
+
+    BOOST_REQUIRE(match(matcher, "", eq));
+    BOOST_REQUIRE(match(matcher, "", co));
+    BOOST_REQUIRE(!match(matcher, "abc", eq));
+    BOOST_REQUIRE(match(matcher, "abc", co));
+}
+
+BOOST_AUTO_TEST_CASE( regex_test ) {
+    MultiPatternMatcher matcher;
+
+    // Simple regexes are handled as literals
+    auto lit_sw = matcher.Add(PatternType::REGEX, "^/usr/bin/");
+    auto lit_eq = matcher.Add(PatternType::REGEX, "^/usr/bin/python3\\.8$");
+    auto lit_co = matcher.Add(PatternType::REGEX, "python");
+    auto re = matcher.Add(PatternType::REGEX, "python[0-9]\\.[0-9]+$");
+    auto re2 = matcher.Add(PatternType::REGEX, "^/usr/s?bin/\\w+$");
+    matcher.Compile();
+
+    BOOST_REQUIRE(match(matcher, "/usr/bin/python3.8", lit_sw));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/python3.8", lit_eq));
+    BOOST_REQUIRE(!match(matcher, "/usr/bin/python3x8", lit_eq));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/python3x8", lit_co));
+    BOOST_REQUIRE(match(matcher, "/usr/bin/python3.10", re));
+    BOOST_REQUIRE(!match(matcher, "/usr/bin/python3", re));
+    BOOST_REQUIRE(match(matcher, "/usr/sbin/sshd", re2));
+    BOOST_REQUIRE(!match(matcher, "/usr/sbin/ssh-agent", re2));
+
+    BOOST_REQUIRE_THROW(matcher.Add(PatternType::REGEX, "python[0-9"), std::regex_error);
+}
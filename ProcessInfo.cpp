@@ -19,6 +19,7 @@
 #include "StringUtils.h"
 #include "ExecveConverter.h"
 
+#include <algorithm>
 #include <climits>
 #include <cerrno>
 #include <cstring>
@@ -43,270 +44,214 @@ time_t boot_time() {
     return ts.tv_sec - sinfo.uptime;
 }
 
-bool read_file(const std::string& path, std::vector<uint8_t>& data, size_t limit, bool& truncated) {
+namespace {
+
+// Large enough for the biggest cmdline that will be kept (the Event field value size limit is UINT16_MAX including NULL terminator)
+constexpr size_t READ_BUFFER_SIZE = UINT16_MAX;
+constexpr size_t STAT_LIMIT = 2048;
+constexpr size_t STATUS_LIMIT = 8192;
+constexpr size_t CMDLINE_LIMIT = UINT16_MAX - 1;
+
+// Per-thread scratch buffer that /proc files are read into. stat and status are parsed in place,
+// so reading a process only allocates if the cmdline outgrows the capacity of the instance's _cmdline.
+char* read_buffer() {
+    static thread_local std::unique_ptr<char[]> buffer;
+    if (!buffer) {
+        buffer.reset(new char[READ_BUFFER_SIZE+1]);
+    }
+    return buffer.get();
+}
+
+// Reads up to limit bytes into buf (which must be at least limit+1 in size). The data is NULL terminated.
+bool read_file(int dir_fd, const char* path, char* buf, size_t limit, size_t& size, bool& truncated) {
     errno = 0;
-    int fd = ::open(path.c_str(), O_RDONLY);
+    int fd = ::openat(dir_fd, path, O_RDONLY|O_CLOEXEC);
     if (fd < 0) {
         return false;
     }
-    data.resize(limit+1);
-    if (data.size() > 0) {
-        ssize_t nr = read(fd, data.data(), data.size());
-        if (nr < 0) {
-            int err_save = errno;
-            close(fd);
-            errno = err_save;
-            return false;
-        } else {
-            if (nr > limit) {
-                data.resize(limit);
-                truncated = true;
-            } else {
-                data.resize(nr);
-                truncated = false;
-            }
-        }
+    ssize_t nr = ::read(fd, buf, limit+1);
+    if (nr < 0) {
+        int err_save = errno;
+        close(fd);
+        errno = err_save;
+        return false;
     }
     close(fd);
+    if (static_cast<size_t>(nr) > limit) {
+        size = limit;
+        truncated = true;
+    } else {
+        size = static_cast<size_t>(nr);
+        truncated = false;
+    }
+    buf[size] = 0;
     return true;
 }
 
 // Return 1 on success, 0 if there is no exe (the case for kernel processes), or -1 on error.
-int read_link(const std::string& path, std::string& data) {
-    char buff[PATH_MAX];
-    data.clear();
+int read_link(int dir_fd, const char* path, char* buf, size_t buf_size, size_t& size) {
+    size = 0;
     errno = 0;
-    ssize_t len = ::readlink(path.c_str(), buff, sizeof(buff)-1);
+    ssize_t len = ::readlinkat(dir_fd, path, buf, buf_size-1);
     if (len < 0) {
         // For kernel processes errno will be ENOENT
         if (errno == ENOENT) {
-            return 1;
+            return 0;
         }
         return -1;
     }
-    data.assign(buff, len);
+    size = static_cast<size_t>(len);
+    buf[size] = 0;
     return 1;
 }
 
-bool ProcessInfo::parse_stat() {
-    if (_stat.empty()) {
+// Parse a decimal number (with optional leading '-') at ptr, and advance ptr past it.
+template<typename T>
+inline bool parse_num(const char*& ptr, const char* end, T& val) {
+    bool neg = false;
+    if (ptr < end && *ptr == '-') {
+        neg = true;
+        ++ptr;
+    }
+    if (ptr >= end || *ptr < '0' || *ptr > '9') {
         return false;
     }
+    uint64_t v = 0;
+    while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+        v = (v * 10) + static_cast<uint64_t>(*ptr - '0');
+        ++ptr;
+    }
+    val = static_cast<T>(neg ? -static_cast<int64_t>(v) : static_cast<int64_t>(v));
+    return true;
+}
 
-    char *ptr = reinterpret_cast<char*>(_stat.data());
-    char *end = reinterpret_cast<char*>(ptr+_stat.size());
+// Advance ptr past the next n space separated fields.
+inline bool skip_fields(const char*& ptr, const char* end, int n) {
+    for (int i = 0; i < n; ++i) {
+        auto f_end = reinterpret_cast<const char*>(memchr(ptr, ' ', end-ptr));
+        if (f_end == nullptr) {
+            return false;
+        }
+        ptr = f_end+1;
+    }
+    return ptr < end;
+}
 
-    // pid
-    char *f_end = ptr;
+inline bool expect_space(const char*& ptr, const char* end) {
+    if (ptr >= end || *ptr != ' ') {
+        return false;
+    }
+    ++ptr;
+    return ptr < end;
+}
 
-    errno = 0;
-    _pid = static_cast<int>(strtol(ptr, &f_end, 10));
-    if (errno != 0 || *f_end != ' ') {
+// Parse "<key>\t<real>\t<effective>\t<saved>\t<fs>" from the status file
+bool parse_ids(const char* ptr, const char* end, const char* key, size_t key_len, int ids[4]) {
+    // Keys are always at the start of a line, and Uid/Gid are never the first line.
+    const char* line = reinterpret_cast<const char*>(memmem(ptr, end-ptr, key, key_len));
+    if (line == nullptr) {
         return false;
     }
+    ptr = line + key_len;
+    for (int i = 0; i < 4; ++i) {
+        while (ptr < end && (*ptr == '\t' || *ptr == ' ')) {
+            ++ptr;
+        }
+        if (!parse_num(ptr, end, ids[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    ptr = f_end+1;
+}
 
+bool ProcessInfo::parse_stat(const char* ptr, const char* end) {
     if (ptr >= end) {
         return false;
     }
 
+    // pid
+    if (!parse_num(ptr, end, _pid) || !expect_space(ptr, end)) {
+        return false;
+    }
+
     // comm
+    // comm may itself contain ") " so the last ')' in the file is the end of comm
     if (*ptr != '(') {
         return false;
     }
-    f_end = strstr(ptr, ") ");
-    if (f_end != nullptr && f_end+1 < end && f_end[1] == ')') {
-        f_end += 1;
-    }
-    if (f_end == nullptr || f_end >= end) {
+    auto c_end = reinterpret_cast<const char*>(memrchr(ptr, ')', end-ptr));
+    if (c_end == nullptr) {
         return false;
     }
-    _comm.assign(ptr+1, f_end-ptr-1);
-
-    ptr = f_end+1;
-    if (ptr < end && *ptr == ' ') {
-        ptr = ptr+1;
-    }
+    _comm_len = std::min(static_cast<size_t>(c_end-ptr-1), sizeof(_comm)-1);
+    memcpy(_comm, ptr+1, _comm_len);
+    _comm[_comm_len] = 0;
 
-    if (ptr >= end) {
+    ptr = c_end+1;
+    if (!expect_space(ptr, end)) {
         return false;
     }
 
     // Skip state
-    f_end = strchr(ptr, ' ');
-    if (f_end == nullptr || f_end >= end) {
-        return false;
-    }
-    ptr = f_end+1;
-    if (ptr >= end) {
+    if (!skip_fields(ptr, end, 1)) {
         return false;
     }
 
     // ppid
-    errno = 0;
-    _ppid = static_cast<int>(strtol(ptr, &f_end, 10));
-    if (errno != 0 || *f_end != ' ') {
-        return false;
-    }
-
-    ptr = f_end+1;
-
-    if (ptr >= end) {
+    if (!parse_num(ptr, end, _ppid) || !expect_space(ptr, end)) {
         return false;
     }
 
     // Skip pgrp
-    f_end = strchr(ptr, ' ');
-    if (f_end == nullptr || f_end >= end) {
-        return false;
-    }
-    ptr = f_end+1;
-    if (ptr >= end) {
+    if (!skip_fields(ptr, end, 1)) {
         return false;
     }
 
     // sid
-    errno = 0;
-    _ses = static_cast<int>(strtol(ptr, &f_end, 10));
-    if (errno != 0 || *f_end != ' ') {
-        return false;
-    }
-
-    ptr = f_end+1;
-
-    if (ptr >= end) {
+    if (!parse_num(ptr, end, _ses) || !expect_space(ptr, end)) {
         return false;
     }
 
     // Skip to utime
-    for (int i = 0; i < 7; ++i) {
-        f_end = strchr(ptr, ' ');
-        if (f_end == nullptr || f_end >= end) {
-            return false;
-        }
-        ptr = f_end + 1;
-        if (ptr >= end) {
-            return false;
-        }
-    }
-
-    // utime
-    errno = 0;
-    _utime = strtoull(ptr, &f_end, 10);
-    if (errno != 0 || *f_end != ' ') {
+    if (!skip_fields(ptr, end, 7)) {
         return false;
     }
 
-    ptr = f_end+1;
-    if (ptr >= end) {
+    // utime
+    if (!parse_num(ptr, end, _utime) || !expect_space(ptr, end)) {
         return false;
     }
 
     // stime
-    errno = 0;
-    _stime = strtoull(ptr, &f_end, 10);
-    if (errno != 0 || *f_end != ' ') {
-        return false;
-    }
-
-    ptr = f_end+1;
-    if (ptr >= end) {
+    if (!parse_num(ptr, end, _stime) || !expect_space(ptr, end)) {
         return false;
     }
 
     // Skip to starttime
-    for (int i = 0; i < 6; ++i) {
-        f_end = strchr(ptr, ' ');
-        if (f_end == nullptr || f_end >= end) {
-            return false;
-        }
-        ptr = f_end + 1;
-        if (ptr >= end) {
-            return false;
-        }
-    }
-
-    // starttime
-    errno = 0;
-    _starttime = strtoull(ptr, &f_end, 10);
-    if (errno != 0 || *f_end != ' ') {
+    if (!skip_fields(ptr, end, 6)) {
         return false;
     }
 
-    ptr = f_end+1;
-
-    if (ptr >= end) {
+    // starttime
+    if (!parse_num(ptr, end, _starttime) || !expect_space(ptr, end)) {
         return false;
     }
 
     return true;
 }
 
-bool ProcessInfo::parse_status() {
-    if (_status.empty()) {
-        return false;
-    }
-
-    char *ptr = reinterpret_cast<char*>(_status.data());
-    char *end = reinterpret_cast<char*>(ptr+_status.size());
-
-    char *uid_line = strstr(ptr, "Uid:");
-    if (uid_line == nullptr || uid_line >= end) {
-        return false;
-    }
-
-    char *uid_line_end = strchr(uid_line, '\n');
-    if (uid_line_end == nullptr || uid_line_end >= end) {
-        return false;
-    }
-
-    char *gid_line = strstr(uid_line_end, "Gid:");
-    if (gid_line == nullptr || gid_line >= end) {
-        return false;
-    }
-
-    char *gid_line_end = strchr(gid_line, '\n');
-    if (gid_line_end == nullptr || gid_line_end >= end) {
-        return false;
-    }
-
-    ptr = uid_line;
-    ptr += 4; // Skip "Uid:"
-    ptr = strchr(ptr, '\t');
-    if (ptr == nullptr) {
-        return false;
-    }
-
+bool ProcessInfo::parse_status(const char* ptr, const char* end) {
     int uids[4];
-    for (int i = 0; i < 4; i++) {
-        errno = 0;
-        uids[i] = static_cast<int>(strtol(ptr, &end, 10));
-        if (errno != 0) {
-            return false;
-        }
-        while(*ptr == '\t') {
-            ++ptr;
-        }
-    }
+    int gids[4];
 
-    ptr = gid_line;
-    ptr += 4; // Skip "Gid:"
-    ptr = strchr(ptr, '\t');
-    if (ptr == nullptr) {
+    if (!parse_ids(ptr, end, "\nUid:", 5, uids)) {
         return false;
     }
 
-    int gids[4];
-    for (int i = 0; i < 4; i++) {
-        errno = 0;
-        gids[i] = static_cast<int>(strtol(ptr, &end, 10));
-        if (errno != 0) {
-            return false;
-        }
-        while(*ptr == '\t') {
-            ++ptr;
-        }
+    if (!parse_ids(ptr, end, "\nGid:", 5, gids)) {
+        return false;
     }
 
     _uid = uids[0];
@@ -323,10 +268,32 @@ bool ProcessInfo::parse_status() {
 }
 
 bool ProcessInfo::read(int pid) {
-    const std::string path = "/proc/" + std::to_string(pid);
+    // All files are read relative to the pid's directory so that they all refer to the same process, even if the pid is reused.
+    char path[32];
+    if (_proc_fd >= 0) {
+        snprintf(path, sizeof(path), "%d", pid);
+    } else {
+        snprintf(path, sizeof(path), "/proc/%d", pid);
+    }
+    errno = 0;
+    int dir_fd = ::openat(_proc_fd >= 0 ? _proc_fd : AT_FDCWD, path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dir_fd < 0) {
+        if (errno != ENOENT && errno != ESRCH) {
+            Logger::Warn("Failed to open /proc/%d: %s", pid, strerror(errno));
+        }
+        return false;
+    }
+    bool ret = read(pid, dir_fd);
+    close(dir_fd);
+    return ret;
+}
+
+bool ProcessInfo::read(int pid, int dir_fd) {
+    char* buf = read_buffer();
+    size_t size;
     bool truncated;
 
-    if (!read_file(path+"/stat", _stat, 2048, truncated)) {
+    if (!read_file(dir_fd, "stat", buf, STAT_LIMIT, size, truncated)) {
         // Only generate a log message if the error was something other than ENOENT (No such file or directory) or ESRCH (No such process)
         if (errno != ENOENT && errno != ESRCH) {
             Logger::Warn("Failed to read /proc/%d/stat: %s", pid, strerror(errno));
@@ -334,7 +301,12 @@ bool ProcessInfo::read(int pid) {
         return false;
     }
 
-    if (!read_file(path+"/status", _status, 8192, truncated)) {
+    if (!parse_stat(buf, buf+size)) {
+        Logger::Warn("Failed to parse /proc/%d/stat", pid);
+        return false;
+    }
+
+    if (!read_file(dir_fd, "status", buf, STATUS_LIMIT, size, truncated)) {
         // Only generate a log message if the error was something other than ENOENT (No such file or directory) or ESRCH (No such process)
         if (errno != ENOENT && errno != ESRCH) {
             Logger::Warn("Failed to read /proc/%d/status: %s", pid, strerror(errno));
@@ -342,7 +314,12 @@ bool ProcessInfo::read(int pid) {
         return false;
     }
 
-    auto exe_status = read_link(path+"/exe", _exe);
+    if (!parse_status(buf, buf+size)) {
+        Logger::Warn("Failed to parse /proc/%d/status", pid);
+        return false;
+    }
+
+    auto exe_status = read_link(dir_fd, "exe", _exe, sizeof(_exe), _exe_len);
     if (exe_status < 0) {
             // EACCES (Permission denied) will be seen occasionally (probably due to racy nature of /proc iteration)
             // ONly emit error if it wasn't EACCES or ESRCH
@@ -355,32 +332,21 @@ bool ProcessInfo::read(int pid) {
     // Only try to read the cmdline file if there was an exe link.
     // Kernel processes will not have anything in the cmdline file.
     if (exe_status == 1) {
-        // The Event field value size limit is UINT16_MAX (including NULL terminator)
-        if (!read_file(path + "/cmdline", _cmdline, UINT16_MAX - 1, _cmdline_truncated)) {
+        if (!read_file(dir_fd, "cmdline", buf, CMDLINE_LIMIT, size, _cmdline_truncated)) {
             // Only generate a log message if the error was something other than ENOENT (No such file or directory) or ESRCH (No such process)
             if (errno != ENOENT && errno != ESRCH) {
                 Logger::Warn("Failed to read /proc/%d/cmdline: %s", pid, strerror(errno));
             }
             return false;
         }
-    }
-
-
-    if (!parse_stat()) {
-        Logger::Warn("Failed to parse /proc/%d/stat", pid);
-        return false;
-    }
-
-    if (!parse_status()) {
-        Logger::Warn("Failed to parse /proc/%d/status", pid);
-        return false;
+        _cmdline.assign(buf, size);
     }
 
     return true;
 }
 
 void ProcessInfo::format_cmdline(std::string& str) {
-    ExecveConverter::ConvertRawCmdline(std::string_view(reinterpret_cast<char*>(_cmdline.data()), _cmdline.size()), str);
+    ExecveConverter::ConvertRawCmdline(_cmdline, str);
 }
 
 bool ProcessInfo::get_arg1(std::string& str) {
@@ -404,11 +370,10 @@ bool ProcessInfo::get_arg1(std::string& str) {
     return size != 0;
 }
 
-std::string ProcessInfo::starttime() {
+std::string_view ProcessInfo::starttime() {
     static auto clk_tick = sysconf(_SC_CLK_TCK);
-    if (_starttime_str.empty()) {
+    if (_starttime_len == 0) {
         char fmt[256];
-        char buf[256];
         struct tm tm;
         uint64_t st = _boot_time + ((_starttime * 1000) / clk_tick);
         time_t st_s = st / 1000;
@@ -416,15 +381,16 @@ std::string ProcessInfo::starttime() {
 
         sprintf(fmt, "%%Y-%%m-%%dT%%H:%%M:%%S.%03uZ", st_m);
         gmtime_r(&st_s, &tm);
-        auto tsize = strftime(buf, sizeof(buf), fmt, &tm);
-        _starttime_str.assign(buf, tsize);
+        _starttime_len = strftime(_starttime_str, sizeof(_starttime_str), fmt, &tm);
     }
-    return _starttime_str;
+    return std::string_view(_starttime_str, _starttime_len);
 }
 
-ProcessInfo::ProcessInfo(void* dp) {
+ProcessInfo::ProcessInfo(void* dp, int proc_fd) {
     _dp = reinterpret_cast<DIR*>(dp);
+    _proc_fd = proc_fd;
     _boot_time = boot_time() * 1000;
+    clear();
 }
 
 ProcessInfo::~ProcessInfo() {
@@ -447,11 +413,15 @@ void ProcessInfo::clear() {
     _egid = -1;
     _sgid = -1;
     _fsgid = -1;
-    _exe.clear();
-    _comm.clear();
+    _utime = 0;
+    _stime = 0;
+    _comm_len = 0;
+    _comm[0] = 0;
+    _exe_len = 0;
+    _exe[0] = 0;
     _cmdline.clear();
     _cmdline_truncated = false;
-    _starttime_str.clear();
+    _starttime_len = 0;
 }
 
 std::unique_ptr<ProcessInfo> ProcessInfo::Open() {
@@ -461,17 +431,42 @@ std::unique_ptr<ProcessInfo> ProcessInfo::Open() {
         return std::unique_ptr<ProcessInfo>();
     }
 
-    return std::unique_ptr<ProcessInfo>(new ProcessInfo(dp));
+    return std::unique_ptr<ProcessInfo>(new ProcessInfo(dp, dirfd(dp)));
 }
 
 std::unique_ptr<ProcessInfo> ProcessInfo::Open(int pid) {
-    auto proc = std::unique_ptr<ProcessInfo>(new ProcessInfo(nullptr));
+    auto proc = std::unique_ptr<ProcessInfo>(new ProcessInfo(nullptr, -1));
     if (proc->read(pid)) {
         return proc;
     }
     return std::unique_ptr<ProcessInfo>();
 }
 
+std::unique_ptr<ProcessInfo> ProcessInfo::OpenAt(int proc_fd) {
+    return std::unique_ptr<ProcessInfo>(new ProcessInfo(nullptr, proc_fd));
+}
+
+bool ProcessInfo::ListPids(std::vector<int>& pids) {
+    DIR *dp = opendir("/proc");
+    if (dp == nullptr) {
+        return false;
+    }
+
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != nullptr) {
+        if (dirp->d_name[0] >= '0' && dirp->d_name[0] <= '9') {
+            pids.emplace_back(atoi(dirp->d_name));
+        }
+    }
+    closedir(dp);
+    return true;
+}
+
+bool ProcessInfo::read_pid(int pid) {
+    clear();
+    return read(pid);
+}
+
 bool ProcessInfo::next() {
     if (_dp == nullptr) {
         return false;
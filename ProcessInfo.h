@@ -18,8 +18,10 @@
 #define AUOMS_PROCESS_INFO_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <climits>
 
 size_t append_escaped_string(const char* ptr, size_t len, std::string& str);
 
@@ -29,8 +31,15 @@ public:
 
     static std::unique_ptr<ProcessInfo> Open();
     static std::unique_ptr<ProcessInfo> Open(int pid);
+    // Returns an instance for reading individual processes with read_pid(), relative to proc_fd (an open fd of /proc).
+    // The caller retains ownership of proc_fd. Each thread must use its own instance.
+    static std::unique_ptr<ProcessInfo> OpenAt(int proc_fd);
+
+    // Appends the pid of each process in /proc
+    static bool ListPids(std::vector<int>& pids);
 
     bool next();
+    bool read_pid(int pid);
 
     void format_cmdline(std::string& str);
     bool get_arg1(std::string& str);
@@ -47,26 +56,29 @@ public:
     inline int sgid()  { return _sgid; }
     inline int fsgid() { return _fsgid; }
 
-    inline std::string comm() { return _comm; }
-    inline std::string exe() { return _exe; }
+    // The returned views are only valid until the next read
+    inline std::string_view comm() { return std::string_view(_comm, _comm_len); }
+    inline std::string_view exe() { return std::string_view(_exe, _exe_len); }
 
     inline uint64_t utime() { return _utime; }
     inline uint64_t stime() { return _stime; }
 
-    std::string starttime();
+    std::string_view starttime();
 
     inline bool is_cmdline_truncated() { return _cmdline_truncated; }
 
 private:
-    explicit ProcessInfo(void* dp);
+    ProcessInfo(void* dp, int proc_fd);
 
-    bool parse_stat();
-    bool parse_status();
+    bool parse_stat(const char* ptr, const char* end);
+    bool parse_status(const char* ptr, const char* end);
 
     bool read(int pid);
+    bool read(int pid, int dir_fd);
     void clear();
 
     void* _dp;
+    int _proc_fd;
 
     time_t _boot_time;
 
@@ -84,13 +96,13 @@ private:
     int _sgid;
     int _fsuid;
     int _fsgid;
-    std::string _comm;
-    std::string _exe;
-    std::vector<uint8_t> _stat;
-    std::vector<uint8_t> _status;
-    std::vector<uint8_t> _statm;
-    std::vector<uint8_t> _cmdline;
-    std::string _starttime_str;
+    size_t _comm_len;
+    size_t _exe_len;
+    size_t _starttime_len;
+    char _comm[64];
+    char _exe[PATH_MAX];
+    char _starttime_str[32];
+    std::string _cmdline;
     bool _cmdline_truncated;
 };
 
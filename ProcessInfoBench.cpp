@@ -0,0 +1,91 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ProcessInfo.h"
+#include "Logger.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+/*
+ * Measures the per-pid cost of reading /proc with ProcessInfo (stat, status, exe and cmdline).
+ *
+ * Usage: ProcessInfoBench [passes]
+ */
+
+int main(int argc, char** argv) {
+    long passes = 100;
+    if (argc > 1) {
+        passes = std::stol(argv[1]);
+    }
+
+    std::vector<int> pids;
+    if (!ProcessInfo::ListPids(pids)) {
+        std::cerr << "Failed to list /proc" << std::endl;
+        return 1;
+    }
+
+    int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (proc_fd < 0) {
+        std::cerr << "Failed to open /proc" << std::endl;
+        return 1;
+    }
+
+    auto pinfo = ProcessInfo::OpenAt(proc_fd);
+    std::string cmdline;
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; ++i) {
+        for (auto pid : pids) {
+            if (pinfo->read_pid(pid)) {
+                pinfo->format_cmdline(cmdline);
+                bytes += pinfo->exe().size() + cmdline.size();
+                reads++;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+
+    std::cout << "read_pid: " << static_cast<uint64_t>((secs*1e9)/std::max<uint64_t>(reads, 1)) << " ns/pid"
+              << " (" << pids.size() << " pids, " << reads << " reads, " << bytes << " bytes of exe+cmdline)" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    reads = 0;
+    for (long i = 0; i < passes; ++i) {
+        auto p = ProcessInfo::Open();
+        while (p->next()) {
+            reads++;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    secs = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+
+    std::cout << "next: " << static_cast<uint64_t>((secs*1e9)/std::max<uint64_t>(reads, 1)) << " ns/pid" << std::endl;
+
+    close(proc_fd);
+    return 0;
+}
@@ -18,13 +18,17 @@
 #include "ProcessTree.h"
 #include "Logger.h"
 #include "StringUtils.h"
+#include "Signals.h"
 #include <stdlib.h>
 #include <dirent.h> 
+#include <unordered_set>
 #include <ctype.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <linux/netlink.h>
+#include <fcntl.h>
+#include <thread>
 
 #ifndef SOL_NETLINIK
 // This isn't defined in older socket.h include files.
@@ -35,18 +39,20 @@
 //constexpr int CLEAN_PROCESS_TIMEOUT = 300;
 //constexpr int CLEAN_PROCESS_INTERVAL = 300;
 constexpr int CLEAN_PROCESS_TIMEOUT = 60;
-constexpr int CLEAN_PROCESS_INTERVAL = 60;
+// Clean() only touches processes that have expired, so it can run often
+constexpr int CLEAN_PROCESS_INTERVAL = 1;
+constexpr int COMPACT_INTERVAL = 60;
+constexpr size_t POPULATE_MAX_THREADS = 4;
+constexpr size_t POPULATE_CHUNK_SIZE = 64;
+// UpdateFlags() releases the write lock after this many processes
+constexpr size_t UPDATE_FLAGS_BATCH_SIZE = 256;
 
 bool ProcessNotify::InitProcSocket()
 {
     struct sockaddr_nl s_addr;
-    struct __attribute__ ((aligned(NLMSG_ALIGNTO))) {
-        struct nlmsghdr header;
-        struct __attribute__ ((__packed__)) {
-            struct cn_msg connector;
-            enum proc_cn_mcast_op mode;
-        };
-    } message;
+    // Assemble the message in a buffer, cn_msg ends in a flexible array member so it can't be embedded in a struct
+    constexpr size_t MESSAGE_SIZE = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    alignas(NLMSG_ALIGNTO) uint8_t message[NLMSG_SPACE(MESSAGE_SIZE)];
 
     Logger::Info("ProcessNotify initialising");
 
@@ -75,17 +81,20 @@ bool ProcessNotify::InitProcSocket()
     }
 
     memset(&message, 0, sizeof(message));
-    message.header.nlmsg_len = sizeof(message);
-    message.header.nlmsg_pid = getpid();
-    message.header.nlmsg_type = NLMSG_DONE;
+    auto header = reinterpret_cast<struct nlmsghdr*>(message);
+    header->nlmsg_len = MESSAGE_SIZE;
+    header->nlmsg_pid = getpid();
+    header->nlmsg_type = NLMSG_DONE;
 
-    message.connector.id.idx = CN_IDX_PROC;
-    message.connector.id.val = CN_VAL_PROC;
-    message.connector.len = sizeof(enum proc_cn_mcast_op);
+    auto connector = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(header));
+    connector->id.idx = CN_IDX_PROC;
+    connector->id.val = CN_VAL_PROC;
+    connector->len = sizeof(enum proc_cn_mcast_op);
 
-    message.mode = PROC_CN_MCAST_LISTEN;
+    enum proc_cn_mcast_op mode = PROC_CN_MCAST_LISTEN;
+    memcpy(connector->data, &mode, sizeof(mode));
 
-    if (send(_proc_socket, &message, sizeof(message), 0) < 0) {
+    if (send(_proc_socket, message, MESSAGE_SIZE, 0) < 0) {
         Logger::Error("Cannot send to netlink socket for proc monitoring: %s", std::strerror(errno));
         close(_proc_socket);
         return false;
@@ -100,24 +109,72 @@ void ProcessNotify::on_stopping() {
     }
 }
 
+// A fork followed by an exit, with no exec in between, in the same batch is a transient process (e.g. a thread or a
+// helper fork) that lived for less time than it took to read the batch. The pair is folded into a single
+// ProcessQueueForkExit item. The process still gets a tree entry, already marked as exited, because its audit
+// records (and those of any children it forked) are processed after it exited and can no longer be read from /proc.
+void ProcessNotify::CoalesceTransient(std::vector<ProcessQueueItem>& items)
+{
+    if (items.size() < 2) {
+        return;
+    }
+
+    _batch_forks.clear();
+    bool coalesced = false;
+    for (size_t i = 0; i < items.size(); ++i) {
+        auto& item = items[i];
+        switch (item.type) {
+            case ProcessQueueFork:
+                _batch_forks[item.pid] = i;
+                break;
+            case ProcessQueueExec:
+                _batch_forks.erase(item.pid);
+                break;
+            case ProcessQueueExit: {
+                auto it = _batch_forks.find(item.pid);
+                if (it != _batch_forks.end()) {
+                    items[it->second].type = ProcessQueueForkExit;
+                    item.pid = -1;
+                    _batch_forks.erase(it);
+                    coalesced = true;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    if (coalesced) {
+        items.erase(std::remove_if(items.begin(), items.end(), [](const ProcessQueueItem& item) { return item.pid < 0; }), items.end());
+    }
+}
+
 void ProcessNotify::run()
 {
     if (!InitProcSocket()) {
         return;
     }
 
-    struct __attribute__ ((aligned(NLMSG_ALIGNTO))) {
-        struct nlmsghdr header;
-        struct __attribute__ ((__packed__)) {
-            struct cn_msg connector;
-            struct proc_event event;
-        };
-    } message;
+    // Receive up to RECV_BATCH_SIZE messages per system call
+    std::vector<uint8_t> buffers(RECV_BATCH_SIZE*RECV_BUFFER_SIZE);
+    std::array<struct iovec, RECV_BATCH_SIZE> iovs;
+    std::array<struct mmsghdr, RECV_BATCH_SIZE> msgs;
+    memset(msgs.data(), 0, sizeof(struct mmsghdr)*msgs.size());
+    for (size_t i = 0; i < RECV_BATCH_SIZE; ++i) {
+        iovs[i].iov_base = buffers.data() + (i*RECV_BUFFER_SIZE);
+        iovs[i].iov_len = RECV_BUFFER_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    std::vector<ProcessQueueItem> items;
+    items.reserve(RECV_BATCH_SIZE);
 
     Logger::Info("ProcessNotify starting");
 
     while(!IsStopping()) {
-        auto ret = recv(_proc_socket, &message, sizeof(message), 0);
+        auto ret = recvmmsg(_proc_socket, msgs.data(), msgs.size(), MSG_WAITFORONE, nullptr);
         if (ret == 0) {
             if (!IsStopping()) {
                 Logger::Error("Unexpected EOF on netlink socket for process monitoring");
@@ -128,88 +185,191 @@ void ProcessNotify::run()
             if (errno == EINTR && !IsStopping()) {
                 continue;
             }
-            Logger::Error("Error receiving from netlink socket for process monitoring: %s", std::strerror(errno));
+            if (!IsStopping()) {
+                Logger::Error("Error receiving from netlink socket for process monitoring: %s", std::strerror(errno));
+            }
             return;
         }
 
-        switch (message.event.what) {
-            case proc_event::what::PROC_EVENT_FORK:
-                _processTree->AddPnForkQueue(message.event.event_data.fork.child_pid, message.event.event_data.fork.parent_pid);
-                break;
-            case proc_event::what::PROC_EVENT_EXEC:
-                _processTree->AddPnExecQueue(message.event.event_data.exec.process_pid);
-                break;
-            case proc_event::what::PROC_EVENT_EXIT:
-                _processTree->AddPnExitQueue(message.event.event_data.exit.process_pid);
-                break;
+        items.clear();
+        for (int i = 0; i < ret; ++i) {
+            auto header = reinterpret_cast<struct nlmsghdr*>(iovs[i].iov_base);
+            auto len = msgs[i].msg_len;
+            for (; NLMSG_OK(header, len); header = NLMSG_NEXT(header, len)) {
+                if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(struct proc_event))) {
+                    continue;
+                }
+                auto connector = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(header));
+                auto event = reinterpret_cast<struct proc_event*>(connector->data);
+                switch (event->what) {
+                    case proc_event::what::PROC_EVENT_FORK:
+                        items.emplace_back(ProcessQueueItem{ProcessQueueFork, ProcessTreeSource_pnotify, event->event_data.fork.child_pid, event->event_data.fork.parent_pid});
+                        break;
+                    case proc_event::what::PROC_EVENT_EXEC:
+                        items.emplace_back(ProcessQueueItem{ProcessQueueExec, ProcessTreeSource_pnotify, event->event_data.exec.process_pid, 0});
+                        break;
+                    case proc_event::what::PROC_EVENT_EXIT:
+                        items.emplace_back(ProcessQueueItem{ProcessQueueExit, ProcessTreeSource_pnotify, event->event_data.exit.process_pid, 0});
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        CoalesceTransient(items);
+        if (!items.empty()) {
+            _processTree->AddPnQueue(items);
         }
     }
 }
 
-void ProcessTree::AddPnForkQueue(int pid, int ppid)
+size_t ProcessQueue::Push(const ProcessQueueItem* items, size_t num_items)
 {
-    struct ProcessQueueItem p = {ProcessQueueFork, ProcessTreeSource_pnotify, pid, ppid};
-    std::unique_lock<std::mutex> queue_lock(_queue_mutex);
-    _PnQueue.push(p);
-    _queue_data.notify_one();
+    auto head = _head.load(std::memory_order_acquire);
+    auto tail = _tail.load(std::memory_order_relaxed);
+    auto n = std::min(num_items, CAPACITY - (tail - head));
+    for (size_t i = 0; i < n; ++i) {
+        _items[(tail + i) & (CAPACITY-1)] = items[i];
+    }
+    // seq_cst so that the _waiting check below can't be ordered before the new tail is visible to the consumer
+    _tail.store(tail + n);
+
+    if (n > 0 && _waiting.load()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cond.notify_one();
+    }
+    return n;
 }
 
-void ProcessTree::AddPnExecQueue(int pid)
+size_t ProcessQueue::Pop(ProcessQueueItem* items, size_t max_items, long timeout)
 {
-    struct ProcessQueueItem p = {ProcessQueueExec, ProcessTreeSource_pnotify, pid};
-    std::unique_lock<std::mutex> queue_lock(_queue_mutex);
-    _PnQueue.push(p);
-    _queue_data.notify_one();
+    auto head = _head.load(std::memory_order_relaxed);
+    if (_tail.load(std::memory_order_acquire) == head) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _waiting.store(true);
+        _cond.wait_for(lock, std::chrono::milliseconds(timeout), [this,head]() { return _tail.load() != head || _interrupted.load(); });
+        _waiting.store(false);
+    }
+
+    auto tail = _tail.load(std::memory_order_acquire);
+    auto n = std::min(max_items, tail - head);
+    for (size_t i = 0; i < n; ++i) {
+        items[i] = _items[(head + i) & (CAPACITY-1)];
+    }
+    _head.store(head + n, std::memory_order_release);
+    return n;
 }
 
-void ProcessTree::AddPnExitQueue(int pid)
+void ProcessQueue::Interrupt()
 {
-    struct ProcessQueueItem p = {ProcessQueueExit, ProcessTreeSource_pnotify, pid};
-    std::unique_lock<std::mutex> queue_lock(_queue_mutex);
-    _PnQueue.push(p);
-    _queue_data.notify_one();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _interrupted.store(true);
+    _cond.notify_all();
+}
+
+void ProcessTree::AddPnQueue(const std::vector<ProcessQueueItem>& items)
+{
+    auto n = _PnQueue.Push(items.data(), items.size());
+    if (n < items.size()) {
+        _PnQueue_dropped.fetch_add(items.size() - n);
+    }
 }
 
 void ProcessTree::on_stopping() {
-    _queue_data.notify_all();
+    _PnQueue.Interrupt();
 }
 
 void ProcessTree::run()
 {
-    std::unique_lock<std::mutex> queue_lock(_queue_mutex);
+    constexpr size_t BATCH_SIZE = 256;
+    std::array<ProcessQueueItem, BATCH_SIZE> items;
+
     while (!IsStopping()) {
-        _queue_data.wait(queue_lock, [&]{return !_PnQueue.empty() || IsStopping();});
+        auto n = _PnQueue.Pop(items.data(), items.size(), CLEAN_PROCESS_INTERVAL*1000);
         if (IsStopping()) {
             return;
         }
-        while (!_PnQueue.empty()) {
-            struct ProcessQueueItem p = _PnQueue.front();
-            _PnQueue.pop();
-            queue_lock.unlock();
-            switch (p.type) {
-                case ProcessQueueFork:
-                    AddPid(p.pid, p.ppid);
-                    break;
-                case ProcessQueueExec:
-                    AddPid(p.pid);
-                    break;
-                case ProcessQueueExit:
-                    RemovePid(p.pid);
-                    break;
-                default:
-                    Logger::Error("Invalid ProcessQueueType");
+
+        if (n > 0) {
+            std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
+            for (size_t i = 0; i < n; ++i) {
+                auto& p = items[i];
+                switch (p.type) {
+                    case ProcessQueueFork:
+                        AddPid(p.pid, p.ppid);
+                        break;
+                    case ProcessQueueExec:
+                        AddPid(p.pid);
+                        break;
+                    case ProcessQueueExit:
+                        RemovePid(p.pid);
+                        break;
+                    case ProcessQueueForkExit:
+                        AddPid(p.pid, p.ppid);
+                        RemovePid(p.pid);
+                        break;
+                    default:
+                        Logger::Error("Invalid ProcessQueueType");
+                }
             }
-            queue_lock.lock();
         }
-        queue_lock.unlock();
 
         // Check if it's time for routine pruning of stale pids
-        std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - _last_clean_time;
-        if (elapsed_seconds.count() > CLEAN_PROCESS_INTERVAL) {
+        if (std::chrono::steady_clock::now() - _last_clean_time >= std::chrono::seconds(CLEAN_PROCESS_INTERVAL)) {
             Clean();
-            _last_clean_time = std::chrono::system_clock::now();
+            _last_clean_time = std::chrono::steady_clock::now();
+
+            auto dropped = _PnQueue_dropped.exchange(0);
+            if (dropped > 0) {
+                Logger::Warn("ProcessTree: Dropped %lu process events because the queue was full", dropped);
+            }
+        }
+    }
+}
+
+std::shared_ptr<ProcessTreeItem> ProcessTable::Get(int pid) const
+{
+    auto& sh = shard(pid);
+    std::shared_lock<std::shared_mutex> lock(sh._mutex);
+    auto it = sh._processes.find(pid);
+    if (it != sh._processes.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+void ProcessTable::Set(int pid, const std::shared_ptr<ProcessTreeItem>& process)
+{
+    auto& sh = shard(pid);
+    std::unique_lock<std::shared_mutex> lock(sh._mutex);
+    sh._processes[pid] = process;
+}
+
+bool ProcessTable::Erase(int pid)
+{
+    auto& sh = shard(pid);
+    std::unique_lock<std::shared_mutex> lock(sh._mutex);
+    return sh._processes.erase(pid) > 0;
+}
+
+size_t ProcessTable::Size() const
+{
+    size_t size = 0;
+    for (auto& sh : _shards) {
+        std::shared_lock<std::shared_mutex> lock(sh._mutex);
+        size += sh._processes.size();
+    }
+    return size;
+}
+
+void ProcessTable::ForEach(const std::function<void(const std::shared_ptr<ProcessTreeItem>&)>& fn) const
+{
+    for (auto& sh : _shards) {
+        std::shared_lock<std::shared_mutex> lock(sh._mutex);
+        for (auto& p : sh._processes) {
+            fn(p.second);
         }
-        queue_lock.lock();
     }
 }
 
@@ -219,27 +379,27 @@ void ProcessTree::run()
 */
 void ProcessTree::AddPid(int pid, int ppid)
 {
-    std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
-    if (_processes.count(pid) == 0) {
+    if (!_processes.Get(pid)) {
         std::shared_ptr<ProcessTreeItem> process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_pnotify, pid, ppid);
-        if (ppid && _processes.count(ppid) > 0) {
-            auto parent = _processes[ppid];
+        auto parent = ppid ? _processes.Get(ppid) : nullptr;
+        if (parent) {
             process->_uid = parent->_uid;
             process->_gid = parent->_gid;
             process->_exe = parent->_exe;
             process->_cmdline = parent->_cmdline;
             process->_containerid = parent->_containerid;
             process->_exec_propagation = parent->_exec_propagation;
+            // The child has the same uid, gid, exe and cmdline as the parent, so it has the same filter matches
+            process->_match_flags = MatchFlags(*parent, *_filtersEngine->GetSnapshot());
+            process->_match_filter_generation = parent->_match_filter_generation;
+            process->_match_exec_generation = process->_exec_generation;
             parent->_children.emplace_back(pid);
-            process->_ancestors = parent->_ancestors;
-            struct Ancestor anc = {ppid, parent->_exe};
-            process->_ancestors.emplace_back(anc);
+            process->_ancestors = AncestorNode(parent);
             ApplyFlags(process);
         } else {
-            struct Ancestor anc = {ppid, ""};
-            process->_ancestors.emplace_back(anc);
+            process->_ancestors = std::make_shared<const Ancestor>(ppid, InternedString(), nullptr);
         }
-        _processes[pid] = process;
+        _processes.Set(pid, process);
     } 
 }
 
@@ -250,15 +410,15 @@ void ProcessTree::AddPid(int pid, int ppid)
 */
 void ProcessTree::AddPid(int pid)
 {
-    std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
-    if (_processes.count(pid) > 0) {
-        if (_processes[pid]->_source == ProcessTreeSource_pnotify) {
-            _processes[pid]->_exec_propagation += 1;
+    auto process = _processes.Get(pid);
+    if (process) {
+        if (process->_source == ProcessTreeSource_pnotify) {
+            process->_exec_propagation += 1;
         }
     } else {
-        std::shared_ptr<ProcessTreeItem> process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_pnotify, pid);
+        process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_pnotify, pid);
         process->_exec_propagation = 1;
-        _processes[pid] = process;
+        _processes.Set(pid, process);
     }
 }
 
@@ -274,72 +434,69 @@ std::shared_ptr<ProcessTreeItem> ProcessTree::AddProcess(enum ProcessTreeSource
         exe = exe.substr(1, exe.length() - 2);
     }
 
-    std::string containerid = ExtractContainerId(exe, cmdline);
-    auto it = _processes.find(pid);
-    if (it != _processes.end()) {
-        process = it->second;
+    auto containerid = _strings.Intern(ExtractContainerId(exe, cmdline));
+    auto exe_str = _strings.Intern(exe);
+    auto cmdline_str = _strings.Intern(cmdline);
+    auto existing = _processes.Get(pid);
+    if (existing) {
+        process = std::make_shared<ProcessTreeItem>(*existing);
         process->_source = source;
+        process->_exec_generation++;
         process->_uid = uid;
         process->_gid = gid;
-        process->_exe = exe;
+        process->_exe = exe_str;
         process->_containeridfromhostprocess = containerid;
         if (ppid != process->_ppid) {
-            auto it2 = _processes.find(process->_ppid);
-            if (it2 != _processes.end()) {
-                auto oldparent = it2->second;
+            auto oldparent = _processes.Get(process->_ppid);
+            if (oldparent) {
                 auto e = std::find(oldparent->_children.begin(), oldparent->_children.end(), pid);
                 if (e != oldparent->_children.end()) {
                     oldparent->_children.erase(e);
                 }
             }
-            it2 = _processes.find(ppid);
-            if (it2 != _processes.end()) {
-                auto parentproc = it2->second;
+            auto parentproc = _processes.Get(ppid);
+            if (parentproc) {
                 parentproc->_children.emplace_back(pid);
                 if (!(parentproc->_containeridfromhostprocess).empty()) {
                     process->_containerid = parentproc->_containeridfromhostprocess;
                 } else {
                     process->_containerid = parentproc->_containerid;
                 }
-                process->_ancestors = parentproc->_ancestors;
-                struct Ancestor anc = {ppid, parentproc->_exe};
-                process->_ancestors.emplace_back(anc);
+                process->_ancestors = AncestorNode(parentproc);
             }
             process->_ppid = ppid;
         }
-        process->_cmdline = cmdline;
+        process->_cmdline = cmdline_str;
         if (process->_exec_propagation > 0) {
             process->_exec_propagation = process->_exec_propagation - 1;
         }
+        ApplyFlags(process);
+        _processes.Set(pid, process);
         for (auto c : process->_children) {
-            auto it2 = _processes.find(c);
-            if (it2 != _processes.end()) {
-                auto p = it2->second;
-                if (p->_exec_propagation > 0) {
-                    p->_source = source;
-                    p->_exe = exe;
-                    p->_cmdline = cmdline;
-                    p->_uid = uid;
-                    p->_gid = gid;
-                    if (!(process->_containeridfromhostprocess).empty()) {
-                        p->_containerid = process->_containeridfromhostprocess;
-                    } else {
-                        p->_containerid = process->_containerid;
-                    }
-                    p->_ancestors = process->_ancestors;
-                    struct Ancestor anc = {pid, exe};
-                    p->_ancestors.emplace_back(anc);
-                    p->_exec_propagation = p->_exec_propagation - 1;
-                    ApplyFlags(p);
+            auto child = _processes.Get(c);
+            if (child && child->_exec_propagation > 0) {
+                auto p = std::make_shared<ProcessTreeItem>(*child);
+                p->_source = source;
+                p->_exec_generation++;
+                p->_exe = exe_str;
+                p->_cmdline = cmdline_str;
+                p->_uid = uid;
+                p->_gid = gid;
+                if (!(process->_containeridfromhostprocess).empty()) {
+                    p->_containerid = process->_containeridfromhostprocess;
+                } else {
+                    p->_containerid = process->_containerid;
                 }
+                p->_ancestors = AncestorNode(process);
+                p->_exec_propagation = p->_exec_propagation - 1;
+                ApplyFlags(p);
+                _processes.Set(c, p);
             }
         }
-        ApplyFlags(process);
     } else {
-        process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_execve, pid, ppid, uid, gid, exe, cmdline);
-        auto it2 = _processes.find(ppid);
-        if (it2 != _processes.end()) {
-            auto parentproc = it2->second;
+        process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_execve, pid, ppid, uid, gid, exe_str, cmdline_str);
+        auto parentproc = _processes.Get(ppid);
+        if (parentproc) {
             parentproc->_children.emplace_back(pid);
             if (!(parentproc->_containeridfromhostprocess).empty()) {
                 process->_containerid = parentproc->_containeridfromhostprocess;
@@ -347,12 +504,10 @@ std::shared_ptr<ProcessTreeItem> ProcessTree::AddProcess(enum ProcessTreeSource
                 process->_containeridfromhostprocess = containerid;
                 process->_containerid = parentproc->_containerid;
             }            
-            process->_ancestors = parentproc->_ancestors;
-            struct Ancestor anc = {ppid, parentproc->_exe};
-            process->_ancestors.emplace_back(anc);
+            process->_ancestors = AncestorNode(parentproc);
         }
         ApplyFlags(process);
-        _processes[pid] = process;
+        _processes.Set(pid, process);
     }
 
     return process;
@@ -362,12 +517,11 @@ std::shared_ptr<ProcessTreeItem> ProcessTree::AddProcess(enum ProcessTreeSource
 */
 void ProcessTree::RemovePid(int pid)
 {
-    std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
-    auto it = _processes.find(pid);
-    if (it != _processes.end()) {
-        auto process = it->second;
-        process->_exit_time = std::chrono::system_clock::now();
+    auto process = _processes.Get(pid);
+    if (process && !process->_exited) {
+        process->_exit_time = std::chrono::steady_clock::now();
         process->_exited = true;
+        _exit_queue.emplace_back(process->_exit_time + std::chrono::seconds(CLEAN_PROCESS_TIMEOUT), pid);
     }
 }
 
@@ -375,45 +529,82 @@ void ProcessTree::Clean()
 {
     std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
 
-    for (auto element = _processes.begin(); element != _processes.end();) {
-        if (element->second->_exited) {
-            std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - element->second->_exit_time;
-            if (elapsed_seconds.count() > CLEAN_PROCESS_TIMEOUT) {
-                // remove this process
-                element = _processes.erase(element);
-                // back round the loop without iterating (as the erase() gave us the next item)
-                continue;
-            }
+    // Exit times only increase, so the queue is in expiry order
+    auto now = std::chrono::steady_clock::now();
+    while (!_exit_queue.empty() && _exit_queue.front().first <= now) {
+        auto expiry = _exit_queue.front().first;
+        auto pid = _exit_queue.front().second;
+        _exit_queue.pop_front();
+        // Skip the entry if the pid has since been reused by a process that is still running or exited later
+        auto process = _processes.Get(pid);
+        if (process && process->_exited && process->_exit_time + std::chrono::seconds(CLEAN_PROCESS_TIMEOUT) <= expiry) {
+            _processes.Erase(pid);
         }
-        element++;
+    }
+
+    if (now - _last_compact_time >= std::chrono::seconds(COMPACT_INTERVAL)) {
+        _strings.Compact();
+        report_metrics();
+        _last_compact_time = now;
     }
 }
 
+// The memory figure is an estimate: it covers the items, their table entries, children lists and ancestor nodes,
+// and the interned strings, but not allocator overhead.
+void ProcessTree::report_metrics()
+{
+    if (!_memory_metric) {
+        return;
+    }
+
+    constexpr size_t MAP_NODE_SIZE = sizeof(std::pair<const int, std::shared_ptr<ProcessTreeItem>>) + 2*sizeof(void*);
+    constexpr size_t SHARED_ALLOC_OVERHEAD = 2*sizeof(long);
+    constexpr size_t STRING_ENTRY_SIZE = sizeof(std::string) + sizeof(std::string_view) + sizeof(std::shared_ptr<const std::string>) + SHARED_ALLOC_OVERHEAD + 2*sizeof(void*);
+
+    size_t num_processes = 0;
+    size_t bytes = 0;
+    _processes.ForEach([&num_processes,&bytes](const std::shared_ptr<ProcessTreeItem>& process) {
+        num_processes++;
+        bytes += MAP_NODE_SIZE + sizeof(ProcessTreeItem) + SHARED_ALLOC_OVERHEAD + process->_children.capacity()*sizeof(int);
+        if (process->_ancestor_node) {
+            bytes += sizeof(Ancestor) + SHARED_ALLOC_OVERHEAD;
+        }
+    });
+    auto num_strings = _strings.Size();
+    bytes += _strings.Bytes() + num_strings*STRING_ENTRY_SIZE;
+
+    _processes_metric->Set(static_cast<double>(num_processes));
+    _memory_metric->Set(static_cast<double>(bytes));
+    _strings_metric->Set(static_cast<double>(num_strings));
+}
+
 std::shared_ptr<ProcessTreeItem> ProcessTree::GetInfoForPid(int pid)
 {
-    auto it = _processes.find(pid);
-    if (it != _processes.end() && it->second->_source != ProcessTreeSource_pnotify) {
-        return it->second;
+    auto existing = _processes.Get(pid);
+    if (existing && existing->_source != ProcessTreeSource_pnotify) {
+        return existing;
     } else {
         // process doesn't currently exist, or we only have rudimentary information for it, so add it
         std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
+        // Another thread might have added it while we waited for the lock
+        existing = _processes.Get(pid);
+        if (existing && existing->_source != ProcessTreeSource_pnotify) {
+            return existing;
+        }
         auto process = ReadProcEntry(pid);
         if (process != nullptr) {
-            auto it2 = _processes.find(process->_ppid);
-            if (it2 != _processes.end()) {
-                auto parentproc = it2->second;
+            auto parentproc = _processes.Get(process->_ppid);
+            if (parentproc) {
                 parentproc->_children.emplace_back(pid);
                 if (!(parentproc->_containeridfromhostprocess).empty()) {
                     process->_containerid = parentproc->_containeridfromhostprocess;
                 } else {
                     process->_containerid = parentproc->_containerid;
                 }
-                process->_ancestors = parentproc->_ancestors;
-                struct Ancestor anc = {process->_ppid, parentproc->_exe};
-                process->_ancestors.emplace_back(anc);
+                process->_ancestors = AncestorNode(parentproc);
             }
-            _processes[pid] = process;
             ApplyFlags(process);
+            _processes.Set(pid, process);
         }
         return process;
     }
@@ -432,105 +623,220 @@ bool ProcessTree::is_number(char *s)
 
 void ProcessTree::ApplyFlags(std::shared_ptr<ProcessTreeItem> process)
 {
+    process->_flags = ComputeFlags(*process);
+}
+
+// The flags of the nearest process (starting with the process itself) in the ancestry that matches any filter
+std::bitset<FILTER_BITSET_SIZE> ProcessTree::ComputeFlags(ProcessTreeItem& process)
+{
+    auto filters = _filtersEngine->GetSnapshot();
     unsigned int height = 0;
-    process->_flags = _filtersEngine->GetFlags(process, height);
-    if (process->_flags.none()) {
-        std::vector<struct Ancestor>::reverse_iterator rit = process->_ancestors.rbegin();
-        for (; rit != process->_ancestors.rend() && process->_flags.none(); ++rit) {
-            height++;
-            auto it = _processes.find(rit->pid);
-            if (it != _processes.end()) {
-                process->_flags = _filtersEngine->GetFlags(it->second, height);
-            }
+    auto flags = MatchFlags(process, *filters) & filters->GetDepthMask(height);
+    for (auto anc = process._ancestors.get(); anc != nullptr && flags.none(); anc = anc->parent.get()) {
+        height++;
+        auto ancestor = _processes.Get(anc->pid);
+        if (ancestor) {
+            flags = MatchFlags(*ancestor, *filters) & filters->GetDepthMask(height);
         }
     }
+    return flags;
+}
+
+// Only the filters that changed since the cached value was computed are evaluated,
+// unless the process has exec'd (or otherwise changed) since then.
+const std::bitset<FILTER_BITSET_SIZE>& ProcessTree::MatchFlags(ProcessTreeItem& process, const FiltersSnapshot& filters)
+{
+    auto generation = filters.Generation();
+    if (process._match_filter_generation == 0 || process._match_exec_generation != process._exec_generation) {
+        process._match_flags = filters.GetMatchFlags(process, std::bitset<FILTER_BITSET_SIZE>().set());
+    } else if (process._match_filter_generation != generation) {
+        auto changed = filters.ChangedSince(process._match_filter_generation);
+        process._match_flags = (process._match_flags & ~changed) | filters.GetMatchFlags(process, changed);
+    }
+    process._match_filter_generation = generation;
+    process._match_exec_generation = process._exec_generation;
+    return process._match_flags;
+}
+
+std::shared_ptr<const Ancestor> ProcessTree::AncestorNode(const std::shared_ptr<ProcessTreeItem>& process)
+{
+    auto& node = process->_ancestor_node;
+    if (!node || node->parent != process->_ancestors || node->exe != process->_exe) {
+        node = std::make_shared<const Ancestor>(process->_pid, process->_exe, process->_ancestors);
+    }
+    return node;
 }
 
 void ProcessTree::PopulateTree()
 {
     std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
 
-    int pid;
-    int ppid;
-    int uid;
-    int gid;
-    std::string exe;
-    std::string cmdline;
+    auto start_time = std::chrono::steady_clock::now();
 
-    auto pinfo = ProcessInfo::Open();
-    if (!pinfo) {
+    std::vector<int> pids;
+    if (!ProcessInfo::ListPids(pids)) {
         return;
     }
 
-    while (pinfo->next()) {
+    int proc_fd = open("/proc", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (proc_fd < 0) {
+        Logger::Error("ProcessTree: Failed to open /proc: %s", std::strerror(errno));
+        return;
+    }
 
-        pid = pinfo->pid();
-        ppid = pinfo->ppid();
-        uid = pinfo->uid();
-        gid = pinfo->gid();
-        exe = pinfo->exe();
-        pinfo->format_cmdline(cmdline);
+    // Read the /proc entries in parallel. Each thread claims POPULATE_CHUNK_SIZE pids at a time.
+    size_t num_threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), POPULATE_MAX_THREADS);
+    num_threads = std::min(num_threads, (pids.size() + POPULATE_CHUNK_SIZE - 1) / POPULATE_CHUNK_SIZE);
+    std::atomic<size_t> next_idx(0);
+    std::vector<std::vector<std::shared_ptr<ProcessTreeItem>>> results(num_threads);
+
+    auto read_entries = [this,proc_fd,&pids,&next_idx,&results](size_t thread_idx) {
+        auto pinfo = ProcessInfo::OpenAt(proc_fd);
+        auto& found = results[thread_idx];
+        std::string exe;
+        std::string cmdline;
+        for (;;) {
+            auto idx = next_idx.fetch_add(POPULATE_CHUNK_SIZE);
+            if (idx >= pids.size()) {
+                break;
+            }
+            auto end_idx = std::min(idx + POPULATE_CHUNK_SIZE, pids.size());
+            for (; idx < end_idx; ++idx) {
+                if (!pinfo->read_pid(pids[idx])) {
+                    continue;
+                }
+                exe = pinfo->exe();
+                pinfo->format_cmdline(cmdline);
 
-        auto process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_procfs, pid, ppid, uid, gid, exe, cmdline);
-        process->_containeridfromhostprocess = ExtractContainerId(exe, cmdline);
-        _processes[pid] = process;
+                auto process = std::make_shared<ProcessTreeItem>(ProcessTreeSource_procfs, pinfo->pid(), pinfo->ppid(), pinfo->uid(), pinfo->gid(), _strings.Intern(exe), _strings.Intern(cmdline));
+                process->_containeridfromhostprocess = _strings.Intern(ExtractContainerId(exe, cmdline));
+                found.emplace_back(process);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back([&read_entries,i]() {
+            Signals::InitThread();
+            read_entries(i);
+        });
+    }
+    if (num_threads > 0) {
+        read_entries(0);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    close(proc_fd);
+
+    auto scan_time = std::chrono::steady_clock::now();
+
+    // Build the tree privately and only add the processes to the table once they are complete
+    std::unordered_map<int, std::shared_ptr<ProcessTreeItem>> processes;
+    processes.reserve(pids.size());
+    for (auto& found : results) {
+        for (auto& process : found) {
+            processes[process->_pid] = process;
+        }
     }
 
-    for (auto p : _processes) {
+    for (auto p : processes) {
         auto process = p.second;
-        auto it = _processes.find(process->_ppid);
-        if (it != _processes.end()) {
+        auto it = processes.find(process->_ppid);
+        if (it != processes.end()) {
             it->second->_children.emplace_back(process->_pid);
         }
     }
 
-    for (auto p : _processes) {
-        std::shared_ptr<ProcessTreeItem> process, parent;
-        process = p.second;
-        auto it = _processes.find(process->_ppid);
-        if (it != _processes.end()) {
-            parent = it->second;
-        } else {
-            parent = nullptr;
-        }
-        while (parent) {
-            process->_ancestors.insert(process->_ancestors.begin(), {parent->_pid, parent->_exe});
-            auto it2 = _processes.find(parent->_ppid);
-            if (it2 != _processes.end()) {
-                parent = it2->second;
+    // Link the ancestry top down so that each parent's node is shared by all of its descendants
+    std::unordered_set<int> linked;
+    std::vector<std::shared_ptr<ProcessTreeItem>> chain;
+    for (auto p : processes) {
+        chain.clear();
+        auto process = p.second;
+        while (process && linked.count(process->_pid) == 0) {
+            linked.insert(process->_pid);
+            chain.emplace_back(process);
+            auto it = processes.find(process->_ppid);
+            if (it != processes.end()) {
+                process = it->second;
             } else {
-                parent = nullptr;
+                process = nullptr;
+            }
+        }
+        for (auto rit = chain.rbegin(); rit != chain.rend(); ++rit) {
+            auto it = processes.find((*rit)->_ppid);
+            if (it != processes.end()) {
+                (*rit)->_ancestors = AncestorNode(it->second);
             }
         }
     }
      // Populate containerid
-    for (auto p : _processes) {
+    for (auto p : processes) {
         auto process = p.second;
         if( !(process->_containeridfromhostprocess).empty()) {
-            SetContainerId(process, process->_containeridfromhostprocess);
+            SetContainerId(processes, process, process->_containeridfromhostprocess);
         }
     }
+
+    for (auto p : processes) {
+        _processes.Set(p.first, p.second);
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+    auto scan_ms = std::chrono::duration_cast<std::chrono::milliseconds>(scan_time - start_time).count();
+    Logger::Info("ProcessTree: Populated %lu processes in %ld ms (%ld ms reading /proc using %lu threads)", processes.size(), total_ms, scan_ms, num_threads);
+    if (_populate_time_metric) {
+        _populate_time_metric->Set(static_cast<double>(total_ms));
+    }
 }
 
+// Called when filters are added or removed. The write lock is released between batches so that process events and
+// lookups are not stalled for the whole update, and only processes whose flags changed are replaced.
 void ProcessTree::UpdateFlags() {
-    std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
+    auto start_time = std::chrono::steady_clock::now();
 
-    for (auto p : _processes) {
-        ApplyFlags(p.second);
+    std::vector<int> pids;
+    _processes.ForEach([&pids](const std::shared_ptr<ProcessTreeItem>& process) {
+        pids.emplace_back(process->_pid);
+    });
+
+    size_t num_changed = 0;
+    for (size_t idx = 0; idx < pids.size(); idx += UPDATE_FLAGS_BATCH_SIZE) {
+        std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
+        auto end_idx = std::min(idx + UPDATE_FLAGS_BATCH_SIZE, pids.size());
+        for (auto i = idx; i < end_idx; ++i) {
+            auto p = _processes.Get(pids[i]);
+            if (!p) {
+                continue;
+            }
+            auto flags = ComputeFlags(*p);
+            if (flags != p->_flags) {
+                auto process = std::make_shared<ProcessTreeItem>(*p);
+                process->_flags = flags;
+                _processes.Set(process->_pid, process);
+                num_changed++;
+            }
+        }
     }
+
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    Logger::Info("ProcessTree: Updated filter flags of %lu processes (%lu changed) in %ld ms", pids.size(), num_changed, elapsed_ms);
 }
 
 // This utility method gets called only during the initial population of ProcessTree when a containerid shim process is identfied with non-empty value of _containeridfromhostprocess.
 // All of its childrens get assigned with the ContainerId value recursively.
 // ContainerId is not set for the containerid shim process.
-void ProcessTree::SetContainerId(std::shared_ptr<ProcessTreeItem> p, std::string containerid)
+void ProcessTree::SetContainerId(std::unordered_map<int, std::shared_ptr<ProcessTreeItem>>& processes, std::shared_ptr<ProcessTreeItem> p, const InternedString& containerid)
 {
     for (auto c : p->_children) {
-        auto it2 = _processes.find(c);
-        if (it2 != _processes.end()) {
+        auto it2 = processes.find(c);
+        if (it2 != processes.end()) {
             auto cp = it2->second;
             cp->_containerid = containerid;
-            SetContainerId(cp, containerid);
+            SetContainerId(processes, cp, containerid);
         }
     }
 }
@@ -578,20 +884,30 @@ std::shared_ptr<ProcessTreeItem> ProcessTree::ReadProcEntry(int pid)
     process->_uid = pinfo->uid();
     process->_gid = pinfo->gid();
     process->_ppid = pinfo->ppid();
-    process->_exe = pinfo->exe();
-    pinfo->format_cmdline(process->_cmdline);
-    process->_containeridfromhostprocess = ExtractContainerId(process->_exe, process->_cmdline);
+    std::string exe(pinfo->exe());
+    std::string cmdline;
+    pinfo->format_cmdline(cmdline);
+    process->_exe = _strings.Intern(exe);
+    process->_cmdline = _strings.Intern(cmdline);
+    process->_containeridfromhostprocess = _strings.Intern(ExtractContainerId(exe, cmdline));
     return process;
 }
 
 
 void ProcessTree::ShowTree()
 {
-    for (auto p : _processes) {
-        ShowProcess(p.second);
-        for (auto c : p.second->_children) {
-            if (_processes.count(c) > 0) {
-                auto p2 = _processes[c];
+    std::unique_lock<std::mutex> process_write_lock(_process_write_mutex);
+
+    std::vector<std::shared_ptr<ProcessTreeItem>> processes;
+    _processes.ForEach([&processes](const std::shared_ptr<ProcessTreeItem>& process) {
+        processes.emplace_back(process);
+    });
+
+    for (auto p : processes) {
+        ShowProcess(p);
+        for (auto c : p->_children) {
+            auto p2 = _processes.Get(c);
+            if (p2) {
                 printf("    => ");
                 ShowProcess(p2);
             }
@@ -601,17 +917,20 @@ void ProcessTree::ShowTree()
 
 void ProcessTree::ShowProcess(std::shared_ptr<ProcessTreeItem> p)
 {
-    if (_processes.count(p->_ppid) > 0) {
-        printf("%6d (%6d) [%d:%d] exe:'%s' cmdline:'%s' prop:%d (%s)\n", p->_pid, p->_ppid, p->_uid, p->_gid, p->_exe.c_str(), p->_cmdline.c_str(), p->_exec_propagation, _processes[p->_ppid]->_exe.c_str());
+    auto parent = _processes.Get(p->_ppid);
+    if (parent) {
+        printf("%6d (%6d) [%d:%d] exe:'%s' cmdline:'%s' prop:%d (%s)\n", p->_pid, p->_ppid, p->_uid, p->_gid, p->_exe.c_str(), p->_cmdline.c_str(), p->_exec_propagation, parent->_exe.c_str());
     } else {
         printf("%6d (%6d) [%d:%d] exe:'%s' cmdline:'%s' prop:%d\n", p->_pid, p->_ppid, p->_uid, p->_gid, p->_exe.c_str(), p->_cmdline.c_str(), p->_exec_propagation);
     }
     printf("  -> flags = %s\n", p->_flags.to_string().c_str());
     printf("  -> ");
-    for (auto i : p->_ancestors) {
-        printf("%s(%d), ", i.exe.c_str(), i.pid);
+    std::vector<const Ancestor*> ancestors;
+    for (auto anc = p->_ancestors.get(); anc != nullptr; anc = anc->parent.get()) {
+        ancestors.emplace_back(anc);
+    }
+    for (auto rit = ancestors.rbegin(); rit != ancestors.rend(); ++rit) {
+        printf("%s(%d), ", (*rit)->exe.c_str(), (*rit)->pid);
     }
     printf("%s(%d)\n", p->_exe.c_str(), p->_pid);
 }
-
-
@@ -21,10 +21,18 @@
 #include "UserDB.h"
 #include "ProcessDefines.h"
 #include "FiltersEngine.h"
+#include "InternedStrings.h"
+#include "Metrics.h"
 
+#include <array>
+#include <functional>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <queue>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <chrono>
 #include <algorithm>
 #include <fstream>
@@ -40,19 +48,30 @@
 enum ProcessTreeSource { ProcessTreeSource_execve, ProcessTreeSource_pnotify, ProcessTreeSource_procfs };
 
 class FiltersEngine;
+class FiltersSnapshot;
 
+// Immutable link in a process' ancestry, starting with the parent. A node is created once per (parent, exe) and
+// shared by all of that parent's descendants, so forks don't copy the ancestry.
 struct Ancestor {
+    Ancestor(int pid, const InternedString& exe, const std::shared_ptr<const Ancestor>& parent): pid(pid), exe(exe), parent(parent) {}
+
     int pid;
-    std::string exe;
+    InternedString exe;
+    std::shared_ptr<const Ancestor> parent;
 };
 
+// Once an item has been added to the ProcessTable, the fields read by consumers (_source, _uid, _gid, _exe, _cmdline,
+// _containerid, _ancestors and _flags) are never modified. Changes are made to a copy which then replaces the original.
+// The remaining fields (_children, _exec_propagation, _exited, _exit_time, _ancestor_node and the _match_* filter cache)
+// are only accessed with the ProcessTree's _process_write_mutex held.
 class ProcessTreeItem {
 public:
     ProcessTreeItem(enum ProcessTreeSource source, int pid, int ppid=0):
-        _source(source), _pid(pid), _ppid(ppid), _uid(-1), _gid(-1), _flags(0), _exec_propagation(0), _exited(false), _containerid("") {}
-    ProcessTreeItem(enum ProcessTreeSource source, int pid, int ppid, int uid, int gid, const std::string& exe, const std::string& cmdline):
-        _source(source), _pid(pid), _ppid(ppid), _uid(uid), _gid(gid), _exe(exe), _cmdline(cmdline), _containerid(""),
-        _flags(0), _exec_propagation(0), _exited(false) {}
+        _source(source), _pid(pid), _ppid(ppid), _uid(-1), _gid(-1), _exec_propagation(0), _exec_generation(0), _flags(0),
+        _match_filter_generation(0), _match_exec_generation(0), _exited(false) {}
+    ProcessTreeItem(enum ProcessTreeSource source, int pid, int ppid, int uid, int gid, const InternedString& exe, const InternedString& cmdline):
+        _source(source), _pid(pid), _ppid(ppid), _uid(uid), _gid(gid), _exe(exe), _cmdline(cmdline),
+        _exec_propagation(0), _exec_generation(0), _flags(0), _match_filter_generation(0), _match_exec_generation(0), _exited(false) {}
 
     enum ProcessTreeSource _source;
     int _pid;
@@ -60,22 +79,90 @@ public:
     int _uid;
     int _gid;
     std::vector<int> _children;
-    std::vector<struct Ancestor> _ancestors;
+    std::shared_ptr<const Ancestor> _ancestors;
+    std::shared_ptr<const Ancestor> _ancestor_node; // This process as an ancestor of its children
     unsigned int _exec_propagation;
-    std::string _exe;
-    std::string _containerid;
-    std::string _containeridfromhostprocess;
-    std::string _cmdline;
+    uint64_t _exec_generation; // Incremented whenever _uid, _gid, _exe or _cmdline change
+    InternedString _exe;
+    InternedString _containerid;
+    InternedString _containeridfromhostprocess;
+    InternedString _cmdline;
     std::bitset<FILTER_BITSET_SIZE> _flags;
+    // Cached FiltersEngine::GetMatchFlags() for the filter and exec generations it was computed at
+    std::bitset<FILTER_BITSET_SIZE> _match_flags;
+    uint64_t _match_filter_generation;
+    uint64_t _match_exec_generation;
     bool _exited;
-    std::chrono::system_clock::time_point _exit_time;
+    std::chrono::steady_clock::time_point _exit_time;
+};
+
+// Process table sharded by pid. A lookup only takes the shared lock of a single shard, so readers don't block each
+// other, and only contend with writers that are updating the same shard.
+class ProcessTable {
+public:
+    static constexpr size_t NUM_SHARDS = 64;
+
+    std::shared_ptr<ProcessTreeItem> Get(int pid) const;
+    void Set(int pid, const std::shared_ptr<ProcessTreeItem>& process);
+    bool Erase(int pid);
+    size_t Size() const;
+
+    // Calls fn for each process, holding the lock for each shard in turn. fn must not modify the table.
+    void ForEach(const std::function<void(const std::shared_ptr<ProcessTreeItem>&)>& fn) const;
+
+private:
+    struct Shard {
+        mutable std::shared_mutex _mutex;
+        std::unordered_map<int, std::shared_ptr<ProcessTreeItem>> _processes;
+    };
+
+    inline const Shard& shard(int pid) const { return _shards[static_cast<unsigned int>(pid) % NUM_SHARDS]; }
+    inline Shard& shard(int pid) { return _shards[static_cast<unsigned int>(pid) % NUM_SHARDS]; }
+
+    std::array<Shard, NUM_SHARDS> _shards;
 };
 
 class ProcessTree;
 
+enum ProcessQueueType { ProcessQueueFork, ProcessQueueExec, ProcessQueueExit, ProcessQueueForkExit };
+
+struct ProcessQueueItem {
+    enum ProcessQueueType type;
+    enum ProcessTreeSource source;
+    int pid;
+    int ppid;
+};
+
+// Bounded, lock-free, single producer (ProcessNotify) / single consumer (ProcessTree) queue.
+// The mutex and condition variable are only used to wake the consumer when it is waiting for data.
+class ProcessQueue {
+public:
+    static constexpr size_t CAPACITY = 64*1024; // Must be a power of 2
+
+    ProcessQueue(): _items(CAPACITY), _head(0), _tail(0), _waiting(false), _interrupted(false) {}
+
+    // Returns the number of items added. Items that don't fit are dropped.
+    size_t Push(const ProcessQueueItem* items, size_t num_items);
+    // Waits up to timeout milliseconds for data. Returns the number of items removed.
+    size_t Pop(ProcessQueueItem* items, size_t max_items, long timeout);
+    void Interrupt();
+
+private:
+    std::vector<ProcessQueueItem> _items;
+    std::atomic<size_t> _head; // Next item to read, only written by the consumer
+    std::atomic<size_t> _tail; // Next item to write, only written by the producer
+    std::atomic<bool> _waiting;
+    std::atomic<bool> _interrupted;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
+
 // Class that monitors pnotify events and writes them to ProcessTree queues
 class ProcessNotify: public RunBase {
 public:
+    static constexpr size_t RECV_BATCH_SIZE = 64;
+    static constexpr size_t RECV_BUFFER_SIZE = 1024;
+
     ProcessNotify(std::shared_ptr<ProcessTree> processTree): _processTree(processTree), _proc_socket(-1) {}
 
 protected:
@@ -84,31 +171,29 @@ protected:
 
 private:
     bool InitProcSocket();
+    void CoalesceTransient(std::vector<ProcessQueueItem>& items);
 
     std::shared_ptr<ProcessTree> _processTree;
     int _proc_socket;
-};
-
-enum ProcessQueueType { ProcessQueueFork, ProcessQueueExec, ProcessQueueExit };
-
-struct ProcessQueueItem {
-    enum ProcessQueueType type;
-    enum ProcessTreeSource source;
-    int pid;
-    int ppid;
+    std::unordered_map<int, size_t> _batch_forks;
 };
 
 // Class that manages the process tree
 class ProcessTree: public RunBase {
 public:
-    ProcessTree(const std::shared_ptr<UserDB>& user_db, std::shared_ptr<FiltersEngine> filtersEngine): _user_db(user_db), _filtersEngine(filtersEngine), _queue_data_ready(false)
+    ProcessTree(const std::shared_ptr<UserDB>& user_db, std::shared_ptr<FiltersEngine> filtersEngine, const std::shared_ptr<Metrics>& metrics = nullptr): _user_db(user_db), _filtersEngine(filtersEngine), _PnQueue_dropped(0)
     {
-        _last_clean_time = std::chrono::system_clock::now();
+        _last_clean_time = std::chrono::steady_clock::now();
+        _last_compact_time = _last_clean_time;
+        if (metrics) {
+            _processes_metric = metrics->AddMetric("process_tree", "processes", MetricPeriod::MINUTE, MetricPeriod::HOUR);
+            _memory_metric = metrics->AddMetric("process_tree", "memory_bytes", MetricPeriod::MINUTE, MetricPeriod::HOUR);
+            _strings_metric = metrics->AddMetric("process_tree", "interned_strings", MetricPeriod::MINUTE, MetricPeriod::HOUR);
+            _populate_time_metric = metrics->AddMetric("process_tree", "populate_time_ms", MetricPeriod::MINUTE, MetricPeriod::HOUR);
+        }
     }
 
-    void AddPnForkQueue(int pid, int ppid);
-    void AddPnExecQueue(int pid);
-    void AddPnExitQueue(int pid);
+    void AddPnQueue(const std::vector<ProcessQueueItem>& items);
     std::shared_ptr<ProcessTreeItem> AddProcess(enum ProcessTreeSource source, int pid, int ppid, int uid, int gid, std::string exe, const std::string& cmdline);
     void Clean();
     std::shared_ptr<ProcessTreeItem> GetInfoForPid(int pid);
@@ -122,6 +207,7 @@ protected:
     void run() override;
 
 private:
+    // Called with _process_write_mutex held
     void AddPid(int pid, int ppid);
     void AddPid(int pid);
     void RemovePid(int pid);
@@ -130,18 +216,28 @@ private:
     std::shared_ptr<ProcessTreeItem> ReadProcEntry(int pid);
     bool is_number(char *s);
     void ApplyFlags(std::shared_ptr<ProcessTreeItem> process);
-    void SetContainerId(std::shared_ptr<ProcessTreeItem> p, std::string containerid);
+    std::bitset<FILTER_BITSET_SIZE> ComputeFlags(ProcessTreeItem& process);
+    const std::bitset<FILTER_BITSET_SIZE>& MatchFlags(ProcessTreeItem& process, const FiltersSnapshot& filters);
+    std::shared_ptr<const Ancestor> AncestorNode(const std::shared_ptr<ProcessTreeItem>& process);
+    void SetContainerId(std::unordered_map<int, std::shared_ptr<ProcessTreeItem>>& processes, std::shared_ptr<ProcessTreeItem> p, const InternedString& containerid);
+    void report_metrics();
     std::string ExtractContainerId(std::string exe, const std::string& cmdline);
 
     std::shared_ptr<UserDB> _user_db;
     std::shared_ptr<FiltersEngine> _filtersEngine;
-    std::unordered_map<int, std::shared_ptr<ProcessTreeItem>> _processes;
-    bool _queue_data_ready;
-    std::mutex _queue_mutex;
+    ProcessTable _processes;
+    StringInterner _strings;
+    std::shared_ptr<Metric> _processes_metric;
+    std::shared_ptr<Metric> _memory_metric;
+    std::shared_ptr<Metric> _strings_metric;
+    std::shared_ptr<Metric> _populate_time_metric;
     std::mutex _process_write_mutex;
-    std::condition_variable _queue_data;
-    std::queue<struct ProcessQueueItem> _PnQueue;
-    std::chrono::system_clock::time_point _last_clean_time;
+    ProcessQueue _PnQueue;
+    std::atomic<uint64_t> _PnQueue_dropped;
+    std::chrono::steady_clock::time_point _last_clean_time;
+    std::chrono::steady_clock::time_point _last_compact_time;
+    // (expiry time, pid) of exited processes in exit order, guarded by _process_write_mutex
+    std::deque<std::pair<std::chrono::steady_clock::time_point, int>> _exit_queue;
 };
 
 #endif //AUOMS_PROCESSTREE_H
@@ -16,6 +16,7 @@
 #include "Queue.h"
 #include "Logger.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <chrono>
@@ -121,6 +122,7 @@ Queue::Queue(size_t size):
     memset(_ptr, 0, _data_size);
 
     _tail = _head = _saved_size = 0;
+    _head_cursor = QueueCursor::TAIL;
 }
 
 Queue::Queue(const std::string& path, size_t size):
@@ -132,6 +134,7 @@ Queue::Queue(const std::string& path, size_t size):
     _data_size = _file_size-FILE_DATA_OFFSET;
     _ptr = new char[_data_size];
     memset(_ptr, 0, _data_size);
+    _head_cursor = QueueCursor::TAIL;
 }
 
 Queue::~Queue()
@@ -156,6 +159,7 @@ void Queue::Open()
     }
 
     _tail = _head = _saved_size = 0;
+    _head_cursor = QueueCursor::TAIL;
 
     _fd = open(_path.c_str(), O_RDWR|O_CREAT|O_SYNC, 0600);
     if (_fd < 0) {
@@ -274,6 +278,21 @@ void Queue::Open()
     bhdr->id = 0;
     bhdr->state = HEAD;
 
+    // Find the newest item once here, after that commit_locked() keeps _head_cursor current
+    uint64_t index = _tail;
+    while (true) {
+        bhdr = reinterpret_cast<BlockHeader*>(_ptr+index);
+        if (bhdr->state == WRAP) {
+            index = 0;
+            bhdr = reinterpret_cast<BlockHeader*>(_ptr);
+        }
+        if (index == _head) {
+            break;
+        }
+        _head_cursor = QueueCursor(bhdr->id, index);
+        index += sizeof(BlockHeader) + bhdr->size;
+    }
+
     _closed = false;
 }
 
@@ -285,6 +304,7 @@ void Queue::Close(bool save)
 {
     std::unique_lock<std::mutex> lock(_lock);
     _closed = true;
+    notify_fds_locked();
 
     if (_path.empty()) {
         return;
@@ -321,6 +341,39 @@ void Queue::Interrupt() {
     std::unique_lock<std::mutex> lock(_lock);
     _int_id++;
     _cond.notify_all();
+    notify_fds_locked();
+}
+
+void Queue::AddNotifyFd(int fd) {
+    std::unique_lock<std::mutex> lock(_lock);
+    _notify_fds.emplace_back(fd, false);
+}
+
+void Queue::RemoveNotifyFd(int fd) {
+    std::unique_lock<std::mutex> lock(_lock);
+    _notify_fds.erase(std::remove_if(_notify_fds.begin(), _notify_fds.end(), [fd](const std::pair<int, bool>& e) { return e.first == fd; }), _notify_fds.end());
+}
+
+void Queue::ArmNotify(int fd) {
+    std::unique_lock<std::mutex> lock(_lock);
+    for (auto& e : _notify_fds) {
+        if (e.first == fd) {
+            e.second = true;
+        }
+    }
+}
+
+// Assumes queue is locked
+void Queue::notify_fds_locked() {
+    for (auto& e : _notify_fds) {
+        if (e.second) {
+            e.second = false;
+            uint64_t val = 1;
+            // Failure (e.g. EAGAIN because the counter is already non-zero) is harmless
+            auto ret = write(e.first, &val, sizeof(val));
+            (void)ret;
+        }
+    }
 }
 
 // Assumes queue is locked
@@ -436,6 +489,7 @@ void Queue::Reset() {
 
     _head = 0;
     _tail = 0;
+    _head_cursor = QueueCursor::TAIL;
     _int_id++;
 
     FileHeader after;
@@ -563,6 +617,7 @@ int Queue::commit_locked()
 
     hdr->state = ITEM;
     hdr->id = _next_id;
+    _head_cursor = QueueCursor(hdr->id, _head);
 
     _head += block_size;
     _next_id++;
@@ -573,6 +628,7 @@ int Queue::commit_locked()
     hdr->state = HEAD;
 
     _cond.notify_all();
+    notify_fds_locked();
 
     return 1;
 }
@@ -614,6 +670,15 @@ bool Queue::have_data(uint64_t *index)
     return this->_head != *index;
 }
 
+QueueCursor Queue::HeadCursor() {
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if (_tail == _head) {
+        return QueueCursor::TAIL;
+    }
+    return _head_cursor;
+}
+
 int Queue::Get(QueueCursor last, void*ptr, size_t* size, QueueCursor *item_cursor, int32_t milliseconds) {
     assert(ptr != nullptr);
     assert(size != nullptr);
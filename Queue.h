@@ -22,6 +22,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <vector>
 
 class QueueCursor {
 public:
@@ -80,6 +81,12 @@ public:
 
     void Interrupt();
 
+    // Register an eventfd that will be signaled when an item is added, or the queue is interrupted or closed.
+    // The fd is only signaled once per call to ArmNotify().
+    void AddNotifyFd(int fd);
+    void RemoveNotifyFd(int fd);
+    void ArmNotify(int fd);
+
     // Does not return until queue is closed.
     void Autosave(uint64_t min_save, int max_delay);
 
@@ -98,6 +105,10 @@ public:
     // item_cursor is the cursor for the item returned.
     int Get(QueueCursor last, void* ptr, size_t* size, QueueCursor* item_cursor, int32_t milliseconds);
 
+    // Return a cursor for the newest item, such that Get() will return the next item added.
+    // Unlike QueueCursor::HEAD, the returned cursor is also useful for non-blocking (milliseconds == 0) Get() calls.
+    QueueCursor HeadCursor();
+
 private:
     void save_locked(std::unique_lock<std::mutex>& lock);
     int allocate_locked(std::unique_lock<std::mutex>& lock, void** ptr, size_t size);
@@ -106,6 +117,7 @@ private:
     bool check_fit(size_t size);
     uint64_t unsaved_size();
     bool have_data(uint64_t *index);
+    void notify_fds_locked();
 
     std::string _path;
     uint64_t _file_size;
@@ -116,11 +128,13 @@ private:
     bool _closed;
     uint64_t _head; // Newest item
     uint64_t _tail; // Oldest item
+    QueueCursor _head_cursor; // Cursor of the newest committed item
     uint64_t _saved_size; // Amount currently saved
     bool _save_active; // Amount currently saved
     std::mutex _lock;
     std::condition_variable _cond;
     uint64_t _int_id;
+    std::vector<std::pair<int, bool>> _notify_fds;
 };
 
 
@@ -246,3 +246,61 @@ BOOST_AUTO_TEST_CASE( queue_reset ) {
         queue.Close(false);
     }
 }
+
+BOOST_AUTO_TEST_CASE( queue_head_cursor ) {
+    TempFile file("/tmp/QueueTests.");
+
+    int maxItemBeforeWrap = ((Queue::MIN_QUEUE_SIZE-FILE_HEADER_SIZE-ITEM_HEADER_SIZE) / (ITEM_HEADER_SIZE+1024));
+    QueueCursor last_cursor;
+
+    {
+        Queue queue(file.Path(), Queue::MIN_QUEUE_SIZE);
+
+        queue.Open();
+
+        BOOST_REQUIRE(queue.HeadCursor().IsTail());
+
+        std::array<char, 1024> data_in;
+        data_in.fill('\0');
+
+        // Wrap so that the head is before the tail
+        for (int i = 0; i < maxItemBeforeWrap+2; i++) {
+            data_in[0] = static_cast<char>(i);
+            auto ret = queue.Put(data_in.data(), data_in.size());
+            if (ret != 1) {
+                BOOST_FAIL("Queue::Put didn't return 1. Instead it returned: " + std::to_string(ret));
+            }
+        }
+
+        std::array<char, 1024> data_out;
+        QueueCursor cursor = QueueCursor::TAIL;
+        while (true) {
+            size_t size = data_out.size();
+            auto ret = queue.Get(cursor, data_out.data(), &size, &cursor, 1);
+            if (ret == Queue::TIMEOUT) {
+                break;
+            }
+            if (ret < 0) {
+                BOOST_FAIL("Unexpected Queue::Get return value: " + std::to_string(ret));
+            }
+            last_cursor = cursor;
+        }
+
+        BOOST_REQUIRE(queue.HeadCursor() == last_cursor);
+
+        queue.Close(true);
+    }
+
+    {
+        Queue queue(file.Path(), Queue::MIN_QUEUE_SIZE);
+        queue.Open();
+
+        BOOST_REQUIRE(queue.HeadCursor() == last_cursor);
+
+        queue.Reset();
+
+        BOOST_REQUIRE(queue.HeadCursor().IsTail());
+
+        queue.Close(false);
+    }
+}
@@ -0,0 +1,109 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUOMS_RAPIDJSONWRITER_H
+#define AUOMS_RAPIDJSONWRITER_H
+
+#include "StringUtils.h"
+
+#include <cstring>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+/*
+ * A rapidjson::Writer<rapidjson::StringBuffer> that escapes String() and Key() values itself.
+ *
+ * rapidjson::Writer escapes strings one char at a time. RapidJSONWriter finds the runs of chars that need no
+ * escaping with json_unescaped_prefix() and copies them in bulk. The remaining chars are escaped exactly the way
+ * rapidjson does it ('"', '\\', \b, \f, \n, \r, \t and \u00XX for other control chars), so the output is
+ * unchanged. Only Writer members and StringBuffer methods present in rapidjson 1.0.2 are used.
+ */
+class RapidJSONWriter: public rapidjson::Writer<rapidjson::StringBuffer> {
+public:
+    using rapidjson::Writer<rapidjson::StringBuffer>::Writer;
+
+    bool String(const Ch* str, rapidjson::SizeType length, bool copy = false) {
+        (void)copy;
+        Prefix(rapidjson::kStringType);
+        write_string(str, length);
+        return true;
+    }
+
+    bool String(const Ch* str) {
+        return String(str, static_cast<rapidjson::SizeType>(std::strlen(str)));
+    }
+
+    bool Key(const Ch* str, rapidjson::SizeType length, bool copy = false) {
+        return String(str, length, copy);
+    }
+
+    bool Key(const Ch* str) {
+        return String(str);
+    }
+
+private:
+    void write_string(const Ch* str, size_t length) {
+        static constexpr char hex_digits[] = "0123456789ABCDEF";
+
+        os_->Put('"');
+        size_t idx = 0;
+        while (idx < length) {
+            auto n = json_unescaped_prefix(str+idx, length-idx);
+            if (n > 0) {
+                std::memcpy(os_->Push(n), str+idx, n);
+                idx += n;
+                if (idx >= length) {
+                    break;
+                }
+            }
+            auto c = static_cast<unsigned char>(str[idx]);
+            os_->Put('\\');
+            switch (c) {
+                case '"':
+                case '\\':
+                    os_->Put(static_cast<char>(c));
+                    break;
+                case '\b':
+                    os_->Put('b');
+                    break;
+                case '\f':
+                    os_->Put('f');
+                    break;
+                case '\n':
+                    os_->Put('n');
+                    break;
+                case '\r':
+                    os_->Put('r');
+                    break;
+                case '\t':
+                    os_->Put('t');
+                    break;
+                default:
+                    os_->Put('u');
+                    os_->Put('0');
+                    os_->Put('0');
+                    os_->Put(hex_digits[c >> 4]);
+                    os_->Put(hex_digits[c & 0xF]);
+                    break;
+            }
+            ++idx;
+        }
+        os_->Put('"');
+    }
+};
+
+#endif //AUOMS_RAPIDJSONWRITER_H
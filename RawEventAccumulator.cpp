@@ -19,13 +19,68 @@
 #include "Translate.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <limits>
+
+using namespace std::literals;
+
+// Returns -1 if the value is empty or not a decimal number
+static int parse_count(std::string_view str) {
+    if (str.empty() || str.size() > 9) {
+        return -1;
+    }
+    int val = 0;
+    for (auto c: str) {
+        if (c < '0' || c > '9') {
+            return -1;
+        }
+        val = (val*10) + (c-'0');
+    }
+    return val;
+}
+
+static inline uint32_t elapsed_usec(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+    if (usec < 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min<int64_t>(usec, std::numeric_limits<uint32_t>::max()));
+}
+
+// Partially reorders samples
+static uint32_t percentile(std::vector<uint32_t>& samples, size_t pct) {
+    auto idx = ((samples.size()-1)*pct)/100;
+    std::nth_element(samples.begin(), samples.begin()+idx, samples.end());
+    return samples[idx];
+}
+
 bool RawEvent::AddRecord(std::unique_ptr<RawEventRecord> record) {
+    static auto SV_ITEMS = "items"sv;
+
     auto rtype = record->GetRecordType();
 
     if (rtype == RecordType::EOE) {
         return true;
     }
 
+    // The kernel emits the PROCTITLE record last, after the PATH records announced by the SYSCALL 'items' field.
+    // Once both have been seen the event is complete and there is no need to wait for the EOE record.
+    switch (rtype) {
+        case RecordType::SYSCALL:
+            if (_expected_path_records < 0) {
+                _expected_path_records = parse_count(record->FieldValue(SV_ITEMS));
+            }
+            break;
+        case RecordType::PATH:
+            _num_path_records++;
+            break;
+        case RecordType::PROCTITLE:
+            _proctitle_seen = true;
+            break;
+        default:
+            break;
+    }
+
     if (rtype == RecordType::EXECVE) {
         _num_execve_records++;
         if (_num_execve_records == 1) {
@@ -62,6 +117,10 @@ bool RawEvent::AddRecord(std::unique_ptr<RawEventRecord> record) {
         }
     }
 
+    if (_proctitle_seen && _expected_path_records >= 0 && _num_path_records >= _expected_path_records) {
+        return true;
+    }
+
     return IsSingleRecordEvent(rtype);
 }
 
@@ -131,8 +190,9 @@ int RawEvent::AddEvent(EventBuilder& builder) {
 int RawEventAccumulator::AddRecord(std::unique_ptr<RawEventRecord> record) {
     std::lock_guard<std::mutex> lock(_mutex);
 
-    _bytes_metric->Add(static_cast<double>(record->GetSize()));
-    _record_metric->Add(1.0);
+    auto now = std::chrono::steady_clock::now();
+    _pending_bytes += record->GetSize();
+    _pending_records++;
 
     // Drop empty records unless it is the EOE record.
     if (record->IsEmpty() && record->GetRecordType() != RecordType::EOE) {
@@ -140,54 +200,137 @@ int RawEventAccumulator::AddRecord(std::unique_ptr<RawEventRecord> record) {
     }
 
     auto event_id = record->GetEventId();
-    int ret = 0;
-    auto found = _events.on(event_id, [this,&record,&ret](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, std::shared_ptr<RawEvent>& event) {
+    auto found = _events.on(event_id, [this,&record,now](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, std::shared_ptr<RawEvent>& event) {
+        if (_gap_samples.size() < MAX_SAMPLES) {
+            _gap_samples.push_back(elapsed_usec(event->LastRecordTime(), now));
+        }
+        event->SetLastRecordTime(now);
         if (event->AddRecord(std::move(record))) {
-            ret = event->AddEvent(*_builder);
+            emit_event(*event, now);
             return CacheEntryOP::REMOVE;
         } else {
             return CacheEntryOP::TOUCH;
         }
     });
     if (!found) {
-        auto event = std::make_shared<RawEvent>(record->GetEventId());
+        // The event was already completed by its last record
+        if (record->GetRecordType() == RecordType::EOE) {
+            return 1;
+        }
+        auto event = std::make_shared<RawEvent>(event_id, now);
         if (event->AddRecord(std::move(record))) {
-            _event_metric->Add(1.0);
+            _pending_events++;
             return event->AddEvent(*_builder);
         } else {
             _events.add(event_id, event);
         }
     }
+
     // Don't wait for Flush to be called, preemptively flush oldest if the cache size limit is exceeded
-    _events.for_all_oldest_first([this](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
-        if (entry_count > MAX_CACHE_ENTRY) {
-            event->AddEvent(*_builder);
-            _event_metric->Add(1.0);
-            return CacheEntryOP::REMOVE;
-        }
-        return CacheEntryOP::STOP;
-    });
+    if (_events.size() > MAX_CACHE_ENTRY) {
+        _events.for_all_oldest_first([this,now](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
+            if (entry_count > MAX_CACHE_ENTRY) {
+                emit_event(*event, now);
+                return CacheEntryOP::REMOVE;
+            }
+            return CacheEntryOP::STOP;
+        });
+    }
+
+    // Flush() is only called when input is idle, so expire events here too when records arrive continuously.
+    if (_max_flush_timeout > 0 && now - _last_expire_check >= std::chrono::milliseconds(EXPIRE_CHECK_INTERVAL)) {
+        expire_events(now);
+    }
+    if (now - _last_report >= std::chrono::milliseconds(REPORT_INTERVAL)) {
+        report_locked(now);
+    }
     return 1;
 }
 
 void RawEventAccumulator::Flush(long milliseconds) {
-    if (milliseconds > 0) {
-        auto now = std::chrono::steady_clock::now();
-        std::lock_guard<std::mutex> lock(_mutex);
+    std::lock_guard<std::mutex> lock(_mutex);
 
-        _events.for_all_oldest_first([this,now,milliseconds](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
-            if (entry_count > MAX_CACHE_ENTRY || std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()-last_touched.time_since_epoch()) > std::chrono::milliseconds(milliseconds)) {
-                event->AddEvent(*_builder);
-                _event_metric->Add(1.0);
-                return CacheEntryOP::REMOVE;
-            }
-            return CacheEntryOP::STOP;
-        });
+    auto now = std::chrono::steady_clock::now();
+    if (milliseconds > 0) {
+        _max_flush_timeout = milliseconds;
+        expire_events(now);
+        if (now - _last_report >= std::chrono::milliseconds(REPORT_INTERVAL)) {
+            report_locked(now);
+        }
     } else {
-        _events.for_all_oldest_first([this](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
-            event->AddEvent(*_builder);
-            _event_metric->Add(1.0);
+        _events.for_all_oldest_first([this,now](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
+            emit_event(*event, now);
             return CacheEntryOP::REMOVE;
         });
+        report_locked(now);
+    }
+}
+
+long RawEventAccumulator::flush_timeout() {
+    if (_flush_timeout > 0 && _flush_timeout < _max_flush_timeout) {
+        return _flush_timeout;
+    }
+    return _max_flush_timeout;
+}
+
+int RawEventAccumulator::emit_event(RawEvent& event, std::chrono::steady_clock::time_point now) {
+    _pending_events++;
+    if (_latency_samples.size() < MAX_SAMPLES) {
+        _latency_samples.push_back(elapsed_usec(event.FirstRecordTime(), now));
+    }
+    return event.AddEvent(*_builder);
+}
+
+void RawEventAccumulator::expire_events(std::chrono::steady_clock::time_point now) {
+    _last_expire_check = now;
+    if (_events.empty()) {
+        return;
+    }
+
+    auto timeout = std::chrono::milliseconds(flush_timeout());
+    _events.for_all_oldest_first([this,now,timeout](size_t entry_count, const std::chrono::steady_clock::time_point& last_touched, const EventId& key, std::shared_ptr<RawEvent>& event) {
+        if (entry_count > MAX_CACHE_ENTRY || now - last_touched > timeout) {
+            emit_event(*event, now);
+            return CacheEntryOP::REMOVE;
+        }
+        return CacheEntryOP::STOP;
+    });
+}
+
+// Metric::Add() takes a lock and reads the clock, so counts are accumulated locally and reported in batches.
+void RawEventAccumulator::report_locked(std::chrono::steady_clock::time_point now) {
+    _last_report = now;
+
+    _bytes_metric->Add(static_cast<double>(_pending_bytes));
+    _record_metric->Add(static_cast<double>(_pending_records));
+    _event_metric->Add(static_cast<double>(_pending_events));
+    _pending_bytes = 0;
+    _pending_records = 0;
+    _pending_events = 0;
+
+    if (!_latency_samples.empty()) {
+        _latency_p50_metric->Set(static_cast<double>(percentile(_latency_samples, 50))/1000.0);
+        _latency_p99_metric->Set(static_cast<double>(percentile(_latency_samples, 99))/1000.0);
+        _latency_samples.clear();
+    }
+
+    // Records of one event are normally emitted back to back, so a small multiple of the p99 gap between them is
+    // enough to decide that no more records are coming. The timeout follows an increase in the gap right away,
+    // but only moves a quarter of the way towards a smaller gap each interval, so one quiet second doesn't make
+    // it split the events of a following burst.
+    if (_gap_samples.size() >= MIN_GAP_SAMPLES) {
+        long gap_ms = static_cast<long>((percentile(_gap_samples, 99)+999)/1000);
+        auto timeout = std::max(MIN_FLUSH_TIMEOUT, gap_ms*GAP_TIMEOUT_MULTIPLIER);
+        if (_flush_timeout <= 0 || timeout >= _flush_timeout) {
+            _flush_timeout = timeout;
+        } else {
+            _flush_timeout = (_flush_timeout*3 + timeout)/4;
+        }
+        _gap_samples.clear();
+    }
+
+    if (_max_flush_timeout > 0) {
+        _flush_timeout_metric->Set(static_cast<double>(flush_timeout()));
     }
+    _held_events_metric->Set(static_cast<double>(_events.size()));
 }
@@ -22,6 +22,8 @@
 #include "Cache.h"
 
 #include <mutex>
+#include <chrono>
+#include <vector>
 
 class RawEvent {
 public:
@@ -31,9 +33,13 @@ public:
     static constexpr size_t NUM_EXECVE_RH_PRESERVE = 3;
 
     RawEvent() = delete;
-    explicit RawEvent(EventId event_id): _event_id(event_id), _num_execve_records(0), _num_dropped_records(0), _syscall_rec_idx(-1), _size(0), _execve_size(0) {}
+    RawEvent(EventId event_id, std::chrono::steady_clock::time_point now): _event_id(event_id), _num_execve_records(0), _num_dropped_records(0), _syscall_rec_idx(-1), _size(0), _execve_size(0),
+        _expected_path_records(-1), _num_path_records(0), _proctitle_seen(false), _first_record_time(now), _last_record_time(now) {}
 
     inline EventId GetEventId() { return _event_id; }
+    inline std::chrono::steady_clock::time_point FirstRecordTime() { return _first_record_time; }
+    inline std::chrono::steady_clock::time_point LastRecordTime() { return _last_record_time; }
+    inline void SetLastRecordTime(std::chrono::steady_clock::time_point now) { _last_record_time = now; }
 
     // Returns true if the event is now complete;
     bool AddRecord(std::unique_ptr<RawEventRecord> record);
@@ -50,28 +56,71 @@ private:
     int _syscall_rec_idx;
     size_t _size;
     size_t _execve_size;
+    int _expected_path_records;
+    int _num_path_records;
+    bool _proctitle_seen;
+    std::chrono::steady_clock::time_point _first_record_time;
+    std::chrono::steady_clock::time_point _last_record_time;
 };
 
 class RawEventAccumulator {
 public:
-    explicit RawEventAccumulator(const std::shared_ptr<EventBuilder>& builder, const std::shared_ptr<Metrics>& metrics): _builder(builder), _metrics(metrics) {
+    // The adaptive timeout never goes below the fixed flush period that was used before it adapted
+    static constexpr long MIN_FLUSH_TIMEOUT = 100; // milliseconds
+    static constexpr long GAP_TIMEOUT_MULTIPLIER = 4;
+    static constexpr long EXPIRE_CHECK_INTERVAL = 20; // milliseconds
+
+    explicit RawEventAccumulator(const std::shared_ptr<EventBuilder>& builder, const std::shared_ptr<Metrics>& metrics): _builder(builder), _metrics(metrics),
+        _pending_bytes(0), _pending_records(0), _pending_events(0), _max_flush_timeout(-1), _flush_timeout(-1), _last_report(std::chrono::steady_clock::now()), _last_expire_check(_last_report) {
         _bytes_metric = _metrics->AddMetric("raw_data", "bytes", MetricPeriod::SECOND, MetricPeriod::HOUR);
         _record_metric = _metrics->AddMetric("raw_data", "records", MetricPeriod::SECOND, MetricPeriod::HOUR);
         _event_metric = _metrics->AddMetric("raw_data", "events", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        _latency_p50_metric = _metrics->AddMetric("raw_data", "accumulation_latency_p50_ms", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        _latency_p99_metric = _metrics->AddMetric("raw_data", "accumulation_latency_p99_ms", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        _flush_timeout_metric = _metrics->AddMetric("raw_data", "flush_timeout_ms", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        _held_events_metric = _metrics->AddMetric("raw_data", "held_events", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        _latency_samples.reserve(MAX_SAMPLES);
+        _gap_samples.reserve(MAX_SAMPLES);
     }
 
     int AddRecord(std::unique_ptr<RawEventRecord> record);
+
+    // Emit events that have not received a record within the flush timeout.
+    // The timeout adapts to the observed gaps between records of the same event, and is capped at milliseconds.
+    // If milliseconds is <= 0, all pending events are emitted.
     void Flush(long milliseconds);
 
 private:
     static constexpr size_t MAX_CACHE_ENTRY = 256;
+    static constexpr size_t MAX_SAMPLES = 1024;
+    static constexpr size_t MIN_GAP_SAMPLES = 64;
+    static constexpr long REPORT_INTERVAL = 1000; // milliseconds
+
+    long flush_timeout();
+    int emit_event(RawEvent& event, std::chrono::steady_clock::time_point now);
+    void expire_events(std::chrono::steady_clock::time_point now);
+    void report_locked(std::chrono::steady_clock::time_point now);
+
     std::mutex _mutex;
     std::shared_ptr<EventBuilder> _builder;
     std::shared_ptr<Metrics> _metrics;
     std::shared_ptr<Metric> _bytes_metric;
     std::shared_ptr<Metric> _record_metric;
     std::shared_ptr<Metric> _event_metric;
+    std::shared_ptr<Metric> _latency_p50_metric;
+    std::shared_ptr<Metric> _latency_p99_metric;
+    std::shared_ptr<Metric> _flush_timeout_metric;
+    std::shared_ptr<Metric> _held_events_metric;
     Cache<EventId, std::shared_ptr<RawEvent>> _events;
+    size_t _pending_bytes;
+    size_t _pending_records;
+    size_t _pending_events;
+    long _max_flush_timeout;
+    long _flush_timeout;
+    std::vector<uint32_t> _latency_samples; // microseconds
+    std::vector<uint32_t> _gap_samples; // microseconds
+    std::chrono::steady_clock::time_point _last_report;
+    std::chrono::steady_clock::time_point _last_expire_check;
 };
 
 
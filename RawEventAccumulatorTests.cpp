@@ -0,0 +1,136 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "RawEventAccumulatorTests"
+#include <boost/test/unit_test.hpp>
+
+#include "Logger.h"
+#include "RawEventAccumulator.h"
+#include "TestEventQueue.h"
+
+#include <cstring>
+#include <thread>
+
+class AccumulatorTest {
+public:
+    AccumulatorTest() {
+        _raw_queue = std::make_shared<TestEventQueue>();
+        auto raw_builder = std::make_shared<EventBuilder>(_raw_queue);
+
+        auto metrics_queue = std::make_shared<TestEventQueue>();
+        auto metrics_builder = std::make_shared<EventBuilder>(metrics_queue);
+        auto metrics = std::make_shared<Metrics>(metrics_builder);
+
+        _accumulator = std::make_unique<RawEventAccumulator>(raw_builder, metrics);
+    }
+
+    void Add(const std::string& line) {
+        std::unique_ptr<RawEventRecord> record = std::make_unique<RawEventRecord>();
+        std::memcpy(record->Data(), line.data(), line.size());
+        BOOST_REQUIRE_MESSAGE(record->Parse(RecordType::UNKNOWN, line.size()), "Failed to parse: " << line);
+        _accumulator->AddRecord(std::move(record));
+    }
+
+    void Flush(long milliseconds) {
+        _accumulator->Flush(milliseconds);
+    }
+
+    size_t EventCount() {
+        return _raw_queue->GetEventCount();
+    }
+
+    Event GetEvent(int idx) {
+        return _raw_queue->GetEvent(idx);
+    }
+
+private:
+    std::shared_ptr<TestEventQueue> _raw_queue;
+    std::unique_ptr<RawEventAccumulator> _accumulator;
+};
+
+BOOST_AUTO_TEST_CASE( proctitle_and_items_complete_event ) {
+    AccumulatorTest test;
+
+    test.Add(R"(type=SYSCALL msg=audit(1.001:10): arch=c000003e syscall=2 success=yes exit=3 a0=1 a1=2 a2=3 a3=4 items=2 ppid=1 pid=2 uid=0 gid=0 comm="cat" exe="/bin/cat")");
+    test.Add(R"(type=CWD msg=audit(1.001:10): cwd="/root")");
+    test.Add(R"(type=PATH msg=audit(1.001:10): item=0 name="/etc/" inode=1 mode=040755 ouid=0 ogid=0 nametype=PARENT)");
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 0);
+    // The PROCTITLE record arrives before all the PATH records
+    test.Add(R"(type=PROCTITLE msg=audit(1.001:10): proctitle=636174)");
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 0);
+    test.Add(R"(type=PATH msg=audit(1.001:10): item=1 name="/etc/passwd" inode=2 mode=0100644 ouid=0 ogid=0 nametype=NORMAL)");
+
+    // Complete without an EOE or a flush
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 1);
+    auto event = test.GetEvent(0);
+    BOOST_REQUIRE_EQUAL(event.Serial(), 10);
+    BOOST_REQUIRE_EQUAL(event.NumRecords(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( trailing_eoe_ignored ) {
+    AccumulatorTest test;
+
+    test.Add(R"(type=SYSCALL msg=audit(1.001:11): arch=c000003e syscall=2 success=yes exit=3 a0=1 a1=2 a2=3 a3=4 items=0 ppid=1 pid=2 uid=0 gid=0 comm="cat" exe="/bin/cat")");
+    test.Add(R"(type=PROCTITLE msg=audit(1.001:11): proctitle=636174)");
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 1);
+
+    // The EOE must neither start a new event nor re-emit the completed one
+    test.Add(R"(type=EOE msg=audit(1.001:11): )");
+    test.Flush(0);
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 1);
+    BOOST_REQUIRE_EQUAL(test.GetEvent(0).NumRecords(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( incomplete_event_expires ) {
+    AccumulatorTest test;
+
+    // Waiting for the PATH record that never arrives
+    test.Add(R"(type=SYSCALL msg=audit(1.001:12): arch=c000003e syscall=2 success=yes exit=3 a0=1 a1=2 a2=3 a3=4 items=1 ppid=1 pid=2 uid=0 gid=0 comm="cat" exe="/bin/cat")");
+    test.Add(R"(type=PROCTITLE msg=audit(1.001:12): proctitle=636174)");
+    test.Flush(50);
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    test.Flush(50);
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 1);
+    BOOST_REQUIRE_EQUAL(test.GetEvent(0).NumRecords(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( adaptive_timeout_floor ) {
+    AccumulatorTest test;
+
+    // Many events whose records arrive back to back, the adapted timeout must not drop below the floor.
+    uint64_t serial = 100;
+    for (int i = 0; i < 200; ++i, ++serial) {
+        test.Add("type=SYSCALL msg=audit(1.001:" + std::to_string(serial) + "): arch=c000003e syscall=2 success=yes exit=3 a0=1 a1=2 a2=3 a3=4 items=0 ppid=1 pid=2 uid=0 gid=0");
+        test.Add("type=PROCTITLE msg=audit(1.001:" + std::to_string(serial) + "): proctitle=636174");
+    }
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 200);
+
+    // Let the accumulator recompute the timeout from the gap samples
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    test.Flush(1000);
+
+    test.Add("type=SYSCALL msg=audit(1.001:" + std::to_string(serial) + "): arch=c000003e syscall=2 success=yes exit=3 a0=1 a1=2 a2=3 a3=4 items=1 ppid=1 pid=2 uid=0 gid=0");
+    // A much smaller timeout would have split events whose records are delayed by a scheduling hiccup
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    test.Flush(1000);
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 200);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(RawEventAccumulator::MIN_FLUSH_TIMEOUT));
+    test.Flush(1000);
+    BOOST_REQUIRE_EQUAL(test.EventCount(), 201);
+}
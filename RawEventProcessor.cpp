@@ -26,10 +26,6 @@
 #include <algorithm>
 #include <iterator>
 
-// Character that separates key in AUDIT_FILTERKEY field in rules
-// This value mirrors what is defined for AUDIT_KEY_SEPARATOR in libaudit.h
-#define KEY_SEP 0x01
-
 #define PROCESS_INVENTORY_EVENT_INTERVAL 3600
 
 void RawEventProcessor::ProcessData(const void* data, size_t data_len) {
@@ -148,6 +144,9 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     static auto SV_PID = "pid"sv;
     static auto SV_PPID = "ppid"sv;
     static auto SV_SYSCALL = "syscall"sv;
+    static auto SV_UID = "uid"sv;
+    static auto SV_GID = "gid"sv;
+    static auto SV_EXE = "exe"sv;
     static auto SV_PROCTITLE = "proctitle"sv;
     static auto S_EXECVE = std::string("execve");
     static auto SV_JSON_ARRAY_START = "[\""sv;
@@ -158,12 +157,8 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     static auto auoms_execve_name = RecordTypeToName(RecordType::AUOMS_EXECVE);
 
     int num_fields = 0;
-    int num_path = 0;
-    int num_execve = 0;
-    int uid;
-    int gid;
-    std::string exe;
-    std::string syscall;
+    int uid = -1;
+    int gid = -1;
 
     auto rec_type = RecordType::AUOMS_SYSCALL_FRAGMENT;
     auto rec_type_name = auoms_syscall_fragment_name;
@@ -173,8 +168,6 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     EventRecord cwd_rec;
     EventRecordField cwd_field;
     EventRecord path_rec;
-    std::vector<EventRecord> path_recs;
-    std::vector<EventRecord> execve_recs;
     EventRecord argc_rec;
     EventRecordField argc_field;
     EventRecord sockaddr_rec;
@@ -184,133 +177,105 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     EventRecord proctitle_rec;
     EventRecordField proctitle_field;
     EventRecord dropped_rec;
-    std::vector<EventRecord> other_recs;
 
+    // These keep their capacity across events so that collecting the records doesn't allocate.
+    _path_recs.clear();
+    _path_order.clear();
+    _execve_recs.clear();
+    _other_recs.clear();
+
+    // The fields of interest are located with FieldByName (binary search on the sorted field index) rather than
+    // by scanning and comparing every field name.
     for (auto& rec: event) {
         switch(static_cast<RecordType>(rec.RecordType())) {
             case RecordType::SYSCALL:
-                if (!syscall_rec) {
+                if (!syscall_rec && rec.NumFields() > 0) {
                     rec_type = RecordType::AUOMS_SYSCALL;
                     rec_type_name = auoms_syscall_name;
-                    for (auto &f : rec) {
-                        auto fname = f.FieldName();
-                        switch (fname[0]) {
-                            case 't': {
-                                if (fname != SV_TYPE) {
-                                    num_fields += 1;
-                                }
-                                break;
-                            }
-                            case 'i': {
-                                if (fname != SV_ITEMS) {
-                                    num_fields += 1;
-                                }
-                                break;
-                            }
-                            case 's': {
-                                if (fname == SV_SYSCALL) {
-                                    syscall_field = f;
-                                }
-                                num_fields += 1;
-                                break;
-                            }
-                            default:
-                                num_fields += 1;
-                                break;
-                        }
-                    }
                     syscall_rec = rec;
+                    syscall_field = rec.FieldByName(SV_SYSCALL);
+                    // All fields except type and items are included
+                    num_fields += rec.NumFields();
+                    if (rec.FieldByName(SV_TYPE)) {
+                        num_fields -= 1;
+                    }
+                    if (rec.FieldByName(SV_ITEMS)) {
+                        num_fields -= 1;
+                    }
                 }
                 break;
             case RecordType::EXECVE: {
                 if (rec.NumFields() > 0) {
-                    if (num_execve == 0) {
+                    if (_execve_recs.empty()) {
                         num_fields += 1;
-                        if (!argc_rec) {
-                            // the argc field should be the first (or second if node field is present) field in the record but check the first four just in case
-                            for(uint16_t i = 0; i < rec.NumFields() && i < 4 ; i++) {
-                                auto field = rec.FieldAt(i);
-                                if (field.FieldName() == SV_ARGC) {
-                                    num_fields += 1;
-                                    argc_rec = rec;
-                                    argc_field = field;
-                                    break;
-                                }
-                            }
+                        // the argc field should be in the first EXECVE record
+                        argc_field = rec.FieldByName(SV_ARGC);
+                        if (argc_field) {
+                            num_fields += 1;
+                            argc_rec = rec;
                         }
                     }
-                    num_execve += 1;
-                    execve_recs.emplace_back(rec);
+                    _execve_recs.emplace_back(rec);
                 }
                 break;
             }
             case RecordType::CWD:
-                if (!cwd_rec) {
-                    for (int i = 0; i < rec.NumFields(); ++i) {
-                        auto field = rec.FieldAt(i);
-                        if (field.FieldName() == SV_CWD) {
-                            num_fields += 1;
-                            cwd_rec = rec;
-                            cwd_field = field;
-                            break;
-                        }
+                if (!cwd_rec && rec.NumFields() > 0) {
+                    cwd_field = rec.FieldByName(SV_CWD);
+                    if (cwd_field) {
+                        num_fields += 1;
+                        cwd_rec = rec;
                     }
                 }
                 break;
             case RecordType::PATH:
                 if (rec.NumFields() > 0) {
-                    if (num_path == 0) {
+                    if (_path_recs.empty()) {
                         // This assumes there will only be a nametype field or an objtype field but never both
                         num_fields += 5; // name, mode, ouid, ogid, (nametype or objtype)
                     }
-                    num_path += 1;
-                    path_recs.emplace_back(rec);
-                    if (!path_rec) {
-                        for (auto& f: rec) {
-                            if (f.FieldName() == SV_ITEM && f.RawValue() == SV_ZERO) {
-                                num_fields += rec.NumFields()-1; // exclude item
-                                path_rec = rec;
-                                break;
-                            }
+                    // PATH records with a missing or invalid item value should be sorted to the end
+                    int item = INT32_MAX;
+                    auto item_field = rec.FieldByName(SV_ITEM);
+                    if (item_field) {
+                        char* end = nullptr;
+                        auto val = strtol(item_field.RawValuePtr(), &end, 10);
+                        if (end != item_field.RawValuePtr() && *end == 0 && val >= 0 && val < INT32_MAX) {
+                            item = static_cast<int>(val);
+                        }
+                        if (!path_rec && item_field.RawValue() == SV_ZERO) {
+                            num_fields += rec.NumFields()-1; // exclude item
+                            path_rec = rec;
                         }
                     }
+                    _path_order.emplace_back(item, _path_recs.size());
+                    _path_recs.emplace_back(rec);
                 }
                 break;
             case RecordType::SOCKADDR:
-                if (!sockaddr_rec) {
-                    for (int i = 0; i < rec.NumFields(); ++i) {
-                        auto field = rec.FieldAt(i);
-                        if (field.FieldName() == SV_SADDR) {
-                            sockaddr_rec = rec;
-                            sockaddr_field = field;
-                            num_fields += 1;
-                            break;
-                        }
+                if (!sockaddr_rec && rec.NumFields() > 0) {
+                    sockaddr_field = rec.FieldByName(SV_SADDR);
+                    if (sockaddr_field) {
+                        num_fields += 1;
+                        sockaddr_rec = rec;
                     }
                 }
                 break;
             case RecordType::INTEGRITY_RULE:
-                if (!integrity_rec) {
-                    for (int i = 0; i < rec.NumFields(); ++i) {
-                        auto field = rec.FieldAt(i);
-                        if (field.FieldName() == SV_INTEGRITY_HASH) {
-                            integrity_rec = rec;
-                            integrity_field = field;
-                            num_fields += 1;
-                        }
+                if (!integrity_rec && rec.NumFields() > 0) {
+                    integrity_field = rec.FieldByName(SV_INTEGRITY_HASH);
+                    if (integrity_field) {
+                        num_fields += 1;
+                        integrity_rec = rec;
                     }
                 }
                 break;
             case RecordType::PROCTITLE:
-                if (!proctitle_rec) {
-                    for (int i = 0; i < rec.NumFields(); ++i) {
-                        auto field = rec.FieldAt(i);
-                        if (field.FieldName() == SV_PROCTITLE) {
-                            num_fields += 1;
-                            proctitle_rec = rec;
-                            proctitle_field = field;
-                            break;
-                        }
+                if (!proctitle_rec && rec.NumFields() > 0) {
+                    proctitle_field = rec.FieldByName(SV_PROCTITLE);
+                    if (proctitle_field) {
+                        num_fields += 1;
+                        proctitle_rec = rec;
                     }
                 }
                 break;
@@ -320,39 +285,20 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
             default:
                 if (rec.NumFields() > 0) {
                     num_fields += rec.NumFields();
-                    other_recs.emplace_back(rec);
+                    _other_recs.emplace_back(rec);
                 }
                 break;
         }
     }
 
     // Sort PATH records by item field
-    std::sort(path_recs.begin(), path_recs.end(), [](const EventRecord& a, const EventRecord& b) -> int {
-        auto fa = a.FieldByName(SV_ITEM);
-        auto fb = b.FieldByName(SV_ITEM);
-        int a_num = INT32_MAX; // PATH records with a missing or invalid item value should be sorted to the end;
-        int b_num = INT32_MAX;
-
-        if (fa) {
-            try {
-                a_num = std::stoi(std::string(fa.FieldName()));
-            } catch (std::logic_error&) {
-                // Ignore
-            }
-        }
-
-        if (fb) {
-            try {
-                b_num = std::stoi(std::string(fb.FieldName()));
-            } catch (std::logic_error&) {
-                // Ignore
-            }
-        }
-
-        return a_num > b_num;
-    });
+    std::sort(_path_order.begin(), _path_order.end());
 
+    _syscall.resize(0);
+    _syscall_mtype = MachineType::UNKNOWN;
+    _syscall_nr = -1;
     if (syscall_rec && syscall_field) {
+        FieldToSyscall(syscall_rec, syscall_field, _syscall_mtype, _syscall_nr);
         if (InterpretField(_tmp_val, syscall_rec, syscall_field, field_type_t::SYSCALL)) {
             if (starts_with(_tmp_val, S_EXECVE)) {
                 rec_type = RecordType::AUOMS_EXECVE;
@@ -363,7 +309,7 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     }
 
     // Exclude proctitle if EXECVE is present
-    if (execve_recs.size() > 0 && proctitle_rec && proctitle_field) {
+    if (!_execve_recs.empty() && proctitle_rec && proctitle_field) {
         num_fields -= 1;
     }
 
@@ -392,56 +338,34 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
         return false;
     }
 
-    if (syscall_rec) {
+    if (syscall_rec && syscall_rec.NumFields() > 0) {
+        auto pid_field = syscall_rec.FieldByName(SV_PID);
+        if (pid_field) {
+            _pid = atoi(pid_field.RawValuePtr());
+            _builder->SetEventPid(_pid);
+        }
+        auto ppid_field = syscall_rec.FieldByName(SV_PPID);
+        if (ppid_field) {
+            _ppid = atoi(ppid_field.RawValuePtr());
+        }
+        auto uid_field = syscall_rec.FieldByName(SV_UID);
+        if (uid_field) {
+            uid = atoi(uid_field.RawValuePtr());
+        }
+        auto gid_field = syscall_rec.FieldByName(SV_GID);
+        if (gid_field) {
+            gid = atoi(gid_field.RawValuePtr());
+        }
+        auto exe_field = syscall_rec.FieldByName(SV_EXE);
+        if (exe_field) {
+            _exe.assign(exe_field.RawValue());
+        } else {
+            _exe.resize(0);
+        }
+
         for (auto &f : syscall_rec) {
             auto fname = f.FieldName();
-            bool add_field = false;
-            switch (fname[0]) {
-                case 't': {
-                    if (fname != SV_TYPE) {
-                        add_field = true;
-                    }
-                    break;
-                }
-                case 'i': {
-                    if (fname != SV_ITEMS) {
-                        add_field = true;
-                    }
-                    break;
-                }
-                case 'p':
-                    if (fname == SV_PID) {
-                        _pid = atoi(f.RawValuePtr());
-                        _builder->SetEventPid(_pid);
-                    }
-                    if (fname == SV_PPID) {
-                        _ppid = atoi(f.RawValuePtr());
-                    }
-                    add_field = true;
-                    break;
-                case 'u':
-                    if (fname == "uid") {
-                        uid = atoi(f.RawValuePtr());
-                    }
-                    add_field = true;
-                    break;
-                case 'g':
-                    if (fname == "gid") {
-                        gid = atoi(f.RawValuePtr());
-                    }
-                    add_field = true;
-                    break;
-                case 'e':
-                    if (fname == "exe") {
-                        exe = std::string(f.RawValuePtr());
-                    }
-                    add_field = true;
-                    break;
-                default:
-                    add_field = true;
-                    break;
-            }
-            if (add_field) {
+            if (fname != SV_TYPE && fname != SV_ITEMS) {
                 if (!process_field(syscall_rec, f, false)) {
                     cancel_event();
                     return false;
@@ -475,7 +399,7 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     _path_ouid.resize(0);
     _path_ogid.resize(0);
 
-    if (path_recs.size() > 0) {
+    if (!_path_recs.empty()) {
         _path_name = SV_JSON_ARRAY_START;
         _path_nametype = SV_JSON_ARRAY_START;
         _path_mode = SV_JSON_ARRAY_START;
@@ -484,72 +408,49 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
 
         int path_num = 0;
 
-        for (auto& rec: path_recs) {
-            bool found_nametype = false;
-            for (auto &f : rec) {
-                auto fname = f.FieldName();
-                if (fname.size() >= 2) {
-                    switch (fname[0]) {
-                        case 'm': {
-                            if (fname == SV_MODE) {
-                                if (path_num != 0) {
-                                    _path_mode.append(SV_JSON_ARRAY_SEP);
-                                }
-                                _path_mode.append(f.RawValuePtr(), f.RawValueSize());
-                            }
-                            break;
-                        }
-                        case 'n': {
-                            if (fname == SV_NAME) {
-                                if (path_num != 0) {
-                                    _path_name.append(SV_JSON_ARRAY_SEP);
-                                }
-                                // name might be escaped
-                                unescape_raw_field(_unescaped_val, f.RawValuePtr(), f.RawValueSize());
-                                // Path names might have non-ASCII/non-printable chars, escape the name before adding it.
-                                json_escape_string(_tmp_val, _unescaped_val.data(), _unescaped_val.size());
-                                _path_name.append(_tmp_val);
-                            } else if (fname == SV_NAMETYPE && !found_nametype) {
-                                if (path_num != 0) {
-                                    _path_nametype.append(SV_JSON_ARRAY_SEP);
-                                }
-                                _path_nametype.append(f.RawValuePtr(), f.RawValueSize());
-                                found_nametype = true;
-                            }
-                            break;
-                        }
-                        case 'o': {
-                            switch (fname[1]) {
-                                case 'b':
-                                    if (fname == SV_OBJTYPE && !found_nametype) {
-                                        if (path_num != 0) {
-                                            _path_nametype.append(SV_JSON_ARRAY_SEP);
-                                        }
-                                        _path_nametype.append(f.RawValuePtr(), f.RawValueSize());
-                                        found_nametype = true;
-                                    }
-                                    break;
-                                case 'g':
-                                    if (fname == SV_OGID) {
-                                        if (path_num != 0) {
-                                            _path_ogid.append(SV_JSON_ARRAY_SEP);
-                                        }
-                                        _path_ogid.append(f.RawValuePtr(), f.RawValueSize());
-                                    }
-                                    break;
-                                case 'u':
-                                    if (fname == SV_OUID) {
-                                        if (path_num != 0) {
-                                            _path_ouid.append(SV_JSON_ARRAY_SEP);
-                                        }
-                                        _path_ouid.append(f.RawValuePtr(), f.RawValueSize());
-                                    }
-                                    break;
-                            }
-                            break;
-                        }
-                    }
+        for (auto& order: _path_order) {
+            auto& rec = _path_recs[order.second];
+            auto name_field = rec.FieldByName(SV_NAME);
+            if (name_field) {
+                if (path_num != 0) {
+                    _path_name.append(SV_JSON_ARRAY_SEP);
+                }
+                // name might be escaped
+                unescape_raw_field(_unescaped_val, name_field.RawValuePtr(), name_field.RawValueSize());
+                // Path names might have non-ASCII/non-printable chars, escape the name before adding it.
+                json_escape_string(_tmp_val, _unescaped_val.data(), _unescaped_val.size());
+                _path_name.append(_tmp_val);
+            }
+            auto nametype_field = rec.FieldByName(SV_NAMETYPE);
+            if (!nametype_field) {
+                nametype_field = rec.FieldByName(SV_OBJTYPE);
+            }
+            if (nametype_field) {
+                if (path_num != 0) {
+                    _path_nametype.append(SV_JSON_ARRAY_SEP);
                 }
+                _path_nametype.append(nametype_field.RawValuePtr(), nametype_field.RawValueSize());
+            }
+            auto mode_field = rec.FieldByName(SV_MODE);
+            if (mode_field) {
+                if (path_num != 0) {
+                    _path_mode.append(SV_JSON_ARRAY_SEP);
+                }
+                _path_mode.append(mode_field.RawValuePtr(), mode_field.RawValueSize());
+            }
+            auto ouid_field = rec.FieldByName(SV_OUID);
+            if (ouid_field) {
+                if (path_num != 0) {
+                    _path_ouid.append(SV_JSON_ARRAY_SEP);
+                }
+                _path_ouid.append(ouid_field.RawValuePtr(), ouid_field.RawValueSize());
+            }
+            auto ogid_field = rec.FieldByName(SV_OGID);
+            if (ogid_field) {
+                if (path_num != 0) {
+                    _path_ogid.append(SV_JSON_ARRAY_SEP);
+                }
+                _path_ogid.append(ogid_field.RawValuePtr(), ogid_field.RawValueSize());
             }
             path_num += 1;
         }
@@ -613,12 +514,12 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
         }
     }
 
-    if (execve_recs.size() > 0) {
+    if (!_execve_recs.empty()) {
         // Exclude proctitle since we have EXECVE
         proctitle_rec = EventRecord();
         proctitle_field = EventRecordField();
 
-        _execve_converter.Convert(execve_recs, _cmdline);
+        _execve_converter.Convert(_execve_recs, _cmdline);
         ret = _builder->AddField(SV_CMDLINE, _cmdline, nullptr, field_type_t::UNESCAPED);
 
         if (ret != 1) {
@@ -660,13 +561,11 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
         }
     }
 
-    if (other_recs.size() > 0) {
-        for (auto& rec : other_recs) {
-            for (auto &field: rec) {
-                if (!process_field(rec, field, true)) {
-                    cancel_event();
-                    return false;
-                }
+    for (auto& rec : _other_recs) {
+        for (auto &field: rec) {
+            if (!process_field(rec, field, true)) {
+                cancel_event();
+                return false;
             }
         }
     }
@@ -687,17 +586,16 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
     }
 
     std::shared_ptr<ProcessTreeItem> p;
-    std::string cmdline;
 
-    if (!_syscall.empty() && starts_with(_syscall, "execve")) {
-        p = _processTree->AddProcess(ProcessTreeSource_execve, _pid, _ppid, uid, gid, exe, _cmdline);
+    if (!_syscall.empty() && starts_with(_syscall, S_EXECVE)) {
+        p = _processTree->AddProcess(ProcessTreeSource_execve, _pid, _ppid, uid, gid, _exe, _cmdline);
     } else if (!_syscall.empty()) {
         p = _processTree->GetInfoForPid(_pid);
     }
 
-    std::string containerid = "";
+    std::string_view containerid;
     if (p) {
-        containerid = p->_containerid;
+        containerid = p->_containerid.str();
     }
 
     ret = _builder->AddField(SV_CONTAINERID, containerid, nullptr, field_type_t::UNCLASSIFIED);
@@ -718,12 +616,11 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
         return false;
     }
 
-    bool filtered = false;
-    if (_filtersEngine->IsEventFiltered(_syscall, p, _filtersEngine->GetCommonFlagsMask())) {
-        filtered = true;
-    }
-
-    if (!filtered) {
+    // Events filtered by every output are dropped here, otherwise the flags are saved so that each output can check
+    // its own mask without repeating the lookup.
+    auto filter_flags = _filtersEngine->GetSyscallFlags(_syscall_mtype, _syscall_nr, p);
+    if ((filter_flags & _filtersEngine->GetCommonFlagsMask()).none()) {
+        _filtersEngine->SetEventFilterFlags(EventId(event.Seconds(), event.Milliseconds(), event.Serial()), filter_flags);
         end_event();
     } else {
         cancel_event();
@@ -734,6 +631,9 @@ bool RawEventProcessor::process_syscall_event(const Event& event) {
 
 void RawEventProcessor::end_event()
 {
+    if (_defer_interp) {
+        _event_flags |= EVENT_FLAG_INTERP_DEFERRED;
+    }
     _builder->SetEventFlags(_event_flags);
     _event_flags = 0;
     auto ret = _builder->EndEvent();
@@ -754,12 +654,7 @@ void RawEventProcessor::cancel_event()
 
 bool RawEventProcessor::process_field(const EventRecord& record, const EventRecordField& field, bool prepend_rec_type)
 {
-    using namespace std::string_literals;
-
-    static auto S_UNSET = "unset"s;
-
     auto val = field.RawValue();
-    auto val_ptr = field.RawValuePtr();
 
     auto field_type = FieldNameToType(static_cast<RecordType>(field.RecordType()), field.FieldName(), field.RawValue());
     if (field_type == field_type_t::UNCLASSIFIED && field.FieldType() == field_type_t::UNESCAPED) {
@@ -776,47 +671,8 @@ bool RawEventProcessor::process_field(const EventRecord& record, const EventReco
 
     _tmp_val.resize(0);
 
-    switch (field_type) {
-        case field_type_t::UID: {
-            int uid = static_cast<int>(strtoul(val_ptr, NULL, 10));
-            if (uid < 0) {
-                _tmp_val = S_UNSET;
-            } else {
-                _tmp_val = _user_db->GetUserName(uid);
-            }
-            if (_tmp_val.size() == 0) {
-                _tmp_val = "unknown-uid(" + std::to_string(uid) + ")";
-            }
-            break;
-        }
-        case field_type_t::GID: {
-            int gid = static_cast<int>(strtoul(val_ptr, NULL, 10));
-            if (gid < 0) {
-                _tmp_val = S_UNSET;
-            } else {
-                _tmp_val = _user_db->GetGroupName(gid);
-            }
-            if (_tmp_val.size() == 0) {
-                _tmp_val = "unknown-gid(" + std::to_string(gid) + ")";
-            }
-            break;
-        }
-        case field_type_t::ESCAPED_KEY:
-            if (unescape_raw_field(_tmp_val, val_ptr, field.RawValueSize()) > 0) {
-                std::replace(_tmp_val.begin(), _tmp_val.end(), static_cast<char>(KEY_SEP), ',');
-            } else {
-                _tmp_val.resize(0);
-            }
-            break;
-        case field_type_t::ESCAPED:
-            break;
-        case field_type_t::PROCTITLE:
-            break;
-        default:
-            if (!InterpretField(_tmp_val, record, field, field_type)) {
-                _tmp_val.resize(0);
-            }
-            break;
+    if (!_defer_interp) {
+        _interpreter->Interpret(_tmp_val, record, field, field_type);
     }
 
     auto ret = _builder->AddField(_field_name, val, _tmp_val, field_type);
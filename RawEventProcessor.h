@@ -22,18 +22,25 @@
 #include "ProcessTree.h"
 #include "ExecveConverter.h"
 #include "Metrics.h"
+#include "Interpret.h"
 
 class RawEventProcessor {
 public:
-    RawEventProcessor(const std::shared_ptr<EventBuilder>& builder, const std::shared_ptr<UserDB>& user_db, const std::shared_ptr<ProcessTree>& processTree, const std::shared_ptr<FiltersEngine> filtersEngine, const std::shared_ptr<Metrics>& metrics):
+    RawEventProcessor(const std::shared_ptr<EventBuilder>& builder, const std::shared_ptr<UserDB>& user_db, const std::shared_ptr<ProcessTree>& processTree, const std::shared_ptr<FiltersEngine> filtersEngine, const std::shared_ptr<Metrics>& metrics, const std::shared_ptr<FieldInterpreter>& interpreter = nullptr):
     _builder(builder), _user_db(user_db), _state_ptr(nullptr), _processTree(processTree), _filtersEngine(filtersEngine), _metrics(metrics),
-        _event_flags(0), _pid(0), _ppid(0), _uid(-1), _last_proc_event_gen(0)
+        _interpreter(interpreter), _defer_interp(false), _event_flags(0), _pid(0), _ppid(0), _uid(-1), _syscall_mtype(MachineType::UNKNOWN), _syscall_nr(-1), _last_proc_event_gen(0)
     {
         _bytes_metric = _metrics->AddMetric("data", "bytes", MetricPeriod::SECOND, MetricPeriod::HOUR);
         _record_metric = _metrics->AddMetric("data", "records", MetricPeriod::SECOND, MetricPeriod::HOUR);
         _event_metric = _metrics->AddMetric("data", "events", MetricPeriod::SECOND, MetricPeriod::HOUR);
+        if (!_interpreter) {
+            _interpreter = std::make_shared<FieldInterpreter>(_user_db, std::make_shared<InterpretCache>(InterpretCache::DEFAULT_MAX_ENTRIES, _metrics));
+        }
     }
 
+    // If true, only the raw value and field type is stored for each field, the outputs will produce the interp values.
+    void SetDeferInterpretation(bool defer) { _defer_interp = defer; }
+
     void ProcessData(const void* data, size_t data_len);
     void DoProcessInventory();
 
@@ -58,6 +65,8 @@ private:
     std::shared_ptr<Metric> _bytes_metric;
     std::shared_ptr<Metric> _record_metric;
     std::shared_ptr<Metric> _event_metric;
+    std::shared_ptr<FieldInterpreter> _interpreter;
+    bool _defer_interp;
     uint32_t _event_flags;
     pid_t _pid;
     pid_t _ppid;
@@ -66,6 +75,8 @@ private:
     std::string _exe;
     std::string _args;
     std::string _syscall;
+    MachineType _syscall_mtype;
+    int _syscall_nr;
     std::string _field_name;
     std::string _unescaped_val;
     std::string _tmp_val;
@@ -75,6 +86,10 @@ private:
     std::string _path_mode;
     std::string _path_ouid;
     std::string _path_ogid;
+    std::vector<EventRecord> _path_recs;
+    std::vector<std::pair<int, size_t>> _path_order;
+    std::vector<EventRecord> _execve_recs;
+    std::vector<EventRecord> _other_recs;
     uint64_t _last_proc_event_gen;
     ExecveConverter _execve_converter;
 };
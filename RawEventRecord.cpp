@@ -161,6 +161,18 @@ bool RawEventRecord::Parse(RecordType record_type, size_t size) {
     return false;
 }
 
+std::string_view RawEventRecord::FieldValue(std::string_view name) {
+    if (_unparsable) {
+        return std::string_view();
+    }
+    for (auto f: _record_fields) {
+        if (f.size() > name.size() && f[name.size()] == '=' && f.compare(0, name.size(), name) == 0) {
+            return f.substr(name.size()+1);
+        }
+    }
+    return std::string_view();
+}
+
 int RawEventRecord::AddRecord(EventBuilder& builder) {
     static auto SV_NODE = "node"sv;
     static auto SV_UNPARSED_TEXT = "unparsed_text"sv;
@@ -41,6 +41,9 @@ public:
     inline size_t GetSize() { return _size; }
     inline bool IsEmpty() { return _record_fields.empty(); }
 
+    // Returns the raw value of the named field, or an empty string_view if the field is not present.
+    std::string_view FieldValue(std::string_view name);
+
 private:
     std::array<char, MAX_RECORD_SIZE> _data;
     size_t _size;
@@ -0,0 +1,94 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SharedEventWriter.h"
+
+#include <cstring>
+
+ssize_t SerializedEventCache::CaptureWriter::WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) {
+    entry->data.append(reinterpret_cast<const char*>(buf), size);
+    entry->ends.push_back(entry->data.size());
+    return OK;
+}
+
+SerializedEventCache::SerializedEventCache(std::shared_ptr<IEventWriter> event_writer, size_t max_bytes):
+    _event_writer(std::move(event_writer)), _max_bytes(max_bytes), _bytes(0), _hits(0), _misses(0)
+{}
+
+ssize_t SerializedEventCache::WriteEvent(const Event& event, IWriter* writer) {
+    auto entry = get_entry(event);
+    if (!entry) {
+        return IWriter::FAILED;
+    }
+    if (entry->ret != IWriter::OK) {
+        return entry->ret;
+    }
+
+    // The entry is kept alive by the shared_ptr, so it can be written without holding the lock
+    size_t start = 0;
+    for (auto end : entry->ends) {
+        auto ret = writer->WriteAll(entry->data.data() + start, end - start);
+        if (ret != IWriter::OK) {
+            return ret;
+        }
+        start = end;
+    }
+    return IWriter::OK;
+}
+
+std::shared_ptr<const SerializedEventCache::Entry> SerializedEventCache::get_entry(const Event& event) {
+    EventId event_id(event.Seconds(), event.Milliseconds(), event.Serial());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto itr = _entries.find(event_id);
+    if (itr != _entries.end()) {
+        auto& data = itr->second->event_data;
+        if (data.size() == event.Size() && memcmp(data.data(), event.Data(), data.size()) == 0) {
+            _hits++;
+            return itr->second;
+        }
+    }
+    _misses++;
+
+    auto entry = std::make_shared<Entry>();
+    entry->event_id = event_id;
+    entry->event_data.assign(reinterpret_cast<const char*>(event.Data()), event.Size());
+    _capture.entry = entry.get();
+    entry->ret = _event_writer->WriteEvent(event, &_capture);
+    _capture.entry = nullptr;
+
+    if (entry->ret != IWriter::OK && entry->ret != IEventWriter::NOOP) {
+        return nullptr;
+    }
+
+    // Replaces any entry with the same EventId, the old entry is freed once it has been evicted from _order
+    _entries[event_id] = entry;
+    _order.emplace_back(entry);
+    _bytes += entry->event_data.size() + entry->data.size();
+
+    while (_bytes > _max_bytes && _order.size() > 1) {
+        auto& old = _order.front();
+        _bytes -= old->event_data.size() + old->data.size();
+        auto oitr = _entries.find(old->event_id);
+        if (oitr != _entries.end() && oitr->second == old) {
+            _entries.erase(oitr);
+        }
+        _order.pop_front();
+    }
+
+    return entry;
+}
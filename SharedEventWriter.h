@@ -0,0 +1,117 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUOMS_SHAREDEVENTWRITER_H
+#define AUOMS_SHAREDEVENTWRITER_H
+
+#include "IEventWriter.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * Holds the recently serialized events of one event writer, so that outputs with identical writer configs
+ * serialize each event only once. Whichever output gets to an event first serializes it, the others write the
+ * cached bytes.
+ *
+ * The writes made by the event writer are replayed one by one, so message boundaries are preserved
+ * (e.g. one datagram per record for syslog). The event writer must not keep state between events
+ * (i.e. HasPending() is always false).
+ */
+class SerializedEventCache {
+public:
+    static constexpr size_t DEFAULT_MAX_BYTES = 4*1024*1024;
+
+    explicit SerializedEventCache(std::shared_ptr<IEventWriter> event_writer, size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // Same return values as IEventWriter::WriteEvent
+    ssize_t WriteEvent(const Event& event, IWriter* writer);
+
+    uint64_t Hits() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+    uint64_t Misses() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _misses;
+    }
+
+private:
+    struct Entry {
+        EventId event_id;
+        std::string event_data; // Used to tell apart events with the same EventId
+        std::string data;
+        std::vector<size_t> ends; // The end offset of each write
+        ssize_t ret;
+    };
+
+    // Collects the writes made by the event writer into an Entry
+    class CaptureWriter: public IWriter {
+    public:
+        Entry* entry = nullptr;
+
+        ssize_t WaitWritable(long timeout) override { return OK; }
+        ssize_t WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) override;
+        using IWriter::WriteAll;
+    };
+
+    std::shared_ptr<const Entry> get_entry(const Event& event);
+
+    std::mutex _mutex;
+    std::shared_ptr<IEventWriter> _event_writer;
+    size_t _max_bytes;
+    size_t _bytes;
+    CaptureWriter _capture;
+    std::unordered_map<EventId, std::shared_ptr<const Entry>> _entries;
+    // Insertion order, for eviction
+    std::deque<std::shared_ptr<const Entry>> _order;
+    uint64_t _hits;
+    uint64_t _misses;
+};
+
+/*
+ * The event writer of one output in a group sharing a SerializedEventCache.
+ *
+ * event_writer is the output's own instance of the same event writer. It parses the acks, and writes the events
+ * directly while no other output holds the cache, so that a lone output doesn't pay for the cache.
+ */
+class SharedEventWriter: public IEventWriter {
+public:
+    SharedEventWriter(std::shared_ptr<SerializedEventCache> cache, std::shared_ptr<IEventWriter> event_writer):
+        _cache(std::move(cache)), _event_writer(std::move(event_writer)) {}
+
+    ssize_t WriteEvent(const Event& event, IWriter* writer) override {
+        if (_cache.use_count() == 1) {
+            return _event_writer->WriteEvent(event, writer);
+        }
+        return _cache->WriteEvent(event, writer);
+    }
+
+    ssize_t ReadAck(EventId& event_id, IReader* reader) override {
+        return _event_writer->ReadAck(event_id, reader);
+    }
+
+private:
+    std::shared_ptr<SerializedEventCache> _cache;
+    std::shared_ptr<IEventWriter> _event_writer;
+};
+
+#endif //AUOMS_SHAREDEVENTWRITER_H
@@ -0,0 +1,155 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SharedEventWriter.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "SharedEventWriterTests"
+#include <boost/test/unit_test.hpp>
+
+#include "TestEventQueue.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Writes a header and the raw event as two separate writes. Events with serial 0 are dropped.
+class CountingEventWriter: public IEventWriter {
+public:
+    ssize_t WriteEvent(const Event& event, IWriter* writer) override {
+        count++;
+        if (event.Serial() == 0) {
+            return NOOP;
+        }
+        auto header = "E" + std::to_string(event.Serial()) + ":";
+        auto ret = writer->WriteAll(header.data(), header.size());
+        if (ret != IWriter::OK) {
+            return ret;
+        }
+        return writer->WriteAll(event.Data(), event.Size());
+    }
+
+    ssize_t ReadAck(EventId& event_id, IReader* reader) override {
+        return IO::FAILED;
+    }
+
+    int count = 0;
+};
+
+class CaptureWriter: public IWriter {
+public:
+    ssize_t WaitWritable(long timeout) override { return OK; }
+    ssize_t WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) override {
+        writes.emplace_back(reinterpret_cast<const char*>(buf), size);
+        return OK;
+    }
+    using IWriter::WriteAll;
+
+    std::vector<std::string> writes;
+};
+
+void build_event(EventBuilder& builder, uint64_t serial, const std::string& value) {
+    BOOST_REQUIRE_EQUAL(builder.BeginEvent(1, 2, serial, 1), 1);
+    BOOST_REQUIRE_EQUAL(builder.BeginRecord(1, "TEST", "", 1), 1);
+    BOOST_REQUIRE_EQUAL(builder.AddField("value", value, nullptr, field_type_t::UNCLASSIFIED), 1);
+    BOOST_REQUIRE_EQUAL(builder.EndRecord(), 1);
+    BOOST_REQUIRE_EQUAL(builder.EndEvent(), 1);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( shared_test ) {
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+    for (uint64_t i = 0; i < 10; i++) {
+        build_event(builder, i, "value" + std::to_string(i));
+    }
+    // Same EventId, different content
+    build_event(builder, 5, "other");
+
+    auto cache_writer = std::make_shared<CountingEventWriter>();
+    auto writer1 = std::make_shared<CountingEventWriter>();
+    auto writer2 = std::make_shared<CountingEventWriter>();
+    auto cache = std::make_shared<SerializedEventCache>(cache_writer);
+    SharedEventWriter output1(cache, writer1);
+    SharedEventWriter output2(cache, writer2);
+    cache.reset();
+
+    CaptureWriter out1;
+    CaptureWriter out2;
+    for (size_t i = 0; i < queue->GetEventCount(); i++) {
+        auto ret = output1.WriteEvent(queue->GetEvent(i), &out1);
+        BOOST_REQUIRE_EQUAL(ret, i == 0 ? IEventWriter::NOOP : IWriter::OK);
+        ret = output2.WriteEvent(queue->GetEvent(i), &out2);
+        BOOST_REQUIRE_EQUAL(ret, i == 0 ? IEventWriter::NOOP : IWriter::OK);
+    }
+
+    BOOST_REQUIRE_EQUAL(cache_writer->count, queue->GetEventCount());
+    BOOST_REQUIRE_EQUAL(writer1->count, 0);
+    BOOST_REQUIRE_EQUAL(writer2->count, 0);
+
+    // The writes are replayed with the same boundaries
+    CaptureWriter expected;
+    CountingEventWriter direct;
+    for (size_t i = 0; i < queue->GetEventCount(); i++) {
+        direct.WriteEvent(queue->GetEvent(i), &expected);
+    }
+    BOOST_REQUIRE_EQUAL(out1.writes.size(), expected.writes.size());
+    for (size_t i = 0; i < expected.writes.size(); i++) {
+        BOOST_REQUIRE_EQUAL(out1.writes[i], expected.writes[i]);
+        BOOST_REQUIRE_EQUAL(out2.writes[i], expected.writes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( lone_output_test ) {
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+    build_event(builder, 1, "value");
+
+    auto cache_writer = std::make_shared<CountingEventWriter>();
+    auto writer = std::make_shared<CountingEventWriter>();
+    SharedEventWriter output(std::make_shared<SerializedEventCache>(cache_writer), writer);
+
+    CaptureWriter out;
+    BOOST_REQUIRE_EQUAL(output.WriteEvent(queue->GetEvent(0), &out), IWriter::OK);
+    BOOST_REQUIRE_EQUAL(cache_writer->count, 0);
+    BOOST_REQUIRE_EQUAL(writer->count, 1);
+    BOOST_REQUIRE_EQUAL(out.writes.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( eviction_test ) {
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+    for (uint64_t i = 1; i <= 100; i++) {
+        build_event(builder, i, "value" + std::to_string(i));
+    }
+
+    auto cache_writer = std::make_shared<CountingEventWriter>();
+    SerializedEventCache cache(cache_writer, 10*(queue->GetEvent(0).Size()*2+8));
+
+    CaptureWriter out;
+    for (size_t i = 0; i < queue->GetEventCount(); i++) {
+        BOOST_REQUIRE_EQUAL(cache.WriteEvent(queue->GetEvent(i), &out), IWriter::OK);
+    }
+    BOOST_REQUIRE_EQUAL(cache.Misses(), 100);
+
+    // Recent events are still cached, older ones have been evicted
+    BOOST_REQUIRE_EQUAL(cache.WriteEvent(queue->GetEvent(99), &out), IWriter::OK);
+    BOOST_REQUIRE_EQUAL(cache.Hits(), 1);
+    BOOST_REQUIRE_EQUAL(cache.WriteEvent(queue->GetEvent(0), &out), IWriter::OK);
+    BOOST_REQUIRE_EQUAL(cache.Misses(), 101);
+    BOOST_REQUIRE_EQUAL(cache_writer->count, 101);
+}
@@ -165,6 +165,49 @@ BOOST_AUTO_TEST_CASE( tty_escape_test ) {
     BOOST_REQUIRE_EQUAL(out, expected);
 }
 
+BOOST_AUTO_TEST_CASE( json_escape_test ) {
+    std::string in;
+    std::string expected;
+    std::string out;
+
+    // Long enough to cover the vectorized and scalar paths
+    for (int i = 0; i < 3; ++i) {
+        in.append("/usr/lib/x86_64-linux-gnu/");
+        expected.append("/usr/lib/x86_64-linux-gnu/");
+        in.push_back('"');
+        expected.append("\\\"");
+        in.push_back('\\');
+        expected.push_back('\\');
+        in.push_back('\n');
+        expected.append("\\x0A");
+        in.push_back(static_cast<char>(0xC9));
+        expected.append("\\xC9");
+        in.push_back(0x7F);
+        expected.append("\\x7F");
+    }
+
+    json_escape_string(out, in.data(), in.size());
+    BOOST_REQUIRE_EQUAL(out, expected);
+}
+
+BOOST_AUTO_TEST_CASE( json_unescaped_prefix_test ) {
+    std::string str(100, 'a');
+    BOOST_REQUIRE_EQUAL(json_unescaped_prefix(str.data(), str.size()), str.size());
+    BOOST_REQUIRE_EQUAL(json_unescaped_prefix(str.data(), 0), 0);
+
+    str[40] = static_cast<char>(0xC9);
+    str[41] = 0x7F;
+    BOOST_REQUIRE_EQUAL(json_unescaped_prefix(str.data(), str.size()), str.size());
+
+    for (size_t i : {0, 5, 15, 16, 31, 32, 33, 70, 99}) {
+        for (char c : {'"', '\\', '\n', '\0', static_cast<char>(0x1F)}) {
+            auto tmp = str;
+            tmp[i] = c;
+            BOOST_REQUIRE_EQUAL(json_unescaped_prefix(tmp.data(), tmp.size()), i);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE( bash_escape_empty ) {
     std::string in = "";
     std::string expected = "''";
@@ -17,6 +17,12 @@
 #include "StringUtils.h"
 #include <cstring>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const int s_hex2int[256] {
         // 0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
         -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0F
@@ -47,27 +53,28 @@ int decode_hex(std::string& out, const char* hex, size_t len)
         out.assign(hex, len);
         return -1;
     }
-    if (out.capacity() < len*2) {
-        out.reserve(len*2);
+    out.resize(len/2);
+
+    // Decode directly into the output buffer. Any invalid hex char will produce a negative value which will
+    // show up in the accumulated error bits.
+    auto out_ptr = reinterpret_cast<uint8_t*>(&out[0]);
+    int err = 0;
+    uint8_t needs_escaping = 0;
+    auto p = reinterpret_cast<const uint8_t*>(hex);
+    auto endp = p+len;
+    for (; p != endp; p += 2, ++out_ptr) {
+        int i1 = s_hex2int[p[0]];
+        int i2 = s_hex2int[p[1]];
+        err |= i1 | i2;
+        uint8_t c = static_cast<uint8_t>(i1 << 4 | i2);
+        *out_ptr = c;
+        // c < 0x20 || c > 0x7E
+        needs_escaping |= static_cast<uint8_t>(c - 0x20) > 0x5E;
     }
-    out.resize(0);
-
-    bool needs_escaping = false;
-    auto p = hex;
-    auto endp = hex+len;
-    while (p != endp) {
-        int i1 = s_hex2int[static_cast<uint8_t>(*p)];
-        ++p;
-        int i2 = s_hex2int[static_cast<uint8_t>(*p)];
-        ++p;
-        if (i1 < 0 || i2 < 0) {
-            // Not hex like we expected, just output the raw value
-            out.assign(hex, len);
-            return -1;
-        }
-        char c = static_cast<char>(i1 << 4 | i2);
-        out.push_back(c);
-        needs_escaping |= (c < 0x20 || c > 0x7E);
+    if (err < 0) {
+        // Not hex like we expected, just output the raw value
+        out.assign(hex, len);
+        return -1;
     }
     return needs_escaping ? 1 : 0;
 }
@@ -82,20 +89,17 @@ size_t decode_hex(void* buf, size_t buf_len, const char* hex, size_t len) {
     }
 
     uint8_t* out = reinterpret_cast<uint8_t*>(buf);
-    auto p = hex;
-    auto endp = hex+len;
-    while (p != endp) {
-        int i1 = s_hex2int[static_cast<uint8_t>(*p)];
-        ++p;
-        int i2 = s_hex2int[static_cast<uint8_t>(*p)];
-        ++p;
-        if (i1 < 0 || i2 < 0) {
-            return 0;
-        }
-        uint8_t c = static_cast<uint8_t>(i1 << 4 | i2);
-        *out = c;
-        ++out;
-        ++size;
+    int err = 0;
+    auto p = reinterpret_cast<const uint8_t*>(hex);
+    auto endp = p+len;
+    for (; p != endp; p += 2, ++out, ++size) {
+        int i1 = s_hex2int[p[0]];
+        int i2 = s_hex2int[p[1]];
+        err |= i1 | i2;
+        *out = static_cast<uint8_t>(i1 << 4 | i2);
+    }
+    if (err < 0) {
+        return 0;
     }
     return size;
 }
@@ -159,21 +163,108 @@ void tty_escape_string_append(std::string& out, const char* in, size_t in_len) {
     }
 }
 
+namespace {
+
+// JSON_STRING: '"', '\\' and chars < 0x20 (JSON string escaping, bytes >= 0x80 pass through)
+// JSON_PRINTABLE: '"' and chars outside 0x20 - 0x7E (json_escape_string)
+enum class JsonScan { JSON_STRING, JSON_PRINTABLE };
+
+template <JsonScan MODE>
+inline bool json_scan_stop(char c) {
+    if (MODE == JsonScan::JSON_STRING) {
+        return static_cast<uint8_t>(c) < 0x20 || c == '"' || c == '\\';
+    } else {
+        return static_cast<uint8_t>(c - 0x20) > 0x5E || c == '"';
+    }
+}
+
+#if defined(__SSE2__)
+template <JsonScan MODE>
+inline uint32_t json_scan_mask(__m128i s) {
+    auto dq = _mm_cmpeq_epi8(s, _mm_set1_epi8('"'));
+    if (MODE == JsonScan::JSON_STRING) {
+        // s < 0x20 <=> max(s, 0x1F) == 0x1F
+        auto ctrl = _mm_cmpeq_epi8(_mm_max_epu8(s, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+        auto bs = _mm_cmpeq_epi8(s, _mm_set1_epi8('\\'));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(ctrl, bs), dq)));
+    } else {
+        // 0x20 <= s <= 0x7E <=> max(s - 0x20, 0x5E) == 0x5E
+        auto t = _mm_sub_epi8(s, _mm_set1_epi8(0x20));
+        auto printable = _mm_cmpeq_epi8(_mm_max_epu8(t, _mm_set1_epi8(0x5E)), _mm_set1_epi8(0x5E));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_andnot_si128(printable, _mm_set1_epi8(-1)), dq)));
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+template <JsonScan MODE>
+inline uint32_t json_scan_mask(__m256i s) {
+    auto dq = _mm256_cmpeq_epi8(s, _mm256_set1_epi8('"'));
+    if (MODE == JsonScan::JSON_STRING) {
+        auto ctrl = _mm256_cmpeq_epi8(_mm256_max_epu8(s, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F));
+        auto bs = _mm256_cmpeq_epi8(s, _mm256_set1_epi8('\\'));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(ctrl, bs), dq)));
+    } else {
+        auto t = _mm256_sub_epi8(s, _mm256_set1_epi8(0x20));
+        auto printable = _mm256_cmpeq_epi8(_mm256_max_epu8(t, _mm256_set1_epi8(0x5E)), _mm256_set1_epi8(0x5E));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_andnot_si256(printable, _mm256_set1_epi8(-1)), dq)));
+    }
+}
+#endif
+
+// Return the offset of the first char in 'in' that stops the scan, or in_len if there is none.
+template <JsonScan MODE>
+size_t json_scan(const char* in, size_t in_len) {
+    size_t idx = 0;
+#if defined(__AVX2__)
+    for (; idx+32 <= in_len; idx += 32) {
+        auto mask = json_scan_mask<MODE>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+idx)));
+        if (mask != 0) {
+            return idx + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; idx+16 <= in_len; idx += 16) {
+        auto mask = json_scan_mask<MODE>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+idx)));
+        if (mask != 0) {
+            return idx + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; idx < in_len; ++idx) {
+        if (json_scan_stop<MODE>(in[idx])) {
+            return idx;
+        }
+    }
+    return in_len;
+}
+
+}
+
+size_t json_unescaped_prefix(const char* in, size_t in_len) {
+    return json_scan<JsonScan::JSON_STRING>(in, in_len);
+}
+
 void json_escape_string(std::string& out, const char* in, size_t in_len) {
     out.clear();
-    auto ptr = in;
-    auto end = ptr+in_len;
-    for (; ptr < end; ++ptr) {
-        if (*ptr < 0x20 || *ptr > 0x7E) {
-            out.push_back('\\');
-            out.push_back('x');
-            out.push_back(int2hex[static_cast<uint8_t>(*ptr) >> 4]);
-            out.push_back(int2hex[*ptr & 0xF]);
-        } else if (*ptr == '"') {
-            out.push_back('\\');
-            out.push_back('"');
-        } else {
-            out.push_back(*ptr);
+    size_t idx = 0;
+    while (idx < in_len) {
+        auto n = json_scan<JsonScan::JSON_PRINTABLE>(in+idx, in_len-idx);
+        out.append(in+idx, n);
+        idx += n;
+        if (idx < in_len) {
+            auto c = in[idx];
+            if (c == '"') {
+                out.push_back('\\');
+                out.push_back('"');
+            } else {
+                out.push_back('\\');
+                out.push_back('x');
+                out.push_back(int2hex[static_cast<uint8_t>(c) >> 4]);
+                out.push_back(int2hex[c & 0xF]);
+            }
+            ++idx;
         }
     }
 }
@@ -283,6 +374,46 @@ const char* bash_escape_codes =
 #define __SINGLE_QUOTE_NEEDED 4
 #define __BASH_QUOTE_NEEDED 8
 #define __HAS_SINGLE_QUOTE 16
+#define __END_OF_STRING 32
+
+// Per byte flags derived from char_category_codes so that the scan loop is a single table lookup and OR.
+class BashCategoryFlags {
+public:
+    BashCategoryFlags() {
+        for (int i = 0; i < 256; ++i) {
+            switch (char_category_codes[i]) {
+                case 'Z':
+                    _flags[i] = __END_OF_STRING;
+                    break;
+                case '-':
+                    _flags[i] = __BASH_QUOTE_NEEDED;
+                    break;
+                case 'q':
+                    _flags[i] = __QUOTE_NEEDED;
+                    break;
+                case 's':
+                    _flags[i] = __SINGLE_QUOTE_NEEDED;
+                    break;
+                case 'e':
+                    _flags[i] = __ESCAPE_NEEDED;
+                    break;
+                case 'S':
+                    _flags[i] = __HAS_SINGLE_QUOTE;
+                    break;
+                default:
+                    _flags[i] = 0;
+                    break;
+            }
+        }
+    }
+
+    inline uint8_t operator[](uint8_t c) const { return _flags[c]; }
+
+private:
+    uint8_t _flags[256];
+};
+
+static const BashCategoryFlags s_bash_category_flags;
 
 /*
  * Find the first null terminated string less than in_len in length and
@@ -298,32 +429,17 @@ const char* bash_escape_codes =
  */
 size_t bash_escape_string(std::string& out, const char* in, size_t in_len) {
     int flags = 0;
-    size_t size = 0;
-    const char *ptr = in;
-    const char* end = in+in_len;
-    for(; ptr < end; ++ptr, ++size) {
-        switch (char_category_codes[static_cast<uint8_t>(*ptr)]) {
-            case 'Z':
-                end = ptr;
-                size -= 1;
-                break;
-            case '-':
-                flags |= __BASH_QUOTE_NEEDED;
-                break;
-            case 'q':
-                flags |= __QUOTE_NEEDED;
-                break;
-            case 's':
-                flags |= __SINGLE_QUOTE_NEEDED;
-                break;
-            case 'e':
-                flags |= __ESCAPE_NEEDED;
-                break;
-            case 'S':
-                flags |= __HAS_SINGLE_QUOTE;
-                break;
+    auto uin = reinterpret_cast<const uint8_t*>(in);
+    auto ptr = uin;
+    auto end = uin+in_len;
+    for(; ptr < end; ++ptr) {
+        auto f = s_bash_category_flags[*ptr];
+        if (f == __END_OF_STRING) {
+            break;
         }
+        flags |= f;
     }
+    size_t size = ptr-uin;
 
     // String is empty, use '' to represent empty string on bash commandline
     if (size == 0) {
@@ -343,6 +459,7 @@ size_t bash_escape_string(std::string& out, const char* in, size_t in_len) {
         if ((flags & __HAS_SINGLE_QUOTE) != 0) {
             flags |= __BASH_QUOTE_NEEDED;
         } else {
+            out.reserve(out.size()+size+2);
             out.push_back('\'');
             out.append(in, size);
             out.push_back('\'');
@@ -352,6 +469,9 @@ size_t bash_escape_string(std::string& out, const char* in, size_t in_len) {
 
     const char* escape_codes = bare_escape_codes;
 
+    // Most chars pass through as is, so reserve for the common case.
+    out.reserve(out.size()+size+3);
+
     if ((flags & __BASH_QUOTE_NEEDED) != 0) {
         escape_codes = bash_escape_codes;
         out.append("$'");
@@ -360,24 +480,29 @@ size_t bash_escape_string(std::string& out, const char* in, size_t in_len) {
         out.push_back('"');
     }
 
-    ptr = in;
-    end = in+size;
+    // Append runs of pass through chars in one go
+    auto run_start = uin;
+    ptr = uin;
+    end = uin+size;
     for(; ptr < end; ++ptr) {
-        switch (escape_codes[static_cast<uint8_t>(*ptr)]) {
-            case '-':
-                out.push_back('\\');
-                out.push_back('x');
-                out.push_back(int2hex[static_cast<uint8_t>(*ptr) >> 4]);
-                out.push_back(int2hex[*ptr & 0xF]);
-                break;
-            case '*':
-                out.push_back(*ptr);
-                break;
-            default:
-                out.push_back('\\');
-                out.push_back(escape_codes[static_cast<uint8_t>(*ptr)]);
-                break;
+        auto code = escape_codes[*ptr];
+        if (code == '*') {
+            continue;
         }
+        if (ptr > run_start) {
+            out.append(reinterpret_cast<const char*>(run_start), ptr-run_start);
+        }
+        run_start = ptr+1;
+        if (code == '-') {
+            char hex[4] = {'\\', 'x', int2hex[*ptr >> 4], int2hex[*ptr & 0xF]};
+            out.append(hex, sizeof(hex));
+        } else {
+            char esc[2] = {'\\', code};
+            out.append(esc, sizeof(esc));
+        }
+    }
+    if (ptr > run_start) {
+        out.append(reinterpret_cast<const char*>(run_start), ptr-run_start);
     }
 
     if ((flags & __BASH_QUOTE_NEEDED) != 0) {
@@ -35,6 +35,9 @@ void tty_escape_string_append(std::string& out, const char* in, size_t in_len);
 // Same as tty_escape_string, but also escape double quote
 void json_escape_string(std::string& out, const char* in, size_t in_len);
 
+// Return the length of the leading run of chars that need no escaping in a JSON string (no '"', '\\' or chars < 0x20)
+size_t json_unescaped_prefix(const char* in, size_t in_len);
+
 size_t bash_escape_string(std::string& out, const char* in, size_t in_len);
 
 void append_hex(std::string& out, uint32_t val);
@@ -13,39 +13,113 @@
 
     THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
+
 #include "SyslogEventWriter.h"
 
 #include "Logger.h"
 #include "StringUtils.h"
 
 #include <string>
-#include <vector>
-#include <sstream>
-#include <iomanip>
+#include <cstdio>
+#include <algorithm>
+
+extern "C" {
+#include <unistd.h>
+}
 
-void SyslogEventWriter::write_string_field(const std::string& name, const std::string& value)
+bool SyslogEventWriter::ParseFormat(const std::string& str, SyslogFormat& format)
 {
-    _buffer << ' ' << name << '=' << '"' << value << '"';
+    if (str == "rfc3164") {
+        format = SyslogFormat::RFC3164;
+    } else if (str == "rfc5424") {
+        format = SyslogFormat::RFC5424;
+    } else {
+        return false;
+    }
+    return true;
 }
 
-void SyslogEventWriter::write_raw_field(const std::string& name, const char* value_data, size_t value_size)
+SyslogEventWriter::SyslogEventWriter(TextEventWriterConfig config, SyslogFormat format)
+    : TextEventWriterBase(config), _format(format), _procid(std::to_string(getpid())), _event(nullptr), _writer(nullptr),
+      _write_ret(IWriter::OK), _header_time(-1)
 {
-    _buffer << ' ' << name << '=';
-    _buffer.write(value_data, value_size);
+    _buffer.reserve(MAX_MESSAGE_SIZE);
+}
+
+ssize_t SyslogEventWriter::WriteEvent(const Event& event, IWriter* writer)
+{
+    _writer = writer;
+    _write_ret = IWriter::OK;
+    auto ret = TextEventWriterBase::WriteEvent(event, writer);
+    if (_write_ret != IWriter::OK) {
+        return _write_ret;
+    }
+    return ret;
+}
+
+void SyslogEventWriter::update_header(time_t now)
+{
+    char buf[64];
+    struct tm tm;
+    _header.clear();
+    if (_format == SyslogFormat::RFC5424) {
+        gmtime_r(&now, &tm);
+        strftime(buf, sizeof(buf), "%FT%TZ", &tm);
+        _header.append("<").append(std::to_string(PRIORITY)).append(">1 ");
+        _header.append(buf).append(" ");
+        _header.append(_config.HostnameValue.empty() ? "-" : _config.HostnameValue);
+        _header.append(" auoms ").append(_procid).append(" - - ");
+    } else {
+        localtime_r(&now, &tm);
+        strftime(buf, sizeof(buf), "%b %e %T", &tm);
+        _header.append("<").append(std::to_string(PRIORITY)).append(">");
+        _header.append(buf).append(" auoms: ");
+    }
+    _header_time = now;
+}
+
+void SyslogEventWriter::write_string_field(std::string_view name, std::string_view value)
+{
+    _buffer.push_back(' ');
+    _buffer.append(name);
+    _buffer.append("=\"");
+    _buffer.append(value);
+    _buffer.push_back('"');
+}
+
+void SyslogEventWriter::write_raw_field(std::string_view name, const char* value_data, size_t value_size)
+{
+    _buffer.push_back(' ');
+    _buffer.append(name);
+    _buffer.push_back('=');
+    _buffer.append(value_data, value_size);
 }
 
 bool SyslogEventWriter::begin_event(const Event& event) {
     _event = &event;
+    auto now = time(nullptr);
+    if (now != _header_time) {
+        update_header(now);
+    }
     return true;
 }
 
-bool SyslogEventWriter::begin_record(const EventRecord& record, const std::string& record_type_name) {
-    _buffer.str(std::string());
-    _buffer << "type=" << record_type_name;
-    _buffer << " audit(" << _event->Seconds() << '.' << std::setw(3) << std::setfill('0') <<_event->Milliseconds() << std::setw(0) << ':' << _event->Serial() << "):";
+bool SyslogEventWriter::begin_record(const EventRecord& record, std::string_view record_type_name) {
+    // Once a write has failed, the rest of the event is dropped
+    if (_write_ret != IWriter::OK) {
+        return false;
+    }
+    char buf[96];
+    auto len = snprintf(buf, sizeof(buf), " audit(%lu.%03u:%lu):", _event->Seconds(), _event->Milliseconds(), _event->Serial());
+    _buffer.assign(_header);
+    _buffer.append("type=");
+    _buffer.append(record_type_name);
+    _buffer.append(buf, len);
     return true;
 }
 
 void SyslogEventWriter::end_record(const EventRecord& record) {
-    syslog(LOG_USER | LOG_INFO, "%s", _buffer.str().c_str());
+    _write_ret = _writer->WriteAll(_buffer.data(), std::min(_buffer.size(), MAX_MESSAGE_SIZE));
 }
+
+template class TextEventWriterBase<SyslogEventWriter>;
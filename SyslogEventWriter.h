@@ -13,40 +13,71 @@
 
     THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
+
 #ifndef AUOMS_SYSLOGEVENTWRITER_H
 #define AUOMS_SYSLOGEVENTWRITER_H
 
 #include "TextEventWriter.h"
 
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <memory>
-#include <syslog.h>
+#include <ctime>
 
-class SyslogEventWriter: public TextEventWriter {
+/*
+ * Syslog message framing
+ *
+ * RFC3164:     <PRI>Mmm dd hh:mm:ss auoms: MSG (the same as syslog(3))
+ * RFC5424:     <PRI>1 TIMESTAMP HOSTNAME auoms PROCID - - MSG
+ */
+enum class SyslogFormat {
+    RFC3164,
+    RFC5424,
+};
+
+/*
+ * Writes one syslog message per record to the IWriter, which is expected to be a
+ * datagram socket (e.g. /dev/log) so that each WriteAll is one message.
+ */
+class SyslogEventWriter: public TextEventWriterBase<SyslogEventWriter> {
 public:
-    SyslogEventWriter(TextEventWriterConfig config) : TextEventWriter(config)
-    {
-	   openlog("auoms", LOG_NOWAIT, LOG_USER);
-    }
+    // Larger messages are truncated, so that they always fit in a unix datagram
+    static constexpr size_t MAX_MESSAGE_SIZE = 64*1024;
+    // LOG_USER | LOG_INFO
+    static constexpr int PRIORITY = 14;
 
-    ~SyslogEventWriter()
-    {
-	    closelog();
-    }
+    // Return false if str is not a valid format name (rfc3164, rfc5424)
+    static bool ParseFormat(const std::string& str, SyslogFormat& format);
+
+    SyslogEventWriter(TextEventWriterConfig config, SyslogFormat format = SyslogFormat::RFC3164);
+
+    virtual ssize_t WriteEvent(const Event& event, IWriter* writer);
 
 private:
-    void write_string_field(const std::string& name, const std::string& value);
-    void write_raw_field(const std::string& name, const char* value_data, size_t value_size);
+    friend class TextEventWriterBase<SyslogEventWriter>;
+
+    void write_string_field(std::string_view name, std::string_view value);
+    void write_raw_field(std::string_view name, const char* value_data, size_t value_size);
 
     bool begin_event(const Event& event);
 
-    bool begin_record(const EventRecord& record, const std::string& record_type_name);
+    bool begin_record(const EventRecord& record, std::string_view record_type_name);
     void end_record(const EventRecord& record);
 
+    // The header only changes once per second
+    void update_header(time_t now);
+
+    SyslogFormat _format;
+    std::string _procid;
     const Event* _event;
-    std::ostringstream _buffer;
+    IWriter* _writer;
+    ssize_t _write_ret;
+    time_t _header_time;
+    std::string _header;
+    std::string _buffer;
 };
 
+extern template class TextEventWriterBase<SyslogEventWriter>;
+
 
 #endif //AUOMS_SYSLOGEVENTWRITER_H
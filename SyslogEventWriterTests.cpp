@@ -0,0 +1,244 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SyslogEventWriter.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "SyslogEventWriterTests"
+#include <boost/test/unit_test.hpp>
+
+#include "BatchWriter.h"
+#include "Interpret.h"
+#include "RecordType.h"
+#include "UnixDomainWriter.h"
+#include "TempDir.h"
+#include "TestEventData.h"
+#include "TestEventWriter.h"
+
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <stdexcept>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+};
+
+namespace {
+
+int bind_dgram_socket(const std::string& path) {
+    struct sockaddr_un unaddr;
+    memset(&unaddr, 0, sizeof(struct sockaddr_un));
+    unaddr.sun_family = AF_UNIX;
+    path.copy(unaddr.sun_path, sizeof(unaddr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("socket() failed");
+    }
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&unaddr), sizeof(unaddr)) != 0) {
+        close(fd);
+        throw std::runtime_error("bind() failed");
+    }
+    return fd;
+}
+
+std::vector<std::string> recv_all(int fd) {
+    std::vector<std::string> msgs;
+    std::vector<char> buf(SyslogEventWriter::MAX_MESSAGE_SIZE+1);
+    ssize_t n;
+    while ((n = recv(fd, buf.data(), buf.size(), MSG_DONTWAIT)) >= 0) {
+        msgs.emplace_back(buf.data(), n);
+    }
+    return msgs;
+}
+
+size_t load_test_events(const std::shared_ptr<TestEventQueue>& queue) {
+    auto builder = std::make_shared<EventBuilder>(queue);
+    for (auto e : test_events) {
+        e.Write(builder);
+    }
+    size_t num_records = 0;
+    for (size_t i = 0; i < queue->GetEventCount(); ++i) {
+        auto event = queue->GetEvent(i);
+        for (auto record : event) {
+            (void)record;
+            num_records++;
+        }
+    }
+    return num_records;
+}
+
+void write_test_events(SyslogFormat format, bool batch_flush, const std::regex& header) {
+    TempDir dir("/tmp/SyslogEventWriterTests");
+    auto socket_path = dir.Path() + "/log";
+    int fd = bind_dgram_socket(socket_path);
+
+    auto queue = std::make_shared<TestEventQueue>();
+    auto num_records = load_test_events(queue);
+
+    auto writer = std::make_shared<UnixDomainWriter>(socket_path, true);
+    BOOST_REQUIRE(writer->Open());
+    BatchWriter batch(writer, 1024*1024);
+
+    TextEventWriterConfig config;
+    config.HostnameValue = TestConfigHostnameValue;
+    SyslogEventWriter syslog_writer(config, format);
+
+    for (size_t i = 0; i < queue->GetEventCount(); ++i) {
+        BOOST_REQUIRE_EQUAL(syslog_writer.WriteEvent(queue->GetEvent(i), &batch), IWriter::OK);
+    }
+    std::vector<std::string> msgs;
+    if (batch_flush) {
+        BOOST_REQUIRE_EQUAL(batch.Flush(-1, nullptr), IWriter::OK);
+        msgs = recv_all(fd);
+    } else {
+        // The receive queue may fill up (net.unix.max_dgram_qlen), so drain it between sends
+        writer->SetNonBlock(true);
+        ssize_t ret;
+        do {
+            ret = batch.WriteSome();
+            auto received = recv_all(fd);
+            msgs.insert(msgs.end(), received.begin(), received.end());
+        } while (ret == IWriter::TIMEOUT);
+        BOOST_REQUIRE_EQUAL(ret, IWriter::OK);
+    }
+    BOOST_REQUIRE_EQUAL(batch.Pending(), 0);
+    close(fd);
+
+    // One message per record
+    BOOST_REQUIRE_EQUAL(msgs.size(), num_records);
+    size_t idx = 0;
+    for (size_t i = 0; i < queue->GetEventCount(); ++i) {
+        auto event = queue->GetEvent(i);
+        for (auto record : event) {
+            std::smatch m;
+            BOOST_REQUIRE_MESSAGE(std::regex_search(msgs[idx], m, header), "Invalid header: " + msgs[idx]);
+            auto prefix = "type=" + std::string(record.RecordTypeNamePtr(), record.RecordTypeNameSize()) + " audit(";
+            BOOST_REQUIRE_EQUAL(msgs[idx].substr(m.length(), prefix.size()), prefix);
+            idx++;
+        }
+    }
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( rfc3164_test ) {
+    write_test_events(SyslogFormat::RFC3164, true, std::regex("^<14>[A-Z][a-z]{2} [ 0-9]\\d \\d{2}:\\d{2}:\\d{2} auoms: "));
+}
+
+BOOST_AUTO_TEST_CASE( rfc5424_test ) {
+    write_test_events(SyslogFormat::RFC5424, false, std::regex("^<14>1 \\d{4}-\\d{2}-\\d{2}T\\d{2}:\\d{2}:\\d{2}Z TestHostname auoms \\d+ - - "));
+}
+
+BOOST_AUTO_TEST_CASE( no_receiver_test ) {
+    TempDir dir("/tmp/SyslogEventWriterTests");
+    auto socket_path = dir.Path() + "/log";
+    int fd = bind_dgram_socket(socket_path);
+
+    auto queue = std::make_shared<TestEventQueue>();
+    load_test_events(queue);
+
+    auto writer = std::make_shared<UnixDomainWriter>(socket_path, true);
+    BOOST_REQUIRE(writer->Open());
+    close(fd);
+
+    BatchWriter batch(writer, 1024*1024);
+    TextEventWriterConfig config;
+    SyslogEventWriter syslog_writer(config);
+
+    BOOST_REQUIRE_EQUAL(syslog_writer.WriteEvent(queue->GetEvent(0), &batch), IWriter::OK);
+    BOOST_REQUIRE_EQUAL(batch.Flush(-1, nullptr), IWriter::CLOSED);
+    BOOST_REQUIRE_EQUAL(syslog_writer.WriteEvent(queue->GetEvent(0), writer.get()), IWriter::FAILED);
+}
+
+BOOST_AUTO_TEST_CASE( deferred_interpretation_test ) {
+    TempDir dir("/tmp/SyslogEventWriterTests");
+    std::ofstream(dir.Path()+"/passwd") << "root:x:0:0:root:/root:/bin/bash\nuser:x:1000:1000:user:/home/user:/bin/bash\n";
+    std::ofstream(dir.Path()+"/group") << "root:x:0:\nuser:x:1000:\n";
+    auto user_db = std::make_shared<UserDB>(dir.Path());
+    user_db->update();
+
+    auto metrics = std::make_shared<Metrics>(std::make_shared<EventBuilder>(std::make_shared<TestEventQueue>()));
+    auto interpreter = std::make_shared<FieldInterpreter>(user_db, std::make_shared<InterpretCache>(InterpretCache::DEFAULT_MAX_ENTRIES, metrics));
+
+    // One field of each type that has an interp value
+    std::vector<std::tuple<std::string, std::string, field_type_t>> fields = {
+            {"arch", "c000003e", field_type_t::ARCH},
+            {"syscall", "42", field_type_t::SYSCALL},
+            {"uid", "1000", field_type_t::UID},
+            {"gid", "0", field_type_t::GID},
+            {"auid", "4294967295", field_type_t::UID},
+            {"ouid", "1001", field_type_t::UID},
+            {"ses", "4294967295", field_type_t::SESSION},
+            {"mode", "0100644", field_type_t::MODE},
+            {"saddr", "02000050C0A801010000000000000000", field_type_t::SOCKADDR},
+            {"key", "6B657931016B657932", field_type_t::ESCAPED_KEY},
+            {"proctitle", "6C73002D6C", field_type_t::PROCTITLE},
+            {"comm", "\"ls\"", field_type_t::ESCAPED},
+            {"exit", "3", field_type_t::UNCLASSIFIED},
+    };
+
+    // The event as the event processor emits it when interpretation is deferred
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+    BOOST_REQUIRE_EQUAL(builder.BeginEvent(1, 2, 3, 1), 1);
+    BOOST_REQUIRE_EQUAL(builder.BeginRecord(static_cast<uint32_t>(RecordType::SYSCALL), "SYSCALL", "", fields.size()), 1);
+    for (auto& f : fields) {
+        BOOST_REQUIRE_EQUAL(builder.AddField(std::get<0>(f), std::get<1>(f), nullptr, std::get<2>(f)), 1);
+    }
+    BOOST_REQUIRE_EQUAL(builder.EndRecord(), 1);
+    builder.SetEventFlags(EVENT_FLAG_INTERP_DEFERRED);
+    BOOST_REQUIRE_EQUAL(builder.EndEvent(), 1);
+
+    // The same event with the interp values added by the event processor
+    auto deferred_event = queue->GetEvent(0);
+    auto deferred_rec = deferred_event.RecordAt(0);
+    std::string interp;
+    BOOST_REQUIRE_EQUAL(builder.BeginEvent(1, 2, 3, 1), 1);
+    BOOST_REQUIRE_EQUAL(builder.BeginRecord(static_cast<uint32_t>(RecordType::SYSCALL), "SYSCALL", "", fields.size()), 1);
+    for (auto field : deferred_rec) {
+        interp.resize(0);
+        interpreter->Interpret(interp, deferred_rec, field, field.FieldType());
+        BOOST_REQUIRE_EQUAL(builder.AddField(field.FieldName(), field.RawValue(), interp, field.FieldType()), 1);
+    }
+    BOOST_REQUIRE_EQUAL(builder.EndRecord(), 1);
+    BOOST_REQUIRE_EQUAL(builder.EndEvent(), 1);
+
+    TextEventWriterConfig config;
+    config.HostnameValue = TestConfigHostnameValue;
+    SyslogEventWriter syslog_writer(config, SyslogFormat::RFC5424);
+
+    TestEventWriter uninterpreted;
+    syslog_writer.WriteEvent(queue->GetEvent(0), &uninterpreted);
+
+    syslog_writer.SetFieldInterpreter(interpreter);
+    TestEventWriter deferred;
+    syslog_writer.WriteEvent(queue->GetEvent(0), &deferred);
+    TestEventWriter eager;
+    syslog_writer.WriteEvent(queue->GetEvent(1), &eager);
+
+    BOOST_REQUIRE_EQUAL(eager.GetEventCount(), 1);
+    BOOST_REQUIRE_EQUAL(deferred.GetEventCount(), 1);
+    BOOST_REQUIRE_EQUAL(deferred.GetEvent(0), eager.GetEvent(0));
+    BOOST_REQUIRE_NE(uninterpreted.GetEvent(0), eager.GetEvent(0));
+
+    for (auto expected : {"user", "root", "unset", "unknown-uid(1001)", "x86_64", "192.168.1.1", "key1,key2"}) {
+        BOOST_CHECK_MESSAGE(eager.GetEvent(0).find(expected) != std::string::npos, "Missing '" << expected << "' in: " << eager.GetEvent(0));
+    }
+}
@@ -21,25 +21,6 @@
 #include <cstdlib>
 #include <climits>
 
-void TextEventWriter::write_int32_field(const std::string& name, int32_t value)
-{
-    char buf[32];
-    int len = snprintf(buf, sizeof(buf) - 1, "%d", value);
-    write_raw_field(name, buf, len);
-}
-
-void TextEventWriter::write_int64_field(const std::string& name, int64_t value)
-{
-    char buf[32];
-    int len = snprintf(buf, sizeof(buf) - 1, "%ld", value);
-    write_raw_field(name, buf, len);
-}
-
-void TextEventWriter::write_string_field(const std::string& name, const std::string& value)
-{
-    write_raw_field(name, value.data(), value.length());
-}
-
 // ACK format: Sec:Msec:Serial\n all in fixed size HEX
 ssize_t TextEventWriter::ReadAck(EventId& event_id, IReader* reader) {
 	std::array<char, ((8+8+4)*2)+3> data;
@@ -73,166 +54,86 @@ ssize_t TextEventWriter::ReadAck(EventId& event_id, IReader* reader) {
 	return IO::OK;
 }
     
-ssize_t TextEventWriter::WriteEvent(const Event& event, IWriter* writer)
-{
-    try {
-        if (!write_event(event)) {
-            return IEventWriter::NOOP;
-        }
+/****************************************************************************
+ *
+ ****************************************************************************/
+
+TextEventWriterPlan::TextEventWriterPlan(const TextEventWriterConfig& config): _config(config) {
+    for (auto& e : _config.FieldNameOverrideMap) {
+        GetFieldPlan(e.first);
     }
-    catch (const std::exception& ex) {
-        Logger::Warn("Unexpected exception while processing event: %s", ex.what());
-        return IWriter::FAILED;
+    for (auto& e : _config.InterpFieldNameMap) {
+        GetFieldPlan(e.first);
     }
-
-    return IWriter::OK;
 }
 
-bool TextEventWriter::write_event(const Event& event)
-{
-    if (!begin_event(event))
-        return false;
+const TextEventWriterPlan::RecordPlan& TextEventWriterPlan::GetRecordPlan(int record_type, std::string_view record_type_name) {
+    auto it = _records.find(record_type);
+    if (it != _records.end()) {
+        // The name is derived from the record type, but check anyway so that the result is always correct.
+        if (it->second.source_name == record_type_name) {
+            return it->second;
+        }
+        compile_record(_tmp_record, record_type, record_type_name);
+        return _tmp_record;
+    }
 
-    int records = 0;
+    auto& plan = _records[record_type];
+    compile_record(plan, record_type, record_type_name);
+    return plan;
+}
 
-    for (auto record : event) {
-        if (write_record(record)) {
-            records++;
-        }
+const TextEventWriterPlan::FieldPlan& TextEventWriterPlan::GetFieldPlan(std::string_view field_name) {
+    auto it = _fields.find(field_name);
+    if (it != _fields.end()) {
+        return *it->second;
     }
 
-    if (records > 0) {
-        end_event(event);
-        return true;
+    if (_fields.size() >= MAX_FIELDS) {
+        compile_field(_tmp_field, field_name);
+        return _tmp_field;
     }
 
-    return false;
+    auto plan = std::make_unique<FieldPlan>();
+    compile_field(*plan, field_name);
+    std::string_view key(plan->field_name);
+    return *_fields.emplace(key, std::move(plan)).first->second;
 }
 
-bool TextEventWriter::write_record(const EventRecord& record)
-{
-	int record_type = record.RecordType();
-	std::string record_type_name = std::string(record.RecordTypeNamePtr(), record.RecordTypeNameSize());
-
-	// apply record type name overrides
-	if (!_config.RecordTypeNameOverrideMap.empty()) {
-		auto it = _config.RecordTypeNameOverrideMap.find(record_type);
-		if (it != _config.RecordTypeNameOverrideMap.end()) {
-			record_type_name = it->second;
-		}
-	}
-
-	// apply record type filters
-	if (_config.FilterRecordTypeSet.count(record_type_name) != 0) {
-		return false;
-	}
-
-	if (!begin_record(record, record_type_name)) {
-		return false;
-	}
+void TextEventWriterPlan::compile_record(RecordPlan& plan, int record_type, std::string_view record_type_name) {
+    plan.source_name.assign(record_type_name);
+    plan.name.assign(record_type_name);
 
-	for (auto field : record) {
-		write_field(field);
-	}
+    // apply record type name overrides
+    auto it = _config.RecordTypeNameOverrideMap.find(record_type);
+    if (it != _config.RecordTypeNameOverrideMap.end()) {
+        plan.name = it->second;
+    }
 
-	end_record(record);
-	return true;
+    plan.filtered = _config.FilterRecordTypeSet.count(plan.name) != 0;
 }
 
-bool TextEventWriter::write_field(const EventRecordField& field)
-{
-    bool ret = false;
-
-	std::string interp_name;
-	std::string field_name;
-	std::string raw_name;
-	std::string escaped_value;
-	std::string interp_value;
-
-	field_name.assign(field.FieldNamePtr(), field.FieldNameSize());
-
-	if (!_config.FieldNameOverrideMap.empty()) {
-		auto it = _config.FieldNameOverrideMap.find(field_name);
-		if (it != _config.FieldNameOverrideMap.end()) {
-			raw_name.assign(it->second);
-		} else {
-			raw_name.assign(field_name);
-		}
-	} else {
-		raw_name.assign(field_name);
-	}
+void TextEventWriterPlan::compile_field(FieldPlan& plan, std::string_view field_name) {
+    plan.field_name.assign(field_name);
 
-	if (!_config.InterpFieldNameMap.empty()) {
-		auto it = _config.InterpFieldNameMap.find(field_name);
-		if (it != _config.InterpFieldNameMap.end()) {
-			interp_name.assign(it->second);
-		} else {
-			interp_name.assign(raw_name);
-		}
-	} else {
-		interp_name.assign(raw_name);
-	}
+    auto it = _config.FieldNameOverrideMap.find(plan.field_name);
+    if (it != _config.FieldNameOverrideMap.end()) {
+        plan.raw_name = it->second;
+    } else {
+        plan.raw_name = plan.field_name;
+    }
 
-	if (raw_name == interp_name) {
-		raw_name.append(_config.FieldSuffix);
-	}
+    it = _config.InterpFieldNameMap.find(plan.field_name);
+    if (it != _config.InterpFieldNameMap.end()) {
+        plan.interp_name = it->second;
+    } else {
+        plan.interp_name = plan.raw_name;
+    }
 
-	if (field.FieldType() == field_type_t::ESCAPED || field.FieldType() == field_type_t::PROCTITLE) {
-		// If the field type is FIELD_TYPE_ESCAPED, then there is no interp value in the event.
-		if (_config.FilterFieldNameSet.count(interp_name) == 0) {
-			switch (unescape_raw_field(interp_value, field.RawValuePtr(), field.RawValueSize())) {
-				case -1: // _interp_value is identical to _raw_value
-				case 0: // _raw_value was "(null)"
-				default:
-					write_raw_field(interp_name, field.RawValuePtr(), field.RawValueSize());
-					break;
-				case 1: // _raw_value was double quoted
-				case 2: // _raw_value was hex encoded
-					write_string_field(interp_name, interp_value);
-					break;
-				case 3: // _raw_value was hex encoded and decoded string needs escaping
-					tty_escape_string(escaped_value, interp_value.data(), interp_value.size());
-					write_string_field(interp_name, escaped_value);
-					break;
-			}
-            ret = true;
-		}
-	} else {
-        if (field.InterpValueSize() > 0) {
-			if (_config.FilterFieldNameSet.count(interp_name) == 0) {
-				switch (field.FieldType()) {
-					case field_type_t::SESSION:
-						// Since the interpreted value for SES is also (normally) an int
-						// Replace "unset" and "4294967295" with "-1"
-						if ((field.InterpValueSize() == 5 && std::strncmp("unset", field.InterpValuePtr(), field.InterpValueSize()) == 0) ||
-								(field.InterpValueSize() == 10 && strncmp("4294967295", field.InterpValuePtr(), field.InterpValueSize()) == 0)) {
-							write_string_field(interp_name, "-1");
-						} else {
-							write_raw_field(interp_name, field.InterpValuePtr(), field.InterpValueSize());
-						}
-						break;
-					default:
-						write_raw_field(interp_name, field.InterpValuePtr(), field.InterpValueSize());
-				}
-                ret = true;
-			}
-			// write additional raw field
-			if (_config.FilterFieldNameSet.count(raw_name) == 0) {
-				write_raw_field(raw_name, field.RawValuePtr(), field.RawValueSize());
-                ret = true;
-			}
-		} else if (_config.FilterFieldNameSet.count(interp_name) == 0) {
-            if (field.FieldType() == field_type_t::UNESCAPED) {
-                // fields we have created that potentially need escaping
-                tty_escape_string(escaped_value, field.RawValuePtr(), field.RawValueSize());
-                write_string_field(interp_name, escaped_value);
-            }
-            else {
-			    // Use interp name for raw value because there is no interp value
-				write_raw_field(interp_name, field.RawValuePtr(), field.RawValueSize());
-			}
-            ret = true;
-		}
-	}
-    return ret;
+    if (plan.raw_name == plan.interp_name) {
+        plan.raw_name.append(_config.FieldSuffix);
+    }
+
+    plan.write_interp = _config.FilterFieldNameSet.count(plan.interp_name) == 0;
+    plan.write_raw = _config.FilterFieldNameSet.count(plan.raw_name) == 0;
 }
@@ -18,36 +18,261 @@
 #define AUOMS_TEXTEVENTWRITER_H
 
 #include "IEventWriter.h"
+#include "IFieldInterpreter.h"
 #include "TextEventWriterConfig.h"
+#include "StringUtils.h"
+#include "Logger.h"
 
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_map>
 
+// The TextEventWriterConfig name overrides and filters resolved per record type and per field name,
+// so that writing a record or field needs a single lookup and no allocation.
+class TextEventWriterPlan {
+public:
+    // Limits the number of distinct field names cached.
+    static constexpr size_t MAX_FIELDS = 4096;
+
+    struct RecordPlan {
+        std::string source_name;
+        std::string name;
+        bool filtered;
+    };
+
+    struct FieldPlan {
+        std::string field_name;
+        std::string interp_name; // Name for the interpreted value, or the raw value if there is no interpreted value
+        std::string raw_name; // Name for the raw value when there is also an interpreted value
+        bool write_interp;
+        bool write_raw;
+    };
+
+    // Fields named in the config are compiled immediately, all others on first use.
+    explicit TextEventWriterPlan(const TextEventWriterConfig& config);
+
+    const RecordPlan& GetRecordPlan(int record_type, std::string_view record_type_name);
+    const FieldPlan& GetFieldPlan(std::string_view field_name);
+
+private:
+    void compile_record(RecordPlan& plan, int record_type, std::string_view record_type_name);
+    void compile_field(FieldPlan& plan, std::string_view field_name);
+
+    const TextEventWriterConfig& _config;
+    std::unordered_map<int, RecordPlan> _records;
+    // The keys refer to FieldPlan::field_name
+    std::unordered_map<std::string_view, std::unique_ptr<FieldPlan>> _fields;
+    RecordPlan _tmp_record;
+    FieldPlan _tmp_field;
+};
+
+// State and config shared by all text writers. The serialization is done by TextEventWriterBase.
 class TextEventWriter: public IEventWriter {
 public:
-    TextEventWriter(TextEventWriterConfig config) : _config(config)
+    TextEventWriter(TextEventWriterConfig config) : _config(config), _plan(_config), _interpret_fields(false)
     {}
+    TextEventWriter(const TextEventWriter&) = delete;
+    TextEventWriter& operator=(const TextEventWriter&) = delete;
+
     ssize_t ReadAck(EventId& event_id, IReader* reader);
-    ssize_t WriteEvent(const Event& event, IWriter* writer);
 
-protected:
+    // Used to produce the interp values for events marked with EVENT_FLAG_INTERP_DEFERRED
+    void SetFieldInterpreter(const std::shared_ptr<IFieldInterpreter>& interpreter) { _interpreter = interpreter; }
 
+protected:
     TextEventWriterConfig _config;
+    TextEventWriterPlan _plan;
+    std::shared_ptr<IFieldInterpreter> _interpreter;
+    bool _interpret_fields;
+    std::string _deferred_interp_value;
+    std::string _interp_value;
+    std::string _escaped_value;
+};
 
-    virtual void write_raw_field(const std::string& name, const char* value_data, size_t value_size) = 0;
-    virtual void write_int32_field(const std::string& name, int32_t value);
-    virtual void write_int64_field(const std::string& name, int64_t value);
-    virtual void write_string_field(const std::string& name, const std::string& value);
+/*
+ * Serializes events through the methods of Derived (CRTP), so that the per-field calls are resolved at compile time
+ * and can be inlined into the concrete writer.
+ *
+ * Derived must implement:
+ *      void write_raw_field(std::string_view name, const char* value_data, size_t value_size);
+ * And may hide any of the other write_*, begin_* and end_* methods below.
+ *
+ * Derived writers declare "extern template class TextEventWriterBase<Derived>;" in their header and instantiate it
+ * in their .cpp, next to the definitions of the methods the core calls.
+ */
+template <class Derived>
+class TextEventWriterBase: public TextEventWriter {
+public:
+    TextEventWriterBase(TextEventWriterConfig config) : TextEventWriter(std::move(config))
+    {}
+
+    ssize_t WriteEvent(const Event& event, IWriter* writer) {
+        try {
+            if (!write_event(event)) {
+                return IEventWriter::NOOP;
+            }
+        }
+        catch (const std::exception& ex) {
+            Logger::Warn("Unexpected exception while processing event: %s", ex.what());
+            return IWriter::FAILED;
+        }
 
-    virtual bool begin_event(const Event& event) {return true;}
-    virtual void end_event(const Event& event) {}
+        return IWriter::OK;
+    }
+
+protected:
+    inline Derived& derived() { return *static_cast<Derived*>(this); }
 
-    virtual bool begin_record(const EventRecord &record, const std::string& record_name) {return true;}
-    virtual void end_record(const EventRecord &record) {}
+    inline void write_int32_field(std::string_view name, int32_t value) {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf) - 1, "%d", value);
+        derived().write_raw_field(name, buf, len);
+    }
 
-    virtual bool write_field(const EventRecordField& field);
-    virtual bool write_record(const EventRecord& rec);
-    virtual bool write_event(const Event& event);
+    inline void write_int64_field(std::string_view name, int64_t value) {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf) - 1, "%ld", value);
+        derived().write_raw_field(name, buf, len);
+    }
+
+    inline void write_string_field(std::string_view name, std::string_view value) {
+        derived().write_raw_field(name, value.data(), value.size());
+    }
+
+    inline bool begin_event(const Event& event) { return true; }
+    inline void end_event(const Event& event) {}
+
+    inline bool begin_record(const EventRecord& record, std::string_view record_type_name) { return true; }
+    inline void end_record(const EventRecord& record) {}
+
+    bool write_event(const Event& event);
+    bool write_record(const EventRecord& record);
+    bool write_field(const EventRecord& record, const EventRecordField& field);
 };
 
+template <class Derived>
+bool TextEventWriterBase<Derived>::write_event(const Event& event)
+{
+    _interpret_fields = _interpreter && (event.Flags() & EVENT_FLAG_INTERP_DEFERRED) != 0;
+
+    if (!derived().begin_event(event))
+        return false;
+
+    int records = 0;
+
+    for (auto record : event) {
+        if (write_record(record)) {
+            records++;
+        }
+    }
+
+    if (records > 0) {
+        derived().end_event(event);
+        return true;
+    }
+
+    return false;
+}
+
+template <class Derived>
+bool TextEventWriterBase<Derived>::write_record(const EventRecord& record)
+{
+    auto& plan = _plan.GetRecordPlan(record.RecordType(), std::string_view(record.RecordTypeNamePtr(), record.RecordTypeNameSize()));
+
+    // apply record type filters
+    if (plan.filtered) {
+        return false;
+    }
+
+    if (!derived().begin_record(record, plan.name)) {
+        return false;
+    }
+
+    for (auto field : record) {
+        write_field(record, field);
+    }
+
+    derived().end_record(record);
+    return true;
+}
+
+template <class Derived>
+bool TextEventWriterBase<Derived>::write_field(const EventRecord& record, const EventRecordField& field)
+{
+    bool ret = false;
+
+    auto& plan = _plan.GetFieldPlan(std::string_view(field.FieldNamePtr(), field.FieldNameSize()));
+
+    if (field.FieldType() == field_type_t::ESCAPED || field.FieldType() == field_type_t::PROCTITLE) {
+        // If the field type is FIELD_TYPE_ESCAPED, then there is no interp value in the event.
+        if (plan.write_interp) {
+            switch (unescape_raw_field(_interp_value, field.RawValuePtr(), field.RawValueSize())) {
+                case -1: // _interp_value is identical to _raw_value
+                case 0: // _raw_value was "(null)"
+                default:
+                    derived().write_raw_field(plan.interp_name, field.RawValuePtr(), field.RawValueSize());
+                    break;
+                case 1: // _raw_value was double quoted
+                case 2: // _raw_value was hex encoded
+                    derived().write_string_field(plan.interp_name, _interp_value);
+                    break;
+                case 3: // _raw_value was hex encoded and decoded string needs escaping
+                    tty_escape_string(_escaped_value, _interp_value.data(), _interp_value.size());
+                    derived().write_string_field(plan.interp_name, _escaped_value);
+                    break;
+            }
+            ret = true;
+        }
+    } else {
+        const char* interp_ptr = field.InterpValuePtr();
+        size_t interp_size = field.InterpValueSize();
+        if (interp_size == 0 && _interpret_fields) {
+            if (_interpreter->Interpret(_deferred_interp_value, record, field, field.FieldType()) && !_deferred_interp_value.empty()) {
+                interp_ptr = _deferred_interp_value.data();
+                interp_size = _deferred_interp_value.size();
+            }
+        }
+        if (interp_size > 0) {
+            if (plan.write_interp) {
+                switch (field.FieldType()) {
+                    case field_type_t::SESSION:
+                        // Since the interpreted value for SES is also (normally) an int
+                        // Replace "unset" and "4294967295" with "-1"
+                        if ((interp_size == 5 && std::strncmp("unset", interp_ptr, interp_size) == 0) ||
+                                (interp_size == 10 && strncmp("4294967295", interp_ptr, interp_size) == 0)) {
+                            derived().write_string_field(plan.interp_name, "-1");
+                        } else {
+                            derived().write_raw_field(plan.interp_name, interp_ptr, interp_size);
+                        }
+                        break;
+                    default:
+                        derived().write_raw_field(plan.interp_name, interp_ptr, interp_size);
+                }
+                ret = true;
+            }
+            // write additional raw field
+            if (plan.write_raw) {
+                derived().write_raw_field(plan.raw_name, field.RawValuePtr(), field.RawValueSize());
+                ret = true;
+            }
+        } else if (plan.write_interp) {
+            if (field.FieldType() == field_type_t::UNESCAPED) {
+                // fields we have created that potentially need escaping
+                tty_escape_string(_escaped_value, field.RawValuePtr(), field.RawValueSize());
+                derived().write_string_field(plan.interp_name, _escaped_value);
+            }
+            else {
+                // Use interp name for raw value because there is no interp value
+                derived().write_raw_field(plan.interp_name, field.RawValuePtr(), field.RawValueSize());
+            }
+            ret = true;
+        }
+    }
+    return ret;
+}
+
 
 #endif //AUOMS_TEXTEVENTWRITER_H
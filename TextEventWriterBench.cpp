@@ -0,0 +1,170 @@
+/*
+    microsoft-oms-auditd-plugin
+
+    Copyright (c) Microsoft Corporation
+
+    All rights reserved.
+
+    MIT License
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the ""Software""), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "OMSEventWriter.h"
+#include "FluentEventWriter.h"
+#include "SyslogEventWriter.h"
+#include "JSONEventWriter.h"
+#include "TestEventQueue.h"
+#include "RecordType.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Measures the per-event cost of each event writer format, serializing into a writer that discards the output.
+ *
+ * Usage: TextEventWriterBench [iterations] [oms|fluent|json|syslog ...]
+ */
+
+class NullWriter: public IWriter {
+public:
+    NullWriter(): _bytes(0) {}
+
+    ssize_t WaitWritable(long timeout) override {
+        return OK;
+    }
+
+    ssize_t WriteAll(const void *buf, size_t size, long timeout, const std::function<bool()>& fn) override {
+        _bytes += size;
+        return OK;
+    }
+
+    uint64_t Bytes() { return _bytes; }
+
+private:
+    uint64_t _bytes;
+};
+
+Event build_event(EventBuilder& builder, TestEventQueue& queue) {
+    builder.BeginEvent(1521757638, 392, 262332, 5);
+
+    builder.BeginRecord(static_cast<uint32_t>(RecordType::SYSCALL), "SYSCALL", "", 21);
+    builder.AddField("arch", "C000003E", "x86_64", field_type_t::ARCH);
+    builder.AddField("syscall", "59", "execve", field_type_t::SYSCALL);
+    builder.AddField("success", "yes", nullptr, field_type_t::SUCCESS);
+    builder.AddField("exit", "0", nullptr, field_type_t::EXIT);
+    builder.AddField("a0", "55b5a6ae2c38", nullptr, field_type_t::A0);
+    builder.AddField("a1", "55b5a6ae3bd8", nullptr, field_type_t::A1);
+    builder.AddField("a2", "55b5a6ae2ea0", nullptr, field_type_t::A2);
+    builder.AddField("a3", "0", nullptr, field_type_t::A3);
+    builder.AddField("items", "2", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("ppid", "10735", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("pid", "10736", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("auid", "1000", "user", field_type_t::UID);
+    builder.AddField("uid", "0", "root", field_type_t::UID);
+    builder.AddField("gid", "0", "root", field_type_t::GID);
+    builder.AddField("euid", "0", "root", field_type_t::UID);
+    builder.AddField("egid", "0", "root", field_type_t::GID);
+    builder.AddField("tty", "pts0", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("ses", "4294967295", "unset", field_type_t::SESSION);
+    builder.AddField("comm", "\"grep\"", nullptr, field_type_t::ESCAPED);
+    builder.AddField("exe", "\"/bin/grep\"", nullptr, field_type_t::ESCAPED);
+    builder.AddField("key", "(null)", nullptr, field_type_t::ESCAPED);
+    builder.EndRecord();
+
+    builder.BeginRecord(static_cast<uint32_t>(RecordType::EXECVE), "EXECVE", "", 4);
+    builder.AddField("argc", "3", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("a0", "\"grep\"", nullptr, field_type_t::ESCAPED);
+    builder.AddField("a1", "\"-i\"", nullptr, field_type_t::ESCAPED);
+    builder.AddField("a2", "6572726F7220696E206C6F67", nullptr, field_type_t::ESCAPED);
+    builder.EndRecord();
+
+    builder.BeginRecord(static_cast<uint32_t>(RecordType::CWD), "CWD", "", 1);
+    builder.AddField("cwd", "\"/var/log\"", nullptr, field_type_t::ESCAPED);
+    builder.EndRecord();
+
+    builder.BeginRecord(static_cast<uint32_t>(RecordType::PATH), "PATH", "", 9);
+    builder.AddField("item", "0", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("name", "\"/bin/grep\"", nullptr, field_type_t::ESCAPED);
+    builder.AddField("inode", "262214", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("dev", "08:01", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("mode", "0100755", "file,755", field_type_t::MODE);
+    builder.AddField("ouid", "0", "root", field_type_t::UID);
+    builder.AddField("ogid", "0", "root", field_type_t::GID);
+    builder.AddField("rdev", "00:00", nullptr, field_type_t::UNCLASSIFIED);
+    builder.AddField("nametype", "NORMAL", nullptr, field_type_t::UNCLASSIFIED);
+    builder.EndRecord();
+
+    builder.BeginRecord(static_cast<uint32_t>(RecordType::PROCTITLE), "PROCTITLE", "", 1);
+    builder.AddField("proctitle", "67726570002D69006572726F7220696E206C6F67", nullptr, field_type_t::PROCTITLE);
+    builder.EndRecord();
+
+    builder.EndEvent();
+
+    return queue.GetEvent(static_cast<int>(queue.GetEventCount()-1));
+}
+
+std::shared_ptr<IEventWriter> make_writer(const std::string& format, const TextEventWriterConfig& config) {
+    if (format == "oms") {
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new OMSEventWriter(config)));
+    } else if (format == "fluent") {
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new FluentEventWriter(config, "LINUX_AUDITD_BLOB")));
+    } else if (format == "json") {
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new JSONEventWriter(config)));
+    } else if (format == "syslog") {
+        return std::shared_ptr<IEventWriter>(static_cast<IEventWriter*>(new SyslogEventWriter(config)));
+    }
+    return nullptr;
+}
+
+int main(int argc, char** argv) {
+    long iterations = 1000000;
+    if (argc > 1) {
+        iterations = std::stol(argv[1]);
+    }
+
+    std::vector<std::string> formats;
+    for (int i = 2; i < argc; ++i) {
+        formats.emplace_back(argv[i]);
+    }
+    if (formats.empty()) {
+        formats = {"oms", "fluent", "json", "syslog"};
+    }
+
+    auto queue = std::make_shared<TestEventQueue>();
+    EventBuilder builder(queue);
+    auto event = build_event(builder, *queue);
+
+    TextEventWriterConfig config;
+
+    for (auto& format : formats) {
+        auto writer = make_writer(format, config);
+        if (!writer) {
+            std::cerr << "Unknown format: " << format << std::endl;
+            return 1;
+        }
+
+        NullWriter out;
+        writer->WriteEvent(event, &out);
+        uint64_t event_size = out.Bytes();
+
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            writer->WriteEvent(event, &out);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+
+        std::cout << format << ": " << static_cast<uint64_t>(iterations/secs) << " events/sec"
+                  << " (" << static_cast<uint64_t>(secs*1e9/iterations) << " ns/event, "
+                  << event_size << " bytes/event)" << std::endl;
+    }
+
+    return 0;
+}
@@ -154,6 +154,15 @@ static std::unordered_map<std::string, config_set_func_t> _configSetters = {
         }},
 };
 
+std::vector<std::string> TextEventWriterConfig::ConfigKeys()
+{
+    std::vector<std::string> keys;
+    for (auto& cs : _configSetters) {
+        keys.emplace_back(cs.first);
+    }
+    return keys;
+}
+
 void TextEventWriterConfig::LoadFromConfig(std::string name, const Config& config)
 {
     for (auto cs : _configSetters) {
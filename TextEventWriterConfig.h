@@ -20,6 +20,9 @@
 #include "ProcFilter.h"
 #include "FiltersEngine.h"
 
+#include <string>
+#include <vector>
+
 class TextEventWriterConfig {
 public:
     explicit TextEventWriterConfig()
@@ -43,6 +46,9 @@ public:
 
     void LoadFromConfig(std::string name, const Config& config);
 
+    // The names of the config keys read by LoadFromConfig
+    static std::vector<std::string> ConfigKeys();
+
     std::string TimestampFieldName;
     std::string SerialFieldName;
     std::string MsgTypeFieldName;
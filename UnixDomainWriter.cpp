@@ -36,7 +36,7 @@ bool UnixDomainWriter::Open()
     unaddr.sun_family = AF_UNIX;
     _addr.copy(unaddr.sun_path, sizeof(unaddr.sun_path));
 
-    int fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    int fd = socket(AF_UNIX, (_datagram ? SOCK_DGRAM : SOCK_STREAM)|SOCK_CLOEXEC, 0);
     if (-1 == fd) {
         throw std::system_error(errno, std::system_category(), "socket() failed");
     }
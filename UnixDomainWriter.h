@@ -22,12 +22,15 @@
 
 class UnixDomainWriter: public IOBase {
 public:
-    UnixDomainWriter(const std::string& addr): IOBase(-1), _addr(addr) {}
+    UnixDomainWriter(const std::string& addr, bool datagram = false): IOBase(-1), _addr(addr), _datagram(datagram) {}
 
     virtual bool Open();
 
+    bool IsDatagram() override { return _datagram; }
+
 private:
     std::string _addr;
+    bool _datagram;
 };
 
 #endif //AUOMS_UNIXDOMAINWRITER_H
@@ -32,6 +32,7 @@
 #include "FiltersEngine.h"
 #include "ProcessTree.h"
 #include "Metrics.h"
+#include "Interpret.h"
 #include "SyscallMetrics.h"
 #include "SystemMetrics.h"
 #include "ProcMetrics.h"
@@ -215,6 +216,31 @@ int main(int argc, char**argv) {
         exit(1);
     }
 
+    bool defer_interpretation = false;
+    if (config.HasKey("defer_interpretation")) {
+        defer_interpretation = config.GetBool("defer_interpretation");
+    }
+
+    size_t interp_cache_size = InterpretCache::DEFAULT_MAX_ENTRIES;
+    if (config.HasKey("interp_cache_size")) {
+        try {
+            interp_cache_size = config.GetUint64("interp_cache_size");
+        } catch(std::exception& ex) {
+            Logger::Error("Invalid 'interp_cache_size' value: %s", config.GetString("interp_cache_size").c_str());
+            exit(1);
+        }
+    }
+
+    size_t output_event_loops = 0;
+    if (config.HasKey("output_event_loops")) {
+        try {
+            output_event_loops = config.GetUint64("output_event_loops");
+        } catch(std::exception& ex) {
+            Logger::Error("Invalid 'output_event_loops' value: %s", config.GetString("output_event_loops").c_str());
+            exit(1);
+        }
+    }
+
     bool use_syslog = true;
     if (config.HasKey("use_syslog")) {
         use_syslog = config.GetBool("use_syslog");
@@ -325,12 +351,14 @@ int main(int argc, char**argv) {
         exit(1);
     }
 
+    auto interpreter = std::make_shared<FieldInterpreter>(user_db, std::make_shared<InterpretCache>(interp_cache_size, metrics));
+
     auto filtersEngine = std::make_shared<FiltersEngine>();
 
-    auto processTree = std::make_shared<ProcessTree>(user_db, filtersEngine);
+    auto processTree = std::make_shared<ProcessTree>(user_db, filtersEngine, metrics);
     processTree->PopulateTree(); // Pre-populate tree
 
-    Outputs outputs(queue, outconf_dir, cursor_dir, allowed_socket_dirs, user_db, filtersEngine, processTree);
+    Outputs outputs(queue, outconf_dir, cursor_dir, allowed_socket_dirs, user_db, filtersEngine, processTree, interpreter, defer_interpretation, output_event_loops);
 
     std::thread autosave_thread([&]() {
         Signals::InitThread();
@@ -386,7 +414,8 @@ int main(int argc, char**argv) {
     auto event_queue = std::make_shared<EventQueue>(queue);
     auto builder = std::make_shared<EventBuilder>(event_queue);
 
-    RawEventProcessor rep(builder, user_db, processTree, filtersEngine, metrics);
+    RawEventProcessor rep(builder, user_db, processTree, filtersEngine, metrics, interpreter);
+    rep.SetDeferInterpretation(defer_interpretation);
     inputs.Start();
 
     Signals::SetExitHandler([&inputs]() {
@@ -0,0 +1 @@
+#define AUOMS_VERSION "2.2.4.0"
\ No newline at end of file
@@ -84,6 +84,10 @@ bool parsePath(std::vector<std::string>& dirs, const std::string& path_str) {
 }
 
 
+// How often incomplete events are checked against the accumulator's (adaptive) flush timeout
+constexpr long FLUSH_POLL_INTERVAL = 20; // milliseconds
+constexpr long MAX_FLUSH_TIMEOUT = 200; // milliseconds
+
 void DoStdinCollection(RawEventAccumulator& accumulator) {
     StdinReader reader;
 
@@ -91,7 +95,7 @@ void DoStdinCollection(RawEventAccumulator& accumulator) {
         std::unique_ptr<RawEventRecord> record = std::make_unique<RawEventRecord>();
 
         for (;;) {
-            ssize_t nr = reader.ReadLine(record->Data(), RawEventRecord::MAX_RECORD_SIZE, 100, [] {
+            ssize_t nr = reader.ReadLine(record->Data(), RawEventRecord::MAX_RECORD_SIZE, FLUSH_POLL_INTERVAL, [] {
                 return Signals::IsExit();
             });
             if (nr > 0) {
@@ -106,7 +110,7 @@ void DoStdinCollection(RawEventAccumulator& accumulator) {
                     Logger::Info("Exiting input loop");
                     break;
                 }
-                accumulator.Flush(200);
+                accumulator.Flush(MAX_FLUSH_TIMEOUT);
             } else { // nr == StdinReader::CLOSED, StdinReader::FAILED or StdinReader::INTERRUPTED
                 if (nr == StdinReader::CLOSED) {
                     Logger::Info("STDIN closed, exiting input loop");
@@ -243,12 +247,12 @@ bool DoNetlinkCollection(RawEventAccumulator& accumulator) {
 
     auto _last_pid_check = std::chrono::steady_clock::now();
     while(!Signals::IsExit()) {
-        if (_stop_gate.Wait(Gate::OPEN, 100)) {
+        if (_stop_gate.Wait(Gate::OPEN, FLUSH_POLL_INTERVAL)) {
             return false;
         }
 
         try {
-            accumulator.Flush(200);
+            accumulator.Flush(MAX_FLUSH_TIMEOUT);
         } catch (const std::exception &ex) {
             Logger::Error("Unexpected exception while flushing input: %s", ex.what());
             exit(1);
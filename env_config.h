@@ -0,0 +1 @@
+/root/repo/build/env_config.h
\ No newline at end of file